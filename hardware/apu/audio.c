@@ -0,0 +1,173 @@
+#include <string.h>
+#include "audio.h"
+
+/******************************************************************************
+ *
+ *   Audio ring
+ *   Single producer, single consumer lock free ring of stereo frames in
+ *   the mixer output format. The emulation writes, the frontend audio
+ *   callback pulls
+ *   with audio_read from its own thread. Positions run free and only
+ *   their owner stores them, so a release store on one side and an
+ *   acquire load on the other are all the synchronisation needed.
+ *
+ ******************************************************************************/
+
+// Define ring storage and size of one frame in bytes
+static unsigned char audio_ring[AUDIO_RING_FRAMES * AUDIO_MAX_FRAME_BYTES];
+static unsigned int audio_frame_bytes = 2 * sizeof(short);
+// Define frames written, owned by the producer
+static unsigned int audio_head = 0;
+// Define frames read, owned by the consumer
+static unsigned int audio_tail = 0;
+// Define fill level rate control aims for
+static unsigned int audio_latency = AUDIO_LATENCY_FRAMES;
+// Define last frame read, repeated on underrun instead of a click to 0
+static unsigned char audio_last[AUDIO_MAX_FRAME_BYTES];
+// Define underrun and overrun counters in frames
+unsigned int audio_underruns = 0;
+unsigned int audio_overruns = 0;
+
+/******************************************************************************
+ *
+ *   Audio reset
+ *   Empty the ring, only safe while the consumer is stopped
+ *
+ ******************************************************************************/
+void audio_reset()
+{
+    __atomic_store_n(&audio_head, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&audio_tail, 0, __ATOMIC_RELEASE);
+    memset(audio_last, 0, sizeof(audio_last));
+    audio_underruns = audio_overruns = 0;
+}
+
+/******************************************************************************
+ *
+ *   Audio frame size
+ *   Set bytes per frame for a new output format, empties the ring
+ *
+ ******************************************************************************/
+void audio_set_frame_bytes(unsigned int bytes)
+{
+    if (bytes > AUDIO_MAX_FRAME_BYTES)
+        bytes = AUDIO_MAX_FRAME_BYTES;
+    audio_frame_bytes = bytes;
+    audio_reset();
+}
+
+unsigned int audio_get_frame_bytes()
+{
+    return audio_frame_bytes;
+}
+
+/******************************************************************************
+ *
+ *   Audio write
+ *   Producer side, append up to "count" frames and return how many fit
+ *
+ ******************************************************************************/
+unsigned int audio_write(const void *frames, unsigned int count)
+{
+    const unsigned char *input = frames;
+    unsigned int head = __atomic_load_n(&audio_head, __ATOMIC_RELAXED);
+    unsigned int tail = __atomic_load_n(&audio_tail, __ATOMIC_ACQUIRE);
+    unsigned int space = AUDIO_RING_FRAMES - (head - tail);
+    unsigned int index = head & (AUDIO_RING_FRAMES - 1);
+    unsigned int first;
+
+    if (count > space)
+    {
+        audio_overruns += count - space;
+        count = space;
+    }
+    first = AUDIO_RING_FRAMES - index;
+    if (first > count)
+        first = count;
+    memcpy(&audio_ring[index * audio_frame_bytes], input, first * audio_frame_bytes);
+    memcpy(audio_ring, &input[first * audio_frame_bytes], (count - first) * audio_frame_bytes);
+    __atomic_store_n(&audio_head, head + count, __ATOMIC_RELEASE);
+    return count;
+}
+
+/******************************************************************************
+ *
+ *   Audio read
+ *   Consumer side, copy "frames" frames to "buffer". Missing frames
+ *   repeat the last one. Returns the number of frames taken from the ring.
+ *
+ ******************************************************************************/
+unsigned int audio_read(void *buffer, unsigned int frames)
+{
+    unsigned char *output = buffer;
+    unsigned int tail = __atomic_load_n(&audio_tail, __ATOMIC_RELAXED);
+    unsigned int head = __atomic_load_n(&audio_head, __ATOMIC_ACQUIRE);
+    unsigned int count = head - tail;
+    unsigned int index = tail & (AUDIO_RING_FRAMES - 1);
+    unsigned int first, i;
+
+    if (count > frames)
+        count = frames;
+    first = AUDIO_RING_FRAMES - index;
+    if (first > count)
+        first = count;
+    memcpy(output, &audio_ring[index * audio_frame_bytes], first * audio_frame_bytes);
+    memcpy(&output[first * audio_frame_bytes], audio_ring, (count - first) * audio_frame_bytes);
+    __atomic_store_n(&audio_tail, tail + count, __ATOMIC_RELEASE);
+
+    if (count)
+        memcpy(audio_last, &output[(count - 1) * audio_frame_bytes], audio_frame_bytes);
+    for (i = count; i < frames; i++)
+        memcpy(&output[i * audio_frame_bytes], audio_last, audio_frame_bytes);
+    audio_underruns += frames - count;
+    return count;
+}
+
+/******************************************************************************
+ *
+ *   Audio fill
+ *   Frames waiting in the ring, callable from either side
+ *
+ ******************************************************************************/
+unsigned int audio_get_fill()
+{
+    unsigned int tail = __atomic_load_n(&audio_tail, __ATOMIC_ACQUIRE);
+    unsigned int head = __atomic_load_n(&audio_head, __ATOMIC_ACQUIRE);
+    return head - tail;
+}
+
+void audio_set_latency(unsigned int frames)
+{
+    if (frames > AUDIO_RING_FRAMES / 2)
+        frames = AUDIO_RING_FRAMES / 2;
+    audio_latency = frames;
+}
+
+unsigned int audio_get_latency()
+{
+    return audio_latency;
+}
+
+/******************************************************************************
+ *
+ *   Audio rate control
+ *   Output rate multiplier keeping the fill level around the latency
+ *   target. Below target the producer makes slightly more frames per
+ *   emulated second, above target slightly fewer, at most
+ *   AUDIO_RATE_DELTA either way so the pitch change stays inaudible.
+ *   A latency of 0 turns it off, for consumers that drain the ring
+ *   right away.
+ *
+ ******************************************************************************/
+double audio_rate_control()
+{
+    double error;
+    if (!audio_latency)
+        return 1;
+    error = ((double)audio_latency - audio_get_fill()) / audio_latency;
+    if (error > 1)
+        error = 1;
+    if (error < -1)
+        error = -1;
+    return 1 + AUDIO_RATE_DELTA * error;
+}
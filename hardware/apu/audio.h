@@ -0,0 +1,14 @@
+#define AUDIO_RING_FRAMES 8192      // Ring capacity in stereo frames, power of 2
+#define AUDIO_LATENCY_FRAMES 2048   // Default fill level rate control aims for
+#define AUDIO_RATE_DELTA 0.005      // Maximum rate correction, +-0.5%
+#define AUDIO_MAX_FRAME_BYTES 8     // Largest frame, float stereo
+
+void audio_reset();
+void audio_set_frame_bytes(unsigned int bytes);
+unsigned int audio_get_frame_bytes();
+unsigned int audio_write(const void *frames, unsigned int count);
+unsigned int audio_read(void *buffer, unsigned int frames);
+unsigned int audio_get_fill();
+void audio_set_latency(unsigned int frames);
+unsigned int audio_get_latency();
+double audio_rate_control();
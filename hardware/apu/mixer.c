@@ -0,0 +1,201 @@
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "mixer.h"
+#include "audio.h"
+
+/******************************************************************************
+ *
+ *   Audio mixer
+ *   Output stage of the core. FM and DAC are weighted at the native
+ *   rate before resampling (mixer_get_gain), PSG and the resampled FM
+ *   are mixed here at the output rate with the master volume folded in,
+ *   then saturated to the output format and written to the audio ring.
+ *
+ ******************************************************************************/
+
+#define MIXER_UNITY (1 << MIXER_GAIN_BITS)
+
+// Define output format and source gains, MIXER_GAIN_BITS fixed point
+static unsigned int mixer_format = MIXER_FORMAT_S16;
+static int mixer_gain[MIXER_SOURCES] = {MIXER_UNITY, MIXER_UNITY, MIXER_UNITY};
+static int mixer_volume = MIXER_UNITY;
+// Define output stage gains of resampled FM and PSG, master volume included
+static short mixer_out_fm = MIXER_UNITY;
+static short mixer_out_psg = MIXER_UNITY;
+
+int ym2612_set_rate(unsigned int rate);
+
+static int mixer_fixed(double gain)
+{
+    if (gain < 0)
+        gain = 0;
+    if (gain > MIXER_MAX_GAIN)
+        gain = MIXER_MAX_GAIN;
+    return (int)(gain * MIXER_UNITY + 0.5);
+}
+
+static short mixer_out_gain(int gain)
+{
+    int value = (gain * mixer_volume) >> MIXER_GAIN_BITS;
+    return value > 32767 ? 32767 : value;
+}
+
+static void mixer_update()
+{
+    mixer_out_fm = mixer_out_gain(MIXER_UNITY);
+    mixer_out_psg = mixer_out_gain(mixer_gain[MIXER_PSG]);
+}
+
+/******************************************************************************
+ *
+ *   Mixer output
+ *   Select the output sample format and rate. The audio ring is emptied,
+ *   call it while the frontend audio callback is stopped. Returns 0 and
+ *   changes nothing for an unknown format, a rate of 0 or a rate above
+ *   YM2612_MAX_RATE, the frontend then falls back to another device rate.
+ *
+ ******************************************************************************/
+int mixer_set_output(unsigned int format, unsigned int rate)
+{
+    if (format != MIXER_FORMAT_S16 && format != MIXER_FORMAT_F32)
+        return 0;
+    if (!ym2612_set_rate(rate))
+        return 0;
+    mixer_format = format;
+    audio_set_frame_bytes(mixer_format == MIXER_FORMAT_F32 ? 2 * sizeof(float) : 2 * sizeof(short));
+    return 1;
+}
+
+unsigned int mixer_get_format()
+{
+    return mixer_format;
+}
+
+/******************************************************************************
+ *
+ *   Mixer gains
+ *   Per source gain and master volume, 1.0 is unity, 0 mutes
+ *
+ ******************************************************************************/
+void mixer_set_gain(unsigned int source, double gain)
+{
+    if (source >= MIXER_SOURCES)
+        return;
+    mixer_gain[source] = mixer_fixed(gain);
+    mixer_update();
+}
+
+void mixer_set_volume(double volume)
+{
+    mixer_volume = mixer_fixed(volume);
+    mixer_update();
+}
+
+int mixer_get_gain(unsigned int source)
+{
+    return source < MIXER_SOURCES ? mixer_gain[source] : 0;
+}
+
+/******************************************************************************
+ *
+ *   Mixer mix
+ *   fm * mixer_out_fm + psg * mixer_out_psg over "samples" interleaved
+ *   samples, saturated to 16 bit or scaled and clamped to float
+ *
+ ******************************************************************************/
+static void mixer_mix_s16(const short *fm, const short *psg, int samples, short *output)
+{
+    int i = 0, value;
+#if defined(__SSE2__)
+    __m128i gain = _mm_set1_epi32((unsigned short)mixer_out_fm | (unsigned int)(unsigned short)mixer_out_psg << 16);
+    __m128i a, b, lo, hi;
+    for (; i + 8 <= samples; i += 8)
+    {
+        a = _mm_loadu_si128((const __m128i *)(fm + i));
+        b = _mm_loadu_si128((const __m128i *)(psg + i));
+        lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), gain), MIXER_GAIN_BITS);
+        hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), gain), MIXER_GAIN_BITS);
+        _mm_storeu_si128((__m128i *)(output + i), _mm_packs_epi32(lo, hi));
+    }
+#elif defined(__ARM_NEON)
+    int32x4_t acc;
+    for (; i + 4 <= samples; i += 4)
+    {
+        acc = vmull_n_s16(vld1_s16(fm + i), mixer_out_fm);
+        acc = vmlal_n_s16(acc, vld1_s16(psg + i), mixer_out_psg);
+        vst1_s16(output + i, vqshrn_n_s32(acc, MIXER_GAIN_BITS));
+    }
+#endif
+    for (; i < samples; i++)
+    {
+        value = (fm[i] * mixer_out_fm + psg[i] * mixer_out_psg) >> MIXER_GAIN_BITS;
+        output[i] = value > 32767 ? 32767 : (value < -32768 ? -32768 : value);
+    }
+}
+
+static void mixer_mix_f32(const short *fm, const short *psg, int samples, float *output)
+{
+    const float scale = 1.0f / (32768.0f * MIXER_UNITY);
+    float value;
+    int i = 0;
+#if defined(__SSE2__)
+    __m128i gain = _mm_set1_epi32((unsigned short)mixer_out_fm | (unsigned int)(unsigned short)mixer_out_psg << 16);
+    __m128 factor = _mm_set1_ps(scale), one = _mm_set1_ps(1.0f), minus_one = _mm_set1_ps(-1.0f);
+    __m128i a, b;
+    for (; i + 8 <= samples; i += 8)
+    {
+        a = _mm_loadu_si128((const __m128i *)(fm + i));
+        b = _mm_loadu_si128((const __m128i *)(psg + i));
+        _mm_storeu_ps(output + i, _mm_max_ps(minus_one, _mm_min_ps(one, _mm_mul_ps(factor,
+                      _mm_cvtepi32_ps(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), gain))))));
+        _mm_storeu_ps(output + i + 4, _mm_max_ps(minus_one, _mm_min_ps(one, _mm_mul_ps(factor,
+                      _mm_cvtepi32_ps(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), gain))))));
+    }
+#elif defined(__ARM_NEON)
+    int32x4_t acc;
+    for (; i + 4 <= samples; i += 4)
+    {
+        acc = vmull_n_s16(vld1_s16(fm + i), mixer_out_fm);
+        acc = vmlal_n_s16(acc, vld1_s16(psg + i), mixer_out_psg);
+        vst1q_f32(output + i, vmaxq_f32(vdupq_n_f32(-1.0f), vminq_f32(vdupq_n_f32(1.0f),
+                  vmulq_n_f32(vcvtq_f32_s32(acc), scale))));
+    }
+#endif
+    for (; i < samples; i++)
+    {
+        value = (fm[i] * mixer_out_fm + psg[i] * mixer_out_psg) * scale;
+        output[i] = value > 1.0f ? 1.0f : (value < -1.0f ? -1.0f : value);
+    }
+}
+
+/******************************************************************************
+ *
+ *   Mixer write
+ *   Mix "frames" interleaved stereo frames of resampled FM and PSG and
+ *   append them to the audio ring in the output format
+ *
+ ******************************************************************************/
+void mixer_write(const short *fm, const short *psg, int frames)
+{
+    short s16[MIXER_BLOCK * 2];
+    float f32[MIXER_BLOCK * 2];
+    int done, count;
+
+    for (done = 0; done < frames; done += count)
+    {
+        count = frames - done < MIXER_BLOCK ? frames - done : MIXER_BLOCK;
+        if (mixer_format == MIXER_FORMAT_F32)
+        {
+            mixer_mix_f32(fm + done * 2, psg + done * 2, count * 2, f32);
+            audio_write(f32, count);
+        }
+        else
+        {
+            mixer_mix_s16(fm + done * 2, psg + done * 2, count * 2, s16);
+            audio_write(s16, count);
+        }
+    }
+}
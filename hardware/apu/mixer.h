@@ -0,0 +1,24 @@
+#define MIXER_GAIN_BITS 12      // Gains fixed point, 1 << MIXER_GAIN_BITS is unity
+#define MIXER_MAX_GAIN 4.0      // Largest gain per source and for the master volume
+#define MIXER_BLOCK 128         // Frames converted per audio ring write
+
+enum
+{
+    MIXER_FM = 0,
+    MIXER_DAC,
+    MIXER_PSG,
+    MIXER_SOURCES
+};
+
+enum
+{
+    MIXER_FORMAT_S16 = 0,   // Interleaved signed 16 bit
+    MIXER_FORMAT_F32        // Interleaved float, -1.0 to 1.0
+};
+
+int mixer_set_output(unsigned int format, unsigned int rate);
+unsigned int mixer_get_format();
+void mixer_set_gain(unsigned int source, double gain);
+void mixer_set_volume(double volume);
+int mixer_get_gain(unsigned int source);
+void mixer_write(const short *fm, const short *psg, int frames);
@@ -0,0 +1,220 @@
+#include <math.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include "resampler.h"
+
+/******************************************************************************
+ *
+ *   Polyphase resampler
+ *   Fixed point windowed sinc resampler for 16 bit stereo streams.
+ *   An optional single pole low pass at the input rate is convolved
+ *   into the kernel, so filtering costs nothing per sample.
+ *
+ ******************************************************************************/
+
+#define RESAMPLER_PI 3.14159265358979323846
+#define RESAMPLER_ONE (1ULL << RESAMPLER_FRAC)
+#define RESAMPLER_PHASE_SHIFT (RESAMPLER_FRAC - 8)  // log2(RESAMPLER_PHASES) = 8
+#define RESAMPLER_ROLLOFF 0.92                       // Passband edge relative to output Nyquist
+#define RESAMPLER_POLE_TAPS 12                       // Taps given to the low pass tail
+
+/******************************************************************************
+ *
+ *   Resampler windowed sinc
+ *   Blackman windowed sinc of cutoff "fc" (cycles per input sample)
+ *   and half width "width" (input samples)
+ *
+ ******************************************************************************/
+static double resampler_sinc(double x, double fc, double width)
+{
+    double t;
+    if (fabs(x) >= width)
+        return 0;
+    t = 2 * fc * x;
+    return 2 * fc * (t == 0 ? 1 : sin(RESAMPLER_PI * t) / (RESAMPLER_PI * t)) *
+           (0.42 + 0.5 * cos(RESAMPLER_PI * x / width) + 0.08 * cos(2 * RESAMPLER_PI * x / width));
+}
+
+/******************************************************************************
+ *
+ *   Resampler set step
+ *   Change the rate ratio without touching kernel or history, used for
+ *   small rate corrections while streaming
+ *
+ ******************************************************************************/
+void resampler_set_step(resampler_t *rs, double in_rate, double out_rate)
+{
+    rs->step = (unsigned long long)(in_rate / out_rate * RESAMPLER_ONE);
+}
+
+/******************************************************************************
+ *
+ *   Resampler init
+ *   Build the kernel from "in_rate" to "out_rate". "pole" is the
+ *   coefficient of a y += (1 - pole) * (x - y) low pass at the input
+ *   rate, 0 disables it. "gain" scales the output.
+ *
+ ******************************************************************************/
+void resampler_init(resampler_t *rs, double in_rate, double out_rate, double pole, double gain)
+{
+    double fc = 0.5 * RESAMPLER_ROLLOFF * (out_rate < in_rate ? out_rate / in_rate : 1.0);
+    int tail = pole > 0 ? RESAMPLER_POLE_TAPS : 1;
+    double width = (RESAMPLER_TAPS - tail) / 2.0;
+    double h[RESAMPLER_TAPS], sum, x;
+    int p, j, k, total, center = 0;
+
+    for (p = 0; p < RESAMPLER_PHASES; p++)
+    {
+        sum = 0;
+        for (j = 0; j < RESAMPLER_TAPS; j++)
+        {
+            // Distance from the output position to the input sample "j" taps back
+            x = j + (double)p / RESAMPLER_PHASES - width;
+            h[j] = 0;
+            for (k = 0; k < tail; k++)
+                h[j] += (pole > 0 ? (1 - pole) * pow(pole, k) : 1) * resampler_sinc(x - k, fc, width);
+            sum += h[j];
+        }
+        // Normalize every phase to unity DC gain, rounding error goes to the peak
+        total = 0;
+        for (j = 0; j < RESAMPLER_TAPS; j++)
+        {
+            rs->kernel[p][RESAMPLER_TAPS - 1 - j] = (short)lrint(h[j] / sum * (1 << RESAMPLER_COEF_BITS));
+            total += rs->kernel[p][RESAMPLER_TAPS - 1 - j];
+            if (h[j] > h[center])
+                center = j;
+        }
+        rs->kernel[p][RESAMPLER_TAPS - 1 - center] += (1 << RESAMPLER_COEF_BITS) - total;
+    }
+
+    memset(rs->history, 0, sizeof(rs->history));
+    rs->head = 0;
+    rs->frac = 0;
+    rs->held_count = 0;
+    rs->gain = (int)(gain * 65536);
+    resampler_set_step(rs, in_rate, out_rate);
+}
+
+/******************************************************************************
+ *
+ *   Resampler dot product
+ *   Multiply RESAMPLER_TAPS samples with a kernel phase
+ *
+ ******************************************************************************/
+static inline int resampler_dot(const short *samples, const short *kernel)
+{
+    int i;
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (i = 0; i < RESAMPLER_TAPS; i += 8)
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(samples + i)),
+                                                _mm_loadu_si128((const __m128i *)(kernel + i))));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0x4E));
+    acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, 0xB1));
+    return _mm_cvtsi128_si32(acc);
+#elif defined(__ARM_NEON)
+    int32x4_t acc = vdupq_n_s32(0);
+    int32x2_t sum;
+    for (i = 0; i < RESAMPLER_TAPS; i += 4)
+        acc = vmlal_s16(acc, vld1_s16(samples + i), vld1_s16(kernel + i));
+    sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    return vget_lane_s32(vpadd_s32(sum, sum), 0);
+#else
+    int acc = 0;
+    for (i = 0; i < RESAMPLER_TAPS; i++)
+        acc += samples[i] * kernel[i];
+    return acc;
+#endif
+}
+
+static inline short resampler_output(resampler_t *rs, int acc)
+{
+    long long value = ((long long)acc * rs->gain) >> (RESAMPLER_COEF_BITS + 16);
+    if (value > 32767)
+        return 32767;
+    if (value < -32768)
+        return -32768;
+    return (short)value;
+}
+
+/******************************************************************************
+ *
+ *   Resampler process
+ *   Feed "frames" interleaved stereo input frames, write every output
+ *   frame that becomes available to "output" and return their count.
+ *   "output" needs room for frames * out_rate / in_rate + 1 frames.
+ *
+ ******************************************************************************/
+int resampler_process(resampler_t *rs, const short *input, int frames, short *output)
+{
+    const short *kernel;
+    unsigned int start;
+    int i, count = 0;
+
+    rs->held_count = 0;
+    for (i = 0; i < frames; i++)
+    {
+        rs->history[0][rs->head] = rs->history[0][rs->head + RESAMPLER_HISTORY] = input[i * 2];
+        rs->history[1][rs->head] = rs->history[1][rs->head + RESAMPLER_HISTORY] = input[i * 2 + 1];
+        rs->head = (rs->head + 1) & (RESAMPLER_HISTORY - 1);
+        start = (rs->head - RESAMPLER_TAPS) & (RESAMPLER_HISTORY - 1);
+
+        while (rs->frac < RESAMPLER_ONE)
+        {
+            kernel = rs->kernel[rs->frac >> RESAMPLER_PHASE_SHIFT];
+            output[count * 2] = resampler_output(rs, resampler_dot(&rs->history[0][start], kernel));
+            output[count * 2 + 1] = resampler_output(rs, resampler_dot(&rs->history[1][start], kernel));
+            count++;
+            rs->frac += rs->step;
+        }
+        rs->frac -= RESAMPLER_ONE;
+    }
+    return count;
+}
+
+/******************************************************************************
+ *
+ *   Resampler hold
+ *   Feed "frames" copies of one stereo frame. Once the whole history
+ *   holds that frame every phase yields the same output, as each kernel
+ *   phase sums to exactly one, so only the output count is computed.
+ *
+ ******************************************************************************/
+int resampler_hold(resampler_t *rs, const short *frame, int frames, short *output)
+{
+    short left, right;
+    unsigned int held;
+    int count = 0;
+
+    if (rs->held_count && (rs->held[0] != frame[0] || rs->held[1] != frame[1]))
+        rs->held_count = 0;
+    held = rs->held_count;
+    while (frames && held < RESAMPLER_TAPS)
+    {
+        count += resampler_process(rs, frame, 1, &output[count * 2]);
+        frames--;
+        held++;
+    }
+    rs->held[0] = frame[0];
+    rs->held[1] = frame[1];
+    rs->held_count = held;
+
+    left = resampler_output(rs, frame[0] * (1 << RESAMPLER_COEF_BITS));
+    right = resampler_output(rs, frame[1] * (1 << RESAMPLER_COEF_BITS));
+    while (frames--)
+    {
+        while (rs->frac < RESAMPLER_ONE)
+        {
+            output[count * 2] = left;
+            output[count * 2 + 1] = right;
+            count++;
+            rs->frac += rs->step;
+        }
+        rs->frac -= RESAMPLER_ONE;
+    }
+    return count;
+}
@@ -0,0 +1,22 @@
+#define RESAMPLER_TAPS 32       // Kernel length in input samples, multiple of 8
+#define RESAMPLER_PHASES 256    // Kernel phases per input sample
+#define RESAMPLER_HISTORY 64    // History ring size, power of 2 >= RESAMPLER_TAPS
+#define RESAMPLER_COEF_BITS 14  // Kernel coefficients fixed point
+#define RESAMPLER_FRAC 32       // Position fixed point
+
+typedef struct _resampler_t
+{
+    short kernel[RESAMPLER_PHASES][RESAMPLER_TAPS];
+    short history[2][RESAMPLER_HISTORY * 2];  // Planar, each sample stored twice
+    unsigned int head;
+    unsigned long long step;  // Input samples per output sample
+    unsigned long long frac;  // Next output position past the newest input
+    int gain;                 // Output gain, 16.16 fixed point
+    short held[2];            // Frame fed by resampler_hold
+    unsigned int held_count;  // Consecutive held frames in the history
+} resampler_t;
+
+void resampler_init(resampler_t *rs, double in_rate, double out_rate, double pole, double gain);
+void resampler_set_step(resampler_t *rs, double in_rate, double out_rate);
+int resampler_process(resampler_t *rs, const short *input, int frames, short *output);
+int resampler_hold(resampler_t *rs, const short *frame, int frames, short *output);
@@ -0,0 +1,298 @@
+#include <math.h>
+#include <string.h>
+#include "sn76489.h"
+#include "hardware/system/state.h"
+
+/******************************************************************************
+ *
+ *   SN76489 PSG
+ *   Three square wave tones and a noise channel. Counters are not
+ *   clocked, each channel jumps from one output transition to the next
+ *   and records the amplitude change as a band limited step in a delta
+ *   buffer at the output rate. Work is proportional to audible edges and
+ *   register writes, sn76489_render integrates the buffer for the mixer.
+ *
+ ******************************************************************************/
+
+#define SN76489_PI 3.14159265358979323846
+#define SN76489_CUTOFF 0.45     // Step bandwidth in cycles per output frame
+#define SN76489_MASK (SN76489_BUFFER_FRAMES - 1)
+
+static sn76489_t psg;
+// Define delta buffer, amplitude changes convolved with the step kernel
+static int psg_buffer[SN76489_BUFFER_FRAMES];
+// Define band limited impulse per step phase, integrated by sn76489_render
+static short psg_step[SN76489_PHASES][SN76489_TAPS];
+// Define amplitude per attenuation step, 2 dB each, 15 is off
+static int psg_volume[16];
+
+unsigned long long get_master_clock();
+
+/******************************************************************************
+ *
+ *   SN76489 Init
+ *   Build the step kernel and volume table and silence every channel
+ *
+ ******************************************************************************/
+void sn76489_init()
+{
+    unsigned long long frame_clocks = psg.frame_clocks;
+    double h[SN76489_TAPS], sum, x, t;
+    int p, k, total, center;
+
+    for (p = 0; p < SN76489_PHASES; p++)
+    {
+        sum = 0;
+        center = 0;
+        for (k = 0; k < SN76489_TAPS; k++)
+        {
+            // Blackman windowed sinc centered SN76489_TAPS / 2 frames after the edge
+            x = k - SN76489_TAPS / 2 - (double)p / SN76489_PHASES;
+            t = 2 * SN76489_CUTOFF * x;
+            h[k] = (t == 0 ? 1 : sin(SN76489_PI * t) / (SN76489_PI * t));
+            if (fabs(x) < SN76489_TAPS / 2)
+                h[k] *= 0.42 + 0.5 * cos(SN76489_PI * x / (SN76489_TAPS / 2)) + 0.08 * cos(2 * SN76489_PI * x / (SN76489_TAPS / 2));
+            else
+                h[k] = 0;
+            sum += h[k];
+        }
+        // Every phase sums to exactly one so the integrated steps settle on the amplitude
+        total = 0;
+        for (k = 0; k < SN76489_TAPS; k++)
+        {
+            psg_step[p][k] = (short)lrint(h[k] / sum * (1 << SN76489_COEF_BITS));
+            total += psg_step[p][k];
+            if (h[k] > h[center])
+                center = k;
+        }
+        psg_step[p][center] += (1 << SN76489_COEF_BITS) - total;
+    }
+
+    for (k = 0; k < 15; k++)
+        psg_volume[k] = (int)lrint(SN76489_MAX_VOLUME * pow(10, -0.1 * k));
+    psg_volume[15] = 0;
+
+    memset(&psg, 0, sizeof(sn76489_t));
+    memset(psg_buffer, 0, sizeof(psg_buffer));
+    psg.frame_clocks = frame_clocks;
+    psg.time = psg.base = get_master_clock();
+    psg.lfsr = 0x8000;
+    for (k = 0; k < 4; k++)
+    {
+        psg.channel[k].volume = 0x0F;
+        psg.channel[k].polarity = 1;
+        psg.channel[k].next = psg.time;
+    }
+}
+
+/******************************************************************************
+ *
+ *   SN76489 Set frame clocks
+ *   Master clocks per output frame in SN76489_FRAC fixed point, the
+ *   FM resampler sets it so both streams share one output timeline
+ *
+ ******************************************************************************/
+void sn76489_set_frame_clocks(unsigned long long clocks)
+{
+    psg.frame_clocks = clocks;
+}
+
+/******************************************************************************
+ *
+ *   SN76489 Delta
+ *   Add an amplitude change at master clock "time" to the delta buffer
+ *
+ ******************************************************************************/
+static void sn76489_delta(unsigned long long time, int delta)
+{
+    unsigned long long offset = 0, index, phase = 0;
+    const short *step;
+    int k;
+
+    if (time > psg.base)
+    {
+        offset = time - psg.base;
+        // Edges too far ahead for the buffer land on its last frame
+        if (offset > SN76489_BUFFER_FRAMES * (psg.frame_clocks >> SN76489_FRAC))
+            offset = SN76489_BUFFER_FRAMES * (psg.frame_clocks >> SN76489_FRAC);
+        offset <<= SN76489_FRAC;
+        offset = offset > psg.base_frac ? offset - psg.base_frac : 0;
+    }
+    index = offset / psg.frame_clocks;
+    if (index > SN76489_BUFFER_FRAMES - SN76489_TAPS)
+        index = SN76489_BUFFER_FRAMES - SN76489_TAPS;
+    else
+        phase = (offset % psg.frame_clocks) * SN76489_PHASES / psg.frame_clocks;
+
+    step = psg_step[phase];
+    for (k = 0; k < SN76489_TAPS; k++)
+        psg_buffer[(psg.head + index + k) & SN76489_MASK] += step[k] * delta;
+}
+
+/******************************************************************************
+ *
+ *   SN76489 Level
+ *   Bring the amplitude of channel "index" in line with its output and
+ *   volume, recording the change at master clock "time"
+ *
+ ******************************************************************************/
+static void sn76489_level(unsigned int index, unsigned long long time)
+{
+    sn76489_channel *ch = &psg.channel[index];
+    int level;
+
+    if (index == 3)
+        level = (psg.lfsr & 1) ? psg_volume[ch->volume] : 0;
+    else
+        level = ch->polarity * psg_volume[ch->volume];
+    if (level != ch->level)
+    {
+        sn76489_delta(time, level - ch->level);
+        ch->level = level;
+    }
+}
+
+/******************************************************************************
+ *
+ *   SN76489 Run
+ *   Advance every channel to master clock "until"
+ *
+ ******************************************************************************/
+static void sn76489_run(unsigned long long until)
+{
+    sn76489_channel *ch;
+    unsigned long long interval, count;
+    unsigned int i, period, feedback;
+
+    if (!psg.frame_clocks || until <= psg.time)
+        return;
+
+    for (i = 0; i < 3; i++)
+    {
+        ch = &psg.channel[i];
+        if (ch->period <= 1)
+        {
+            // Periods 0 and 1 hold the output high, used for sample playback
+            ch->polarity = 1;
+            sn76489_level(i, psg.time);
+            ch->next = until;
+            continue;
+        }
+        interval = (unsigned long long)ch->period * SN76489_TICK_CYCLES;
+        if (!psg_volume[ch->volume])
+        {
+            // Inaudible, only keep the counter phase
+            if (ch->next < until)
+            {
+                count = (until - ch->next + interval - 1) / interval;
+                if (count & 1)
+                    ch->polarity = -ch->polarity;
+                ch->next += count * interval;
+            }
+            continue;
+        }
+        while (ch->next < until)
+        {
+            ch->polarity = -ch->polarity;
+            sn76489_level(i, ch->next);
+            ch->next += interval;
+        }
+    }
+
+    // Noise counter runs at a fixed rate or follows tone 2
+    ch = &psg.channel[3];
+    period = (psg.noise & 3) == 3 ? psg.channel[2].period : 0x10 << (psg.noise & 3);
+    interval = (unsigned long long)(period ? period : 1) * SN76489_TICK_CYCLES;
+    while (ch->next < until)
+    {
+        psg.noise_phase ^= 1;
+        if (psg.noise_phase)
+        {
+            // White noise taps bits 0 and 3, periodic noise recirculates bit 0
+            feedback = (psg.noise & 4) ? (psg.lfsr ^ (psg.lfsr >> 3)) & 1 : psg.lfsr & 1;
+            psg.lfsr = (psg.lfsr >> 1) | (feedback << 15);
+            sn76489_level(3, ch->next);
+        }
+        ch->next += interval;
+    }
+    psg.time = until;
+}
+
+/******************************************************************************
+ *
+ *   SN76489 Write
+ *   Latch bytes (bit 7 set) select channel and register and carry the
+ *   low 4 bits, data bytes carry the upper 6 bits of a tone period
+ *
+ ******************************************************************************/
+void sn76489_write(unsigned int value)
+{
+    sn76489_channel *ch;
+    unsigned int index;
+
+    sn76489_run(get_master_clock());
+    if (value & 0x80)
+        psg.latch = (value >> 4) & 0x07;
+    index = psg.latch >> 1;
+    ch = &psg.channel[index];
+
+    if (psg.latch & 1)
+    {
+        ch->volume = value & 0x0F;
+        sn76489_level(index, psg.time);
+    }
+    else if (index == 3)
+    {
+        psg.noise = value & 0x07;
+        psg.lfsr = 0x8000;
+        sn76489_level(3, psg.time);
+    }
+    else if (value & 0x80)
+    {
+        ch->period = (ch->period & 0x3F0) | (value & 0x0F);
+    }
+    else
+    {
+        ch->period = (ch->period & 0x00F) | ((value & 0x3F) << 4);
+    }
+}
+
+/******************************************************************************
+ *
+ *   SN76489 Render
+ *   Synthesize the next "frames" output frames as interleaved stereo
+ *
+ ******************************************************************************/
+void sn76489_render(short *output, int frames)
+{
+    unsigned long long end = psg.base_frac + frames * psg.frame_clocks;
+    unsigned int index;
+    int i, sample;
+
+    sn76489_run(psg.base + (end >> SN76489_FRAC));
+    for (i = 0; i < frames; i++)
+    {
+        index = (psg.head + i) & SN76489_MASK;
+        psg.accum += psg_buffer[index];
+        psg_buffer[index] = 0;
+        sample = psg.accum >> SN76489_COEF_BITS;
+        sample = sample > 32767 ? 32767 : (sample < -32768 ? -32768 : sample);
+        output[i * 2] = output[i * 2 + 1] = sample;
+    }
+    psg.head = (psg.head + frames) & SN76489_MASK;
+    psg.base += end >> SN76489_FRAC;
+    psg.base_frac = end & ((1ULL << SN76489_FRAC) - 1);
+}
+
+/******************************************************************************
+ *
+ *   SN76489 State
+ *   Hand out the chip and the pending deltas for state_save
+ *
+ ******************************************************************************/
+unsigned int sn76489_state_blocks(state_block *blocks)
+{
+    state_block list[] = {STATE_BLOCK(psg), STATE_BLOCK(psg_buffer)};
+    memcpy(blocks, list, sizeof(list));
+    return sizeof(list) / sizeof(list[0]);
+}
@@ -0,0 +1,37 @@
+#define SN76489_FREQ_DIVISOR 15                             // Frequency divisor to SN76489 clock
+#define SN76489_TICK_CYCLES (16 * SN76489_FREQ_DIVISOR)     // Master clocks per counter tick
+#define SN76489_MAX_VOLUME 2800                             // Channel amplitude at 0 dB attenuation
+#define SN76489_BUFFER_FRAMES 8192                          // Delta buffer size in output frames, power of 2
+#define SN76489_TAPS 16                                     // Band limited step length in output frames
+#define SN76489_PHASES 32                                   // Step phases per output frame
+#define SN76489_COEF_BITS 15                                // Step coefficients fixed point
+#define SN76489_FRAC 32                                     // Frame clocks fixed point
+
+typedef struct _sn76489_channel
+{
+    unsigned int period;               // Counter reload in ticks
+    unsigned int volume;               // 4 bit attenuation
+    int polarity;                      // Tone output, +1 or -1
+    int level;                         // Amplitude currently in the delta buffer
+    unsigned long long next;           // Master clock of the next counter expiry
+} sn76489_channel;
+
+typedef struct _sn76489_t
+{
+    sn76489_channel channel[4];        // Tone 0-2, noise
+    unsigned int latch;                // Channel and type of the last latch byte
+    unsigned int noise;                // Noise control register
+    unsigned int lfsr;                 // Noise shift register
+    unsigned int noise_phase;          // Noise counter output, the register shifts on its rising edge
+    unsigned long long time;           // Master clock synthesis has reached
+    unsigned long long base;           // Master clock of delta buffer frame 0, integer part
+    unsigned long long base_frac;      // Fractional part, SN76489_FRAC bits
+    unsigned long long frame_clocks;   // Master clocks per output frame, SN76489_FRAC bits
+    unsigned int head;                 // Delta buffer index of frame 0
+    int accum;                         // Integrated output, SN76489_COEF_BITS fixed point
+} sn76489_t;
+
+void sn76489_init();
+void sn76489_write(unsigned int value);
+void sn76489_set_frame_clocks(unsigned long long clocks);
+void sn76489_render(short *output, int frames);
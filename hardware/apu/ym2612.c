@@ -1,13 +1,32 @@
+#include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 #include <libs/NukedOPN2/ym3438.h>
 #include "ym2612.h"
+#include "ym2612_fast.h"
+#include "ym2612_batch.h"
+#include "resampler.h"
+#include "audio.h"
+#include "sn76489.h"
+#include "mixer.h"
+#include "hardware/system/state.h"
+#include "hardware/debug/timing.h"
 
 #define YM2612_FREQ 7670454
-#define YM2612_RATE YM2612_FREQ / 72
+#define YM2612_NATIVE_RATE (YM2612_FREQ / 144.0)
 #define OUTPUT_FACTOR 11
 #define OUTPUT_FACTOR_F 12
-#define FILTER_CUTOFF 0.512331301282628 // 5894Hz  single pole IIR low pass
-#define FILTER_CUTOFF_I (1 - FILTER_CUTOFF)
+#define FILTER_CUTOFF 0.512331301282628 // 5894Hz  single pole IIR low pass, folded into the resampler kernel
+#define INPUT_SHIFT 2                   // Native samples are scaled up before resampling to keep precision
+#define SYNC_BLOCK 64                   // Native samples generated per resampler call
+// Output frames of a SYNC_BLOCK at YM2612_MAX_RATE, with room for the +0.5%
+// of AUDIO_RATE_DELTA and rounding
+#define SYNC_OUTPUT (SYNC_BLOCK * YM2612_MAX_RATE / (YM2612_FREQ / 144) * 201 / 200 + 2)
+#define SILENCE_SAMPLES 16              // Identical samples from a silent chip before generation stops
+
+#define YM2612_BUSY_CYCLES (32 * 6 * YM2612_FREQ_DIVISOR)   // Master clocks busy after a data write
+#define YM2612_TIMER_A_CYCLES YM2612_SAMPLE_CYCLES          // Master clocks per Timer A tick
+#define YM2612_TIMER_B_CYCLES (16 * YM2612_SAMPLE_CYCLES)   // Master clocks per Timer B tick
 
 enum
 {
@@ -17,37 +36,463 @@ enum
     eg_num_release = 3
 };
 
-Bit32u *audio;
+static resampler_t ym_resampler;
+static unsigned int ym_output_rate = 44100;
+// Master clock of the next native sample to generate
+static Bit64u ym_sample_clock = 0;
+// Define consecutive idle samples and the idle output level
+static Bit32u ym_silent = 0;
+static Bit32s ym_idle[4] = {0, 0, 0, 0};
 static ym3438_t ym_chip;
 static Bit32u use_filter = 0;
 static Bit32u chip_type = YM2612;
 
+// Analytic timer and busy model, status reads never need to clock the chip
+static ym2612_timer ym_timer_a, ym_timer_b;
+static Bit16u ym_timer_a_reg = 0;
+static Bit8u ym_timer_b_reg = 0;
+static Bit64u ym_busy_until = 0;
+// Latched register address, bit 8 selects the second register bank
+static Bit16u ym_address = 0;
+
+// Active synthesis core and register shadow used to hand state over on switch
+static int ym_core = YM2612_CORE_NUKED;
+static Bit8u ym_regs[2][0x100];
+
+// Register log, port writes stamped with the native sample they land on
+static FILE *ym_log = NULL;
+static Bit64u ym_log_start = 0;
+
+unsigned long long get_master_clock();
+
+/******************************************************************************
+ * 
+ *   YM2612 Timers reset
+ *   Stop both timers and clear status flags and busy window
+ * 
+ ******************************************************************************/
+void ym2612_timers_reset()
+{
+    memset(&ym_timer_a, 0, sizeof(ym2612_timer));
+    memset(&ym_timer_b, 0, sizeof(ym2612_timer));
+    ym_timer_a_reg = 0;
+    ym_timer_b_reg = 0;
+    ym_timer_a.period = 1024 * YM2612_TIMER_A_CYCLES;
+    ym_timer_b.period = 256 * YM2612_TIMER_B_CYCLES;
+    ym_busy_until = 0;
+    ym_address = 0;
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Timer update
+ *   Account every overflow of a running timer up to master clock "now"
+ * 
+ ******************************************************************************/
+static void ym2612_timer_update(ym2612_timer *timer, Bit64u now)
+{
+    if (!timer->load || now < timer->next)
+        return;
+    if (timer->enable)
+        timer->overflow = 1;
+    // The counter reloads on every overflow, skip all elapsed periods at once
+    timer->next += ((now - timer->next) / timer->period + 1) * timer->period;
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Timers update
+ *   Bring Timer A and Timer B up to master clock "now"
+ * 
+ ******************************************************************************/
+void ym2612_timers_update(Bit64u now)
+{
+    ym2612_timer_update(&ym_timer_a, now);
+    ym2612_timer_update(&ym_timer_b, now);
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Timer control
+ *   Handle load, enable and reset bits written to register 0x27
+ * 
+ ******************************************************************************/
+static void ym2612_timer_control(ym2612_timer *timer, int load, int enable, int reset, Bit64u now)
+{
+    if (load && !timer->load)
+        timer->next = now + timer->period;
+    timer->load = load;
+    timer->enable = enable;
+    if (reset)
+        timer->overflow = 0;
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Timers register write
+ *   Track writes to timer registers 0x24-0x27 on the first bank.
+ *   A new timer value is used from the next reload on, as the counter
+ *   only reads its register on overflow or load.
+ * 
+ ******************************************************************************/
+static void ym2612_timers_write(unsigned int reg, unsigned int value, Bit64u now)
+{
+    ym2612_timers_update(now);
+    switch (reg)
+    {
+    case 0x24: // Timer A MSB
+        ym_timer_a_reg = (ym_timer_a_reg & 0x03) | (value << 2);
+        ym_timer_a.period = (1024 - ym_timer_a_reg) * YM2612_TIMER_A_CYCLES;
+        break;
+    case 0x25: // Timer A LSB
+        ym_timer_a_reg = (ym_timer_a_reg & 0x3FC) | (value & 0x03);
+        ym_timer_a.period = (1024 - ym_timer_a_reg) * YM2612_TIMER_A_CYCLES;
+        break;
+    case 0x26: // Timer B
+        ym_timer_b_reg = value;
+        ym_timer_b.period = (256 - ym_timer_b_reg) * YM2612_TIMER_B_CYCLES;
+        break;
+    case 0x27: // Timer control and channel 3 mode
+        ym2612_timer_control(&ym_timer_a, value & 1, (value >> 2) & 1, (value >> 4) & 1, now);
+        ym2612_timer_control(&ym_timer_b, (value >> 1) & 1, (value >> 3) & 1, (value >> 5) & 1, now);
+        break;
+    }
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Status
+ *   Build status byte from the timer and busy model at master clock "now"
+ *   bit 7: busy, bit 1: Timer B overflow, bit 0: Timer A overflow
+ * 
+ ******************************************************************************/
+unsigned int ym2612_status(Bit64u now)
+{
+    ym2612_timers_update(now);
+    return (now < ym_busy_until) << 7 | ym_timer_b.overflow << 1 | ym_timer_a.overflow;
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Registers reset
+ *   Clear register shadow to the chip power on values
+ * 
+ ******************************************************************************/
+static void ym2612_registers_reset()
+{
+    memset(ym_regs, 0, sizeof(ym_regs));
+    // Both outputs are enabled on reset
+    memset(&ym_regs[0][0xB4], 0xC0, 3);
+    memset(&ym_regs[1][0xB4], 0xC0, 3);
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Core port write
+ *   Forward a port write to the active synthesis core
+ * 
+ ******************************************************************************/
+static void ym2612_core_write(unsigned int port, unsigned int value)
+{
+    if (ym_core == YM2612_CORE_FAST)
+        ym2612_fast_write(port, value);
+    else
+        OPN2_WriteBuffered(&ym_chip, port, value);
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Registers replay
+ *   Send register shadow as port writes, timers and key on are left out
+ *   and each fnum goes out after its block/fnum MSB latch
+ * 
+ ******************************************************************************/
+static void ym2612_registers_replay(void (*write)(unsigned int port, unsigned int value))
+{
+    unsigned int bank, reg;
+    for (bank = 0; bank < 2; bank++)
+    {
+        for (reg = bank ? 0x30 : 0x22; reg < 0xB7; reg++)
+        {
+            if ((reg >= 0x24 && reg <= 0x26) || reg == 0x28 || reg == 0x29)
+                continue;
+            if ((reg & 0xF4) == 0xA4)
+                continue;
+            if ((reg & 0xF4) == 0xA0)
+            {
+                write(bank << 1, reg + 4);
+                write(bank << 1 | 1, ym_regs[bank][reg + 4]);
+            }
+            write(bank << 1, reg);
+            write(bank << 1 | 1, ym_regs[bank][reg]);
+        }
+    }
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Set core
+ *   Switch synthesis core at runtime. The new core is reset and the
+ *   register shadow replayed, notes already keyed on restart on the
+ *   next key on. Nuked and batch clock the same chip state and switch
+ *   without a reset.
+ * 
+ ******************************************************************************/
+void ym2612_set_core(int core)
+{
+    int shared = core != YM2612_CORE_FAST && ym_core != YM2612_CORE_FAST;
+
+    if (core == ym_core)
+        return;
+    ym_core = core;
+    if (shared)
+        return;
+    ym_silent = 0;
+    if (ym_core == YM2612_CORE_FAST)
+        ym2612_fast_reset();
+    else
+        OPN2_Reset(&ym_chip);
+    ym2612_registers_replay(ym2612_core_write);
+    // Restore the address latch for a data write still to come
+    ym2612_core_write((ym_address >> 7) & 2, ym_address & 0xFF);
+}
+
+int ym2612_get_core()
+{
+    return ym_core;
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Set mute
+ *   Mute channels in both cores, bit n mutes channel n + 1 and bit 6
+ *   the DAC
+ * 
+ ******************************************************************************/
+void ym2612_set_mute(unsigned int mute)
+{
+    OPN2_SetMute(&ym_chip, mute);
+    ym2612_fast_set_mute(mute);
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Register log
+ *   Record every port write as 6 bytes: native sample since log start
+ *   (32 bits, little endian), port and data. Logs replay through
+ *   tools/ymbench to compare cores.
+ * 
+ ******************************************************************************/
+static void ym2612_log_write(Bit64u sample, unsigned int port, unsigned int value)
+{
+    Bit8u entry[6];
+    entry[0] = sample;
+    entry[1] = sample >> 8;
+    entry[2] = sample >> 16;
+    entry[3] = sample >> 24;
+    entry[4] = port;
+    entry[5] = value;
+    fwrite(entry, 1, sizeof(entry), ym_log);
+}
+
+static void ym2612_log_state(unsigned int port, unsigned int value)
+{
+    ym2612_log_write(0, port, value);
+}
+
+int ym2612_log_open(const char *filename)
+{
+    ym2612_log_close();
+    ym_log = fopen(filename, "wb");
+    if (!ym_log)
+        return 0;
+    ym_log_start = get_master_clock() / YM2612_SAMPLE_CYCLES;
+    // Start with current register state so logs can begin mid song
+    ym2612_registers_replay(ym2612_log_state);
+    return 1;
+}
+
+void ym2612_log_close()
+{
+    if (ym_log)
+        fclose(ym_log);
+    ym_log = NULL;
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Set rate
+ *   Set output sample rate and rebuild the resampler kernel, the
+ *   YM2612 output low pass is part of the kernel. Returns 0 and keeps
+ *   the current rate for 0 or a rate above YM2612_MAX_RATE.
+ * 
+ ******************************************************************************/
+int ym2612_set_rate(unsigned int rate)
+{
+    if (!rate || rate > YM2612_MAX_RATE)
+        return 0;
+    ym_output_rate = rate;
+    resampler_init(&ym_resampler, YM2612_NATIVE_RATE, rate,
+                   use_filter ? FILTER_CUTOFF : 0,
+                   (double)(use_filter ? OUTPUT_FACTOR_F : OUTPUT_FACTOR) / (1 << INPUT_SHIFT));
+    // PSG steps are placed on the output frames the resampler produces
+    sn76489_set_frame_clocks(ym_resampler.step * YM2612_SAMPLE_CYCLES);
+    return 1;
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Silence
+ *   A chip with every envelope at maximum attenuation, nothing keyed on,
+ *   no buffered write and the DAC off outputs a constant level. After
+ *   SILENCE_SAMPLES such samples synthesis stops and the level is held
+ *   until the next port write. Timers are modelled analytically so they
+ *   keep running, the LFO and envelope counters of the core pause.
+ * 
+ ******************************************************************************/
+static int OPN2_Silent(ym3438_t *chip)
+{
+    Bit32u i;
+    if (chip->dacen || chip->mode_csm || (chip->writebuf[chip->writebuf_cur].port & 0x04))
+        return 0;
+    for (i = 0; i < 24; i++)
+    {
+        if (chip->mode_kon[i] || chip->eg_kon_latch[i] || chip->eg_level[i] != 0x3ff || chip->eg_out[i] != 0x3ff)
+            return 0;
+    }
+    return 1;
+}
+
+static void ym2612_silence_check(Bit32s *sample)
+{
+    if (sample[0] != ym_idle[0] || sample[1] != ym_idle[1] || sample[2] != ym_idle[2] || sample[3] != ym_idle[3] ||
+        !(ym_core == YM2612_CORE_FAST ? ym2612_fast_silent() : OPN2_Silent(&ym_chip)))
+    {
+        memcpy(ym_idle, sample, sizeof(ym_idle));
+        ym_silent = 0;
+        return;
+    }
+    ym_silent++;
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Mix
+ *   Weight FM and DAC of one native sample with their mixer gains into
+ *   a resampler input frame
+ * 
+ ******************************************************************************/
+static inline void ym2612_mix(const Bit32s *sample, Bit16s *input, int fm_gain, int dac_gain)
+{
+    Bit32s left = (sample[0] * fm_gain + sample[2] * dac_gain) >> (MIXER_GAIN_BITS - INPUT_SHIFT);
+    Bit32s right = (sample[1] * fm_gain + sample[3] * dac_gain) >> (MIXER_GAIN_BITS - INPUT_SHIFT);
+    input[0] = left > 32767 ? 32767 : (left < -32768 ? -32768 : left);
+    input[1] = right > 32767 ? 32767 : (right < -32768 ? -32768 : right);
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 Sync
+ *   Generate native samples from the active core up to master clock
+ *   "now", resample them and hand them with the PSG to the mixer
+ * 
+ ******************************************************************************/
+static void ym2612_sync(Bit64u now)
+{
+    Bit16s input[SYNC_BLOCK * 2], output[SYNC_OUTPUT * 2], psg[SYNC_OUTPUT * 2];
+    Bit32s sample[4];
+    int frames, count;
+    int fm_gain = mixer_get_gain(MIXER_FM), dac_gain = mixer_get_gain(MIXER_DAC);
+
+    // Writes sync from inside the 68K and Z80 scopes, the time is taken
+    // out of theirs
+    TIMING_BEGIN(TIMING_YM2612);
+    while (ym_sample_clock + YM2612_SAMPLE_CYCLES <= now)
+    {
+        if (ym_silent >= SILENCE_SAMPLES)
+        {
+            // Idle chip, hold its output level until the next write
+            frames = (now - ym_sample_clock) / YM2612_SAMPLE_CYCLES;
+            if (frames > SYNC_BLOCK)
+                frames = SYNC_BLOCK;
+            ym2612_mix(ym_idle, input, fm_gain, dac_gain);
+            ym_sample_clock += (Bit64u)frames * YM2612_SAMPLE_CYCLES;
+            count = resampler_hold(&ym_resampler, input, frames, output);
+            sn76489_render(psg, count);
+            mixer_write(output, psg, count);
+            continue;
+        }
+        for (frames = 0; frames < SYNC_BLOCK && ym_sample_clock + YM2612_SAMPLE_CYCLES <= now; frames++)
+        {
+            ym2612_generate(sample);
+            ym2612_silence_check(sample);
+            ym2612_mix(sample, &input[frames * 2], fm_gain, dac_gain);
+            ym_sample_clock += YM2612_SAMPLE_CYCLES;
+        }
+        count = resampler_process(&ym_resampler, input, frames, output);
+        sn76489_render(psg, count);
+        mixer_write(output, psg, count);
+    }
+    TIMING_END(TIMING_YM2612);
+}
+
 void ym2612_init()
 {
     OPN2_SetOptions(chip_type);
-    OPN2_Reset(&ym_chip, YM2612_RATE, YM2612_FREQ);
+    ym2612_fast_set_ladder(chip_type == YM2612);
+    ym2612_set_rate(ym_output_rate);
+    OPN2_Reset(&ym_chip);
+    ym2612_fast_reset();
+    ym2612_registers_reset();
+    ym2612_timers_reset();
+    ym_silent = 0;
+    ym_sample_clock = get_master_clock();
 }
 
 void ym2612_pulse_reset()
 {
-    OPN2_Reset(&ym_chip, YM2612_RATE, YM2612_FREQ);
+    ym2612_sync(get_master_clock());
+    OPN2_Reset(&ym_chip);
+    ym2612_fast_reset();
+    ym2612_registers_reset();
+    ym2612_timers_reset();
+    ym_silent = 0;
 }
 
 unsigned int ym2612_read_memory_8(unsigned int address)
 {
-    return OPN2_Read(&ym_chip, address);
+    // Every port returns the status on a discrete YM2612
+    return ym2612_status(get_master_clock());
 }
 
 void ym2612_write_memory_8(unsigned int address, unsigned int value)
 {
+    Bit64u now = get_master_clock();
     address &= 0x3;
+    value &= 0xFF;
+    // Samples before the write are generated with the previous register state
+    ym2612_sync(now);
+    ym_silent = 0;
     //printf("[yamaha w8]0x%x\t %x\n", address, value);
-    OPN2_Write(&ym_chip, address, value);
+    if (address & 1)
+    {
+        if (ym_address < 0x30)
+            ym2612_timers_write(ym_address, value, now);
+        ym_regs[ym_address >> 8][ym_address & 0xFF] = value;
+        ym_busy_until = now + YM2612_BUSY_CYCLES;
+    }
+    else
+    {
+        ym_address = ((address & 2) << 7) | value;
+    }
+    if (ym_log)
+        ym2612_log_write(now / YM2612_SAMPLE_CYCLES - ym_log_start, address, value);
+    ym2612_core_write(address, value);
 }
 
 unsigned int ym2612_read_memory_16(unsigned int address)
 {
-    unsigned int value = OPN2_Read(&ym_chip, address) << 8 | OPN2_Read(&ym_chip, address + 1);
+    unsigned int value = ym2612_read_memory_8(address) << 8 | ym2612_read_memory_8(address + 1);
     return value;
 }
 
@@ -55,25 +500,31 @@ void ym2612_write_memory_16(unsigned int address, unsigned int value)
 {
     address &= 0x3;
     //printf("[yamaha w16] 0x%x\n", address);
-    OPN2_Write(&ym_chip, address, value >> 8);
-    OPN2_Write(&ym_chip, address + 1, value & 0xFF);
+    ym2612_write_memory_8(address, value >> 8);
+    ym2612_write_memory_8(address + 1, value & 0xFF);
 }
 
+/******************************************************************************
+ * 
+ *   YM2612 Update
+ *   Catch up synthesis with the master clock, nudging the output rate
+ *   to keep the audio ring at its target fill level
+ * 
+ ******************************************************************************/
 void ym2612_update()
 {
-    //OPN2_GenerateResampled(&ym_chip, audio);
-}
-
-void ym2612_set_buffer(unsigned char *audio_buffer)
-{
-    audio = audio_buffer;
+    resampler_set_step(&ym_resampler, YM2612_NATIVE_RATE, ym_output_rate * audio_rate_control());
+    sn76489_set_frame_clocks(ym_resampler.step * YM2612_SAMPLE_CYCLES);
+    ym2612_sync(get_master_clock());
 }
 
-void _OPN2_Reset(ym3438_t *chip, Bit32u rate, Bit32u clock)
+void _OPN2_Reset(ym3438_t *chip)
 {
-    Bit32u i, rateratio;
-    rateratio = chip->rateratio;
+    Bit32u i, mute[7];
+    // Channel mutes are a frontend setting, they survive a reset
+    memcpy(mute, chip->mute, sizeof(mute));
     memset(chip, 0, sizeof(ym3438_t));
+    memcpy(chip->mute, mute, sizeof(mute));
     for (i = 0; i < 24; i++)
     {
         chip->eg_out[i] = 0x3ff;
@@ -86,14 +537,6 @@ void _OPN2_Reset(ym3438_t *chip, Bit32u rate, Bit32u clock)
         chip->pan_l[i] = 1;
         chip->pan_r[i] = 1;
     }
-    if (rate != 0)
-    {
-        chip->rateratio = (Bit32u)((((Bit64u)144 * rate) << RSM_FRAC) / clock);
-    }
-    else
-    {
-        chip->rateratio = rateratio;
-    }
 }
 
 void _OPN2_SetChipType(Bit32u type)
@@ -109,7 +552,7 @@ void _OPN2_SetChipType(Bit32u type)
 void OPN2_WriteBuffered(ym3438_t *chip, Bit32u port, Bit8u data)
 {
     Bit64u time1, time2;
-    Bit32s buffer[2];
+    Bit16s buffer[2];
     Bit64u skip;
 
     if (chip->writebuf[chip->writebuf_last].port & 0x04)
@@ -141,98 +584,95 @@ void OPN2_WriteBuffered(ym3438_t *chip, Bit32u port, Bit8u data)
     chip->writebuf_last = (chip->writebuf_last + 1) % OPN_WRITEBUF_SIZE;
 }
 
-void OPN2_GenerateResampled(ym3438_t *chip, Bit32s *buf)
+/******************************************************************************
+ * 
+ *   OPN2 Generate
+ *   Clock Nuked OPN2 through the 24 slots of one native sample,
+ *   applying buffered writes as they become due. FM channels go to
+ *   buf[0..1], channel 6 goes to buf[2..3] while it plays the DAC.
+ * 
+ ******************************************************************************/
+void OPN2_Generate(ym3438_t *chip, Bit32s *buf)
 {
     Bit32u i;
-    Bit32s buffer[2];
-    Bit32u mute;
+    Bit16s buffer[2];
+    Bit32u mute, side;
 
-    while (chip->samplecnt >= chip->rateratio)
+    buf[0] = buf[1] = buf[2] = buf[3] = 0;
+    for (i = 0; i < 24; i++)
     {
-        // printf("ratio     %d\t", chip->rateratio);
-        // printf("samplecnt %d\t", chip->samplecnt);
-        //if (chip->channel > 0)
-        //    printf("channels  %d\n", chip->channel);
-        chip->oldsamples[0] = chip->samples[0];
-        chip->oldsamples[1] = chip->samples[1];
-        chip->samples[0] = chip->samples[1] = 0;
-        for (i = 0; i < 24; i++)
+        switch (chip->cycles >> 2)
         {
-            switch (chip->cycles >> 2)
-            {
-            case 0: // Ch 2
-                mute = chip->mute[1];
-                break;
-            case 1: // Ch 6, DAC
-                mute = chip->mute[5 + chip->dacen];
-                break;
-            case 2: // Ch 4
-                mute = chip->mute[3];
-                break;
-            case 3: // Ch 1
-                mute = chip->mute[0];
-                break;
-            case 4: // Ch 5
-                mute = chip->mute[4];
-                break;
-            case 5: // Ch 3
-                mute = chip->mute[2];
-                break;
-            default:
-                mute = 0;
-                break;
-            }
-            OPN2_Clock(chip, buffer);
-            if (!mute)
-            {
-
-                chip->samples[0] += buffer[0];
-                chip->samples[1] += buffer[1];
-            }
-            while (chip->writebuf[chip->writebuf_cur].time <= chip->writebuf_samplecnt)
-            {
-                if (!(chip->writebuf[chip->writebuf_cur].port & 0x04))
-                {
-                    break;
-                }
-                chip->writebuf[chip->writebuf_cur].port &= 0x03;
-                OPN2_Write(chip, chip->writebuf[chip->writebuf_cur].port,
-                           chip->writebuf[chip->writebuf_cur].data);
-                chip->writebuf_cur = (chip->writebuf_cur + 1) % OPN_WRITEBUF_SIZE;
-            }
-            chip->writebuf_samplecnt++;
+        case 0: // Ch 2
+            mute = chip->mute[1];
+            break;
+        case 1: // Ch 6, DAC
+            mute = chip->mute[5 + chip->dacen];
+            break;
+        case 2: // Ch 4
+            mute = chip->mute[3];
+            break;
+        case 3: // Ch 1
+            mute = chip->mute[0];
+            break;
+        case 4: // Ch 5
+            mute = chip->mute[4];
+            break;
+        case 5: // Ch 3
+            mute = chip->mute[2];
+            break;
+        default:
+            mute = 0;
+            break;
         }
-        if (!use_filter)
+        side = ((chip->cycles >> 2) == 1 && chip->dacen) ? 2 : 0;
+        OPN2_Clock(chip, buffer);
+        if (!mute)
         {
-            chip->samples[0] *= OUTPUT_FACTOR;
-            chip->samples[1] *= OUTPUT_FACTOR;
+            buf[side] += buffer[0];
+            buf[side + 1] += buffer[1];
         }
-        else
+        while (chip->writebuf[chip->writebuf_cur].time <= chip->writebuf_samplecnt)
         {
-            chip->samples[0] = chip->oldsamples[0] + FILTER_CUTOFF_I * (chip->samples[0] * OUTPUT_FACTOR_F - chip->oldsamples[0]);
-            chip->samples[1] = chip->oldsamples[1] + FILTER_CUTOFF_I * (chip->samples[1] * OUTPUT_FACTOR_F - chip->oldsamples[1]);
+            if (!(chip->writebuf[chip->writebuf_cur].port & 0x04))
+            {
+                break;
+            }
+            chip->writebuf[chip->writebuf_cur].port &= 0x03;
+            OPN2_Write(chip, chip->writebuf[chip->writebuf_cur].port,
+                       chip->writebuf[chip->writebuf_cur].data);
+            chip->writebuf_cur = (chip->writebuf_cur + 1) % OPN_WRITEBUF_SIZE;
         }
-        chip->samplecnt -= chip->rateratio;
+        chip->writebuf_samplecnt++;
     }
-    buf[0] = (Bit32s)((chip->oldsamples[0] * (chip->rateratio - chip->samplecnt) + chip->samples[0] * chip->samplecnt) / chip->rateratio);
-    buf[1] = (Bit32s)((chip->oldsamples[1] * (chip->rateratio - chip->samplecnt) + chip->samples[1] * chip->samplecnt) / chip->rateratio);
-    chip->samplecnt += 1 << RSM_FRAC;
 }
 
-void OPN2_GenerateStream(ym3438_t *chip, Bit32s **sndptr, Bit32u numsamples)
+/******************************************************************************
+ * 
+ *   YM2612 Generate
+ *   Generate one native sample from the active core, both cores
+ *   return the sum of the 24 slot outputs of the chip, FM channels in
+ *   buffer[0..1] and the DAC in buffer[2..3]
+ * 
+ ******************************************************************************/
+void ym2612_generate(Bit32s *buffer)
 {
-    Bit32u i;
-    Bit32s *smpl, *smpr;
-    Bit32s buffer[2];
-    smpl = sndptr[0];
-    smpr = sndptr[1];
-
-    for (i = 0; i < numsamples; i++)
+    Bit16s sample[4];
+    if (ym_core == YM2612_CORE_FAST)
+    {
+        ym2612_fast_generate(sample);
+        buffer[0] = sample[0];
+        buffer[1] = sample[1];
+        buffer[2] = sample[2];
+        buffer[3] = sample[3];
+        return;
+    }
+    if (ym_core == YM2612_CORE_BATCH)
     {
-        OPN2_GenerateResampled(chip, buffer);
-        *smpl++ = buffer[0];
-        *smpr++ = buffer[1];
+        ym2612_batch_generate(&ym_chip, buffer);
+        return;
     }
+    OPN2_Generate(&ym_chip, buffer);
 }
 
 void OPN2_SetOptions(Bit8u flags)
@@ -262,4 +702,24 @@ void OPN2_SetMute(ym3438_t *chip, Bit32u mute)
     {
         chip->mute[i] = (mute >> i) & 0x01;
     }
-}
\ No newline at end of file
+    ym_silent = 0;
+}
+
+/******************************************************************************
+ * 
+ *   YM2612 State
+ *   Hand out both synthesis cores, the timers and the resampler history
+ *   for state_save. The resampler kernel depends on the output rate only.
+ * 
+ ******************************************************************************/
+unsigned int ym2612_state_blocks(state_block *blocks)
+{
+    state_block list[] = {
+        {ym_resampler.history, sizeof(resampler_t) - offsetof(resampler_t, history)},
+        STATE_BLOCK(ym_sample_clock), STATE_BLOCK(ym_silent), STATE_BLOCK(ym_idle), STATE_BLOCK(ym_chip),
+        STATE_BLOCK(ym_timer_a), STATE_BLOCK(ym_timer_b), STATE_BLOCK(ym_timer_a_reg),
+        STATE_BLOCK(ym_timer_b_reg), STATE_BLOCK(ym_busy_until), STATE_BLOCK(ym_address),
+        STATE_BLOCK(ym_core), STATE_BLOCK(ym_regs)};
+    memcpy(blocks, list, sizeof(list));
+    return sizeof(list) / sizeof(list[0]) + ym2612_fast_state_blocks(blocks + sizeof(list) / sizeof(list[0]));
+}
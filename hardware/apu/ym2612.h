@@ -1,7 +1,10 @@
-#define RSM_FRAC 10
 #define OPN_WRITEBUF_SIZE 2048
 #define OPN_WRITEBUF_DELAY 15
 
+#define YM2612_FREQ_DIVISOR 7                               // Frequency divisor to YM2612 clock
+#define YM2612_SAMPLE_CYCLES (144 * YM2612_FREQ_DIVISOR)    // Master clocks per FM sample
+#define YM2612_MAX_RATE 192000                              // Highest output rate ym2612_set_rate takes
+
 #include "libs/NukedOPN2/ym3438.h"
 
 enum
@@ -12,6 +15,13 @@ enum
     YM2612_W_FILTER
 };
 
+enum
+{
+    YM2612_CORE_NUKED = 0,
+    YM2612_CORE_FAST,
+    YM2612_CORE_BATCH
+};
+
 typedef struct _opn2_writebuf
 {
     Bit64u time;
@@ -19,6 +29,15 @@ typedef struct _opn2_writebuf
     Bit8u data;
 } opn2_writebuf;
 
+typedef struct _ym2612_timer
+{
+    Bit64u next;     // Master clock of the next overflow
+    Bit64u period;   // Master clocks between two overflows
+    Bit8u load;      // Counter is running
+    Bit8u enable;    // Overflow raises the status flag
+    Bit8u overflow;  // Status flag
+} ym2612_timer;
+
 typedef struct
 {
     Bit32u cycles;
@@ -162,10 +181,6 @@ typedef struct
     Bit8u pms[6];
 
     Bit32u mute[7];
-    Bit32s rateratio;
-    Bit32s samplecnt;
-    Bit32s oldsamples[2];
-    Bit32s samples[2];
 
     Bit64u writebuf_samplecnt;
     Bit32u writebuf_cur;
@@ -178,8 +193,19 @@ typedef struct
 #define OPN2_Reset _OPN2_Reset
 #define OPN2_SetChipType _OPN2_SetChipType
 void _OPN2_SetChipType(Bit32u type);
-void _OPN2_Reset(ym3438_t *chip, Bit32u rate, Bit32u clock);
+void _OPN2_Reset(ym3438_t *chip);
 void OPN2_WriteBuffered(ym3438_t *chip, Bit32u port, Bit8u data);
-void OPN2_GenerateStream(ym3438_t *chip, Bit32s **sndptr, Bit32u numsamples);
 void OPN2_SetOptions(Bit8u flags);
-void OPN2_SetMute(ym3438_t *chip, Bit32u mute);
\ No newline at end of file
+void OPN2_SetMute(ym3438_t *chip, Bit32u mute);
+void OPN2_Generate(ym3438_t *chip, Bit32s *buf);
+
+void ym2612_init();
+void ym2612_write_memory_8(unsigned int address, unsigned int value);
+void ym2612_set_core(int core);
+void ym2612_set_mute(unsigned int mute);
+int ym2612_get_core();
+void ym2612_generate(Bit32s *buffer);
+int ym2612_set_rate(unsigned int rate);
+void ym2612_update();
+int ym2612_log_open(const char *filename);
+void ym2612_log_close();
\ No newline at end of file
@@ -0,0 +1,891 @@
+#include "ym2612.h"
+#include "ym2612_batch.h"
+
+/******************************************************************************
+ *
+ *   YM2612 batch OPN2 clock
+ *   The 24 OPN2_Clock cycles of one native sample, run on Nuked's own
+ *   chip state stage by stage instead of cycle by cycle. Timers, key on,
+ *   LFO and envelope counters are cheap and still step once per cycle.
+ *   Envelope and phase generators become loops over the slot arrays, each
+ *   slot reading the pipeline registers Nuked would hand it on its cycle.
+ *   The operator chain keeps its cycle order, a slot modulates the next
+ *   one a single cycle later.
+ *   Samples with a register write landing, a test mode set or not
+ *   starting on cycle 0 go through OPN2_Generate, so output and chip
+ *   state stay bit-exact with Nuked and the cores can be switched at any
+ *   sample. ymbench -v checks this against a register log.
+ *
+ ******************************************************************************/
+
+enum
+{
+    eg_num_attack = 0,
+    eg_num_decay = 1,
+    eg_num_sustain = 2,
+    eg_num_release = 3
+};
+
+// Define log-sin table, same ROM as Nuked's logsinrom
+static const Bit16u batch_logsin[256] = {
+    0x859, 0x6c3, 0x607, 0x58b, 0x52e, 0x4e4, 0x4a6, 0x471, 0x443, 0x41a, 0x3f5, 0x3d3, 0x3b5, 0x398, 0x37e, 0x365,
+    0x34e, 0x339, 0x324, 0x311, 0x2ff, 0x2ed, 0x2dc, 0x2cd, 0x2bd, 0x2af, 0x2a0, 0x293, 0x286, 0x279, 0x26d, 0x261,
+    0x256, 0x24b, 0x240, 0x236, 0x22c, 0x222, 0x218, 0x20f, 0x206, 0x1fd, 0x1f5, 0x1ec, 0x1e4, 0x1dc, 0x1d4, 0x1cd,
+    0x1c5, 0x1be, 0x1b7, 0x1b0, 0x1a9, 0x1a2, 0x19b, 0x195, 0x18f, 0x188, 0x182, 0x17c, 0x177, 0x171, 0x16b, 0x166,
+    0x160, 0x15b, 0x155, 0x150, 0x14b, 0x146, 0x141, 0x13c, 0x137, 0x133, 0x12e, 0x129, 0x125, 0x121, 0x11c, 0x118,
+    0x114, 0x10f, 0x10b, 0x107, 0x103, 0x0ff, 0x0fb, 0x0f8, 0x0f4, 0x0f0, 0x0ec, 0x0e9, 0x0e5, 0x0e2, 0x0de, 0x0db,
+    0x0d7, 0x0d4, 0x0d1, 0x0cd, 0x0ca, 0x0c7, 0x0c4, 0x0c1, 0x0be, 0x0bb, 0x0b8, 0x0b5, 0x0b2, 0x0af, 0x0ac, 0x0a9,
+    0x0a7, 0x0a4, 0x0a1, 0x09f, 0x09c, 0x099, 0x097, 0x094, 0x092, 0x08f, 0x08d, 0x08a, 0x088, 0x086, 0x083, 0x081,
+    0x07f, 0x07d, 0x07a, 0x078, 0x076, 0x074, 0x072, 0x070, 0x06e, 0x06c, 0x06a, 0x068, 0x066, 0x064, 0x062, 0x060,
+    0x05e, 0x05c, 0x05b, 0x059, 0x057, 0x055, 0x053, 0x052, 0x050, 0x04e, 0x04d, 0x04b, 0x04a, 0x048, 0x046, 0x045,
+    0x043, 0x042, 0x040, 0x03f, 0x03e, 0x03c, 0x03b, 0x039, 0x038, 0x037, 0x035, 0x034, 0x033, 0x031, 0x030, 0x02f,
+    0x02e, 0x02d, 0x02b, 0x02a, 0x029, 0x028, 0x027, 0x026, 0x025, 0x024, 0x023, 0x022, 0x021, 0x020, 0x01f, 0x01e,
+    0x01d, 0x01c, 0x01b, 0x01a, 0x019, 0x018, 0x017, 0x017, 0x016, 0x015, 0x014, 0x014, 0x013, 0x012, 0x011, 0x011,
+    0x010, 0x00f, 0x00f, 0x00e, 0x00d, 0x00d, 0x00c, 0x00c, 0x00b, 0x00a, 0x00a, 0x009, 0x009, 0x008, 0x008, 0x007,
+    0x007, 0x007, 0x006, 0x006, 0x005, 0x005, 0x005, 0x004, 0x004, 0x004, 0x003, 0x003, 0x003, 0x002, 0x002, 0x002,
+    0x002, 0x001, 0x001, 0x001, 0x001, 0x001, 0x001, 0x001, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000};
+
+// Define exponent table, same ROM as Nuked's exprom
+static const Bit16u batch_exp[256] = {
+    0x000, 0x003, 0x006, 0x008, 0x00b, 0x00e, 0x011, 0x014, 0x016, 0x019, 0x01c, 0x01f, 0x022, 0x025, 0x028, 0x02a,
+    0x02d, 0x030, 0x033, 0x036, 0x039, 0x03c, 0x03f, 0x042, 0x045, 0x048, 0x04b, 0x04e, 0x051, 0x054, 0x057, 0x05a,
+    0x05d, 0x060, 0x063, 0x066, 0x069, 0x06c, 0x06f, 0x072, 0x075, 0x078, 0x07b, 0x07e, 0x082, 0x085, 0x088, 0x08b,
+    0x08e, 0x091, 0x094, 0x098, 0x09b, 0x09e, 0x0a1, 0x0a4, 0x0a8, 0x0ab, 0x0ae, 0x0b1, 0x0b5, 0x0b8, 0x0bb, 0x0be,
+    0x0c2, 0x0c5, 0x0c8, 0x0cc, 0x0cf, 0x0d2, 0x0d6, 0x0d9, 0x0dc, 0x0e0, 0x0e3, 0x0e7, 0x0ea, 0x0ed, 0x0f1, 0x0f4,
+    0x0f8, 0x0fb, 0x0ff, 0x102, 0x106, 0x109, 0x10c, 0x110, 0x114, 0x117, 0x11b, 0x11e, 0x122, 0x125, 0x129, 0x12c,
+    0x130, 0x134, 0x137, 0x13b, 0x13e, 0x142, 0x146, 0x149, 0x14d, 0x151, 0x154, 0x158, 0x15c, 0x160, 0x163, 0x167,
+    0x16b, 0x16f, 0x172, 0x176, 0x17a, 0x17e, 0x181, 0x185, 0x189, 0x18d, 0x191, 0x195, 0x199, 0x19c, 0x1a0, 0x1a4,
+    0x1a8, 0x1ac, 0x1b0, 0x1b4, 0x1b8, 0x1bc, 0x1c0, 0x1c4, 0x1c8, 0x1cc, 0x1d0, 0x1d4, 0x1d8, 0x1dc, 0x1e0, 0x1e4,
+    0x1e8, 0x1ec, 0x1f0, 0x1f5, 0x1f9, 0x1fd, 0x201, 0x205, 0x209, 0x20e, 0x212, 0x216, 0x21a, 0x21e, 0x223, 0x227,
+    0x22b, 0x230, 0x234, 0x238, 0x23c, 0x241, 0x245, 0x249, 0x24e, 0x252, 0x257, 0x25b, 0x25f, 0x264, 0x268, 0x26d,
+    0x271, 0x276, 0x27a, 0x27f, 0x283, 0x288, 0x28c, 0x291, 0x295, 0x29a, 0x29e, 0x2a3, 0x2a8, 0x2ac, 0x2b1, 0x2b5,
+    0x2ba, 0x2bf, 0x2c4, 0x2c8, 0x2cd, 0x2d2, 0x2d6, 0x2db, 0x2e0, 0x2e5, 0x2e9, 0x2ee, 0x2f3, 0x2f8, 0x2fd, 0x302,
+    0x306, 0x30b, 0x310, 0x315, 0x31a, 0x31f, 0x324, 0x329, 0x32e, 0x333, 0x338, 0x33d, 0x342, 0x347, 0x34c, 0x351,
+    0x356, 0x35b, 0x360, 0x365, 0x36a, 0x370, 0x375, 0x37a, 0x37f, 0x384, 0x38a, 0x38f, 0x394, 0x399, 0x39f, 0x3a4,
+    0x3a9, 0x3ae, 0x3b4, 0x3b9, 0x3bf, 0x3c4, 0x3c9, 0x3cf, 0x3d4, 0x3da, 0x3df, 0x3e4, 0x3ea, 0x3ef, 0x3f5, 0x3fa};
+
+// Define key code note from the 4 upper fnum bits
+static const Bit32u batch_fn_note[16] = {0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 3, 3, 3, 3, 3, 3};
+
+// Define envelope increments of rates 48 and up
+static const Bit32u batch_eg_stephi[4][4] = {{0, 0, 0, 0}, {1, 0, 0, 0}, {1, 0, 1, 0}, {1, 1, 1, 0}};
+
+// Define LFO amplitude modulation shifts by AMS
+static const Bit8u batch_eg_am_shift[4] = {7, 3, 1, 0};
+
+// Define detune base values
+static const Bit32u batch_pg_detune[8] = {16, 17, 19, 20, 22, 24, 27, 29};
+
+// Define LFO phase modulation shifts by PMS and LFO step
+static const Bit32u batch_pg_lfo_sh1[8][8] = {
+    {7, 7, 7, 7, 7, 7, 7, 7}, {7, 7, 7, 7, 7, 7, 7, 7}, {7, 7, 7, 7, 7, 7, 1, 1}, {7, 7, 7, 7, 1, 1, 1, 1},
+    {7, 7, 7, 1, 1, 1, 1, 0}, {7, 7, 1, 1, 0, 0, 0, 0}, {7, 7, 1, 1, 0, 0, 0, 0}, {7, 7, 1, 1, 0, 0, 0, 0}};
+static const Bit32u batch_pg_lfo_sh2[8][8] = {
+    {7, 7, 7, 7, 7, 7, 7, 7}, {7, 7, 7, 7, 2, 2, 2, 2}, {7, 7, 7, 2, 2, 2, 7, 7}, {7, 7, 2, 2, 7, 7, 2, 2},
+    {7, 7, 2, 7, 7, 7, 2, 7}, {7, 7, 7, 2, 7, 7, 2, 1}, {7, 7, 7, 2, 7, 7, 2, 1}, {7, 7, 7, 2, 7, 7, 2, 1}};
+
+// Define register offset of each slot and channel, slot order is OP1, OP3
+// of the 6 channels, OP2 and OP4 are 12 slots further
+static const Bit32u batch_op_offset[12] = {0x000, 0x001, 0x002, 0x100, 0x101, 0x102, 0x004, 0x005, 0x006, 0x104, 0x105, 0x106};
+static const Bit32u batch_ch_offset[6] = {0x000, 0x001, 0x002, 0x100, 0x101, 0x102};
+
+// Define LFO cycles per step by LFO frequency
+static const Bit32u batch_lfo_cycles[8] = {108, 77, 71, 67, 62, 44, 8, 5};
+
+// Define modulation inputs and output of each operator by algorithm: OP1
+// (two last outputs), OP2, previous operator (two buses) and channel output
+static const Bit32u batch_fm_algorithm[4][6][8] = {
+    {{1, 1, 1, 1, 1, 1, 1, 1}, {1, 1, 1, 1, 1, 1, 1, 1}, {0, 0, 0, 0, 0, 0, 0, 0},
+     {0, 0, 0, 0, 0, 0, 0, 0}, {0, 0, 0, 0, 0, 0, 0, 0}, {0, 0, 0, 0, 0, 0, 0, 1}},
+    {{0, 1, 0, 0, 0, 1, 0, 0}, {0, 0, 0, 0, 0, 0, 0, 0}, {1, 1, 1, 0, 0, 0, 0, 0},
+     {0, 0, 0, 0, 0, 0, 0, 0}, {0, 0, 0, 0, 0, 0, 0, 0}, {0, 0, 0, 0, 0, 1, 1, 1}},
+    {{0, 0, 0, 0, 0, 0, 0, 0}, {0, 0, 0, 0, 0, 0, 0, 0}, {0, 0, 0, 0, 0, 0, 0, 0},
+     {1, 0, 0, 1, 1, 0, 0, 0}, {0, 0, 1, 0, 0, 0, 0, 0}, {0, 0, 0, 0, 1, 1, 1, 1}},
+    {{0, 0, 1, 0, 0, 1, 0, 0}, {0, 0, 0, 0, 0, 0, 0, 0}, {0, 0, 0, 1, 0, 0, 0, 0},
+     {1, 1, 0, 1, 1, 0, 0, 0}, {0, 0, 1, 0, 0, 0, 0, 0}, {1, 1, 1, 1, 1, 1, 1, 1}}};
+
+// Define channel output in each 4 cycle group, group 1 plays the DAC when on
+static const Bit8u batch_mute_channel[6] = {1, 5, 3, 0, 4, 2};
+
+/******************************************************************************
+ *
+ *   Batch Write applied
+ *   Nuked rewrites the last addressed register on every cycle of its slot
+ *   or channel while write_fm_data is set. Once the value is in, those
+ *   rewrites change nothing and the sample can be batched.
+ *
+ ******************************************************************************/
+static int batch_write_applied(ym3438_t *chip)
+{
+    Bit32u i, slot, value;
+    Bit32u address = chip->address;
+    Bit8u data = chip->data;
+
+    if (!chip->write_fm_data)
+        return 1;
+    if (data != (chip->write_data & 0xff))
+        return 0;
+    for (i = 0; i < 12; i++)
+    {
+        if (batch_op_offset[i] != (address & 0x107))
+            continue;
+        slot = i + ((address & 0x08) ? 12 : 0);
+        switch (address & 0xf0)
+        {
+        case 0x30:
+            value = data & 0x0f;
+            value = value ? value << 1 : 1;
+            return chip->multi[slot] == value && chip->dt[slot] == ((data >> 4) & 0x07);
+        case 0x40:
+            return chip->tl[slot] == (data & 0x7f);
+        case 0x50:
+            return chip->ar[slot] == (data & 0x1f) && chip->ks[slot] == ((data >> 6) & 0x03);
+        case 0x60:
+            return chip->dr[slot] == (data & 0x1f) && chip->am[slot] == ((data >> 7) & 0x01);
+        case 0x70:
+            return chip->sr[slot] == (data & 0x1f);
+        case 0x80:
+            value = (data >> 4) & 0x0f;
+            value |= (value + 1) & 0x10;
+            return chip->rr[slot] == (data & 0x0f) && chip->sl[slot] == value;
+        case 0x90:
+            return chip->ssg_eg[slot] == (data & 0x0f);
+        }
+    }
+    for (i = 0; i < 6; i++)
+    {
+        if (batch_ch_offset[i] != (address & 0x103))
+            continue;
+        switch (address & 0xfc)
+        {
+        case 0xa0:
+            value = data | ((chip->reg_a4 & 0x07) << 8);
+            return chip->fnum[i] == value && chip->block[i] == ((chip->reg_a4 >> 3) & 0x07) &&
+                   chip->kcode[i] == ((((chip->reg_a4 >> 3) & 0x07) << 2) | batch_fn_note[value >> 7]);
+        case 0xa4:
+            return chip->reg_a4 == data;
+        case 0xa8:
+            value = data | ((chip->reg_ac & 0x07) << 8);
+            return chip->fnum_3ch[i] == value && chip->block_3ch[i] == ((chip->reg_ac >> 3) & 0x07) &&
+                   chip->kcode_3ch[i] == ((((chip->reg_ac >> 3) & 0x07) << 2) | batch_fn_note[value >> 7]);
+        case 0xac:
+            return chip->reg_ac == data;
+        case 0xb0:
+            return chip->connect[i] == (data & 0x07) && chip->fb[i] == ((data >> 3) & 0x07);
+        case 0xb4:
+            return chip->pms[i] == (data & 0x07) && chip->ams[i] == ((data >> 4) & 0x03) &&
+                   chip->pan_l[i] == ((data >> 7) & 0x01) && chip->pan_r[i] == ((data >> 6) & 0x01);
+        }
+    }
+    return 1;
+}
+
+/******************************************************************************
+ *
+ *   Batch Ready
+ *   A sample can be batched when it starts on cycle 0, no port write goes
+ *   through the IO latches or lands from the write buffer during it, the
+ *   last register write is already in and no test mode alters the
+ *   generators
+ *
+ ******************************************************************************/
+static int batch_ready(ym3438_t *chip)
+{
+    opn2_writebuf *next = &chip->writebuf[chip->writebuf_cur];
+
+    if (chip->cycles != 0 || (chip->write_a & 0x03) || (chip->write_d & 0x03))
+        return 0;
+    if ((next->port & 0x04) && next->time < chip->writebuf_samplecnt + 24)
+        return 0;
+    if (chip->mode_test_21[3] || chip->mode_test_21[4] || chip->mode_test_21[5] || chip->mode_test_2c[5])
+        return 0;
+    return batch_write_applied(chip);
+}
+
+/******************************************************************************
+ *
+ *   Batch Control
+ *   Per cycle part of OPN2_Clock: envelope and LFO counters, IO busy
+ *   counter, timers, key on latches and LFO step
+ *
+ ******************************************************************************/
+static void batch_control(ym3438_t *chip, Bit32u cycle)
+{
+    Bit16u time;
+    Bit8u load;
+
+    chip->lfo_inc = chip->mode_test_21[1];
+    chip->pg_read >>= 1;
+    chip->eg_read[1] >>= 1;
+    chip->eg_cycle++;
+    if (cycle == 1 && chip->eg_quotient == 2)
+    {
+        if (chip->eg_cycle_stop)
+            chip->eg_shift_lock = 0;
+        else
+            chip->eg_shift_lock = chip->eg_shift + 1;
+        chip->eg_timer_low_lock = chip->eg_timer & 0x03;
+    }
+    switch (cycle)
+    {
+    case 0:
+        chip->lfo_pm = chip->lfo_cnt >> 2;
+        if (chip->lfo_cnt & 0x40)
+            chip->lfo_am = chip->lfo_cnt & 0x3f;
+        else
+            chip->lfo_am = chip->lfo_cnt ^ 0x3f;
+        chip->lfo_am <<= 1;
+        break;
+    case 1:
+        chip->eg_quotient++;
+        chip->eg_quotient %= 3;
+        chip->eg_cycle = 0;
+        chip->eg_cycle_stop = 1;
+        chip->eg_shift = 0;
+        chip->eg_timer_inc |= chip->eg_quotient >> 1;
+        chip->eg_timer = chip->eg_timer + chip->eg_timer_inc;
+        chip->eg_timer_inc = chip->eg_timer >> 12;
+        chip->eg_timer &= 0xfff;
+        break;
+    case 2:
+        // Test register read out, shifted out again before the sample ends
+        chip->pg_read = chip->pg_phase[21] & 0x3ff;
+        chip->eg_read[1] = chip->eg_out[0];
+        break;
+    case 13:
+        chip->eg_cycle = 0;
+        chip->eg_cycle_stop = 1;
+        chip->eg_shift = 0;
+        chip->eg_timer = chip->eg_timer + chip->eg_timer_inc;
+        chip->eg_timer_inc = chip->eg_timer >> 12;
+        chip->eg_timer &= 0xfff;
+        break;
+    case 23:
+        chip->lfo_inc |= 1;
+        break;
+    }
+    if (((chip->eg_timer >> chip->eg_cycle) | (chip->pin_test_in & chip->eg_custom_timer)) & chip->eg_cycle_stop)
+    {
+        chip->eg_shift = chip->eg_cycle;
+        chip->eg_cycle_stop = 0;
+    }
+
+    // IO, no write reaches the latches in a batched sample
+    chip->write_a_en = 0;
+    chip->write_d_en = 0;
+    chip->write_a <<= 1;
+    chip->write_d <<= 1;
+    chip->busy = chip->write_busy;
+    chip->write_busy_cnt += chip->write_busy;
+    chip->write_busy = chip->write_busy && !(chip->write_busy_cnt >> 5);
+    chip->write_busy_cnt &= 0x1f;
+
+    // Timer A, its overflow keys channel 3 on in CSM mode
+    load = chip->timer_a_overflow;
+    if (cycle == 2)
+    {
+        load |= (!chip->timer_a_load_lock && chip->timer_a_load);
+        chip->timer_a_load_lock = chip->timer_a_load;
+        chip->mode_kon_csm = chip->mode_csm ? load : 0;
+    }
+    time = chip->timer_a_load_latch ? chip->timer_a_reg : chip->timer_a_cnt;
+    chip->timer_a_load_latch = load;
+    if ((cycle == 1 && chip->timer_a_load_lock) || chip->mode_test_21[2])
+        time++;
+    if (chip->timer_a_reset)
+    {
+        chip->timer_a_reset = 0;
+        chip->timer_a_overflow_flag = 0;
+    }
+    else
+        chip->timer_a_overflow_flag |= chip->timer_a_overflow & chip->timer_a_enable;
+    chip->timer_a_overflow = (time >> 10);
+    chip->timer_a_cnt = time & 0x3ff;
+
+    // Timer B
+    load = chip->timer_b_overflow;
+    if (cycle == 2)
+    {
+        load |= (!chip->timer_b_load_lock && chip->timer_b_load);
+        chip->timer_b_load_lock = chip->timer_b_load;
+    }
+    time = chip->timer_b_load_latch ? chip->timer_b_reg : chip->timer_b_cnt;
+    chip->timer_b_load_latch = load;
+    if (cycle == 1)
+        chip->timer_b_subcnt++;
+    if ((chip->timer_b_subcnt == 0x10 && chip->timer_b_load_lock) || chip->mode_test_21[2])
+        time++;
+    chip->timer_b_subcnt &= 0x0f;
+    if (chip->timer_b_reset)
+    {
+        chip->timer_b_reset = 0;
+        chip->timer_b_overflow_flag = 0;
+    }
+    else
+        chip->timer_b_overflow_flag |= chip->timer_b_overflow & chip->timer_b_enable;
+    chip->timer_b_overflow = (time >> 8);
+    chip->timer_b_cnt = time & 0xff;
+
+    // Key on latch of this cycle's slot
+    chip->eg_kon_latch[cycle] = chip->mode_kon[cycle];
+    chip->eg_kon_csm[cycle] = 0;
+    if (cycle % 6 == 2 && chip->mode_kon_csm)
+    {
+        chip->eg_kon_latch[cycle] = 1;
+        chip->eg_kon_csm[cycle] = 1;
+    }
+    if (cycle == chip->mode_kon_channel)
+    {
+        chip->mode_kon[cycle] = chip->mode_kon_operator[0];
+        chip->mode_kon[cycle + 12] = chip->mode_kon_operator[1];
+        chip->mode_kon[cycle + 6] = chip->mode_kon_operator[2];
+        chip->mode_kon[cycle + 18] = chip->mode_kon_operator[3];
+    }
+
+    // LFO
+    if ((chip->lfo_quotient & batch_lfo_cycles[chip->lfo_freq]) == batch_lfo_cycles[chip->lfo_freq])
+    {
+        chip->lfo_quotient = 0;
+        chip->lfo_cnt++;
+    }
+    else
+        chip->lfo_quotient += chip->lfo_inc;
+    chip->lfo_cnt &= chip->lfo_en;
+}
+
+/******************************************************************************
+ *
+ *   Batch Phase source
+ *   Frequency Nuked latches into pg_fnum/pg_block/pg_kcode for a slot on
+ *   the cycle before it, channel 3 special mode gives OP1-OP3 their own
+ *
+ ******************************************************************************/
+static void batch_pg_source(ym3438_t *chip, Bit32u slot, Bit32u *fnum, Bit8u *block, Bit8u *kcode)
+{
+    Bit32u channel = slot % 6;
+    Bit32u index = slot == 2 ? 1 : slot == 8 ? 0 : 2;
+
+    if (chip->mode_ch3 && (slot == 2 || slot == 8 || slot == 14))
+    {
+        *fnum = chip->fnum_3ch[index];
+        *block = chip->block_3ch[index];
+        *kcode = chip->kcode_3ch[index];
+        return;
+    }
+    *fnum = chip->fnum[channel];
+    *block = chip->block[channel];
+    *kcode = chip->kcode[channel];
+}
+
+/******************************************************************************
+ *
+ *   Batch Phase increment
+ *   OPN2_PhaseCalcIncrement for one slot
+ *
+ ******************************************************************************/
+static void batch_pg_increment(ym3438_t *chip, Bit32u slot, Bit32u fnum, Bit8u pg_block, Bit8u kcode)
+{
+    Bit32u fnum_h = fnum >> 4;
+    Bit32u fm;
+    Bit32u basefreq;
+    Bit8u lfo = chip->lfo_pm;
+    Bit8u lfo_l = lfo & 0x0f;
+    Bit8u pms = chip->pms[slot % 6];
+    Bit8u dt = chip->dt[slot];
+    Bit8u dt_l = dt & 0x03;
+    Bit8u detune = 0;
+    Bit8u block, note;
+    Bit8u sum, sum_h, sum_l;
+
+    fnum <<= 1;
+    if (lfo_l & 0x08)
+        lfo_l ^= 0x0f;
+    fm = (fnum_h >> batch_pg_lfo_sh1[pms][lfo_l]) + (fnum_h >> batch_pg_lfo_sh2[pms][lfo_l]);
+    if (pms > 5)
+        fm <<= pms - 5;
+    fm >>= 2;
+    if (lfo & 0x10)
+        fnum -= fm;
+    else
+        fnum += fm;
+    fnum &= 0xfff;
+
+    basefreq = (fnum << pg_block) >> 2;
+    if (dt_l)
+    {
+        if (kcode > 0x1c)
+            kcode = 0x1c;
+        block = kcode >> 2;
+        note = kcode & 0x03;
+        sum = block + 9 + ((dt_l == 3) | (dt_l & 0x02));
+        sum_h = sum >> 1;
+        sum_l = sum & 0x01;
+        detune = batch_pg_detune[(sum_l << 2) | note] >> (9 - sum_h);
+    }
+    if (dt & 0x04)
+        basefreq -= detune;
+    else
+        basefreq += detune;
+    basefreq &= 0x1ffff;
+    chip->pg_inc[slot] = ((basefreq * chip->multi[slot]) >> 1) & 0xfffff;
+}
+
+/******************************************************************************
+ *
+ *   Batch Phase step
+ *   Second half of OPN2_PhaseGenerate for one slot, the increment has been
+ *   masked by the phase reset of the key on
+ *
+ ******************************************************************************/
+static inline void batch_pg_step(ym3438_t *chip, Bit32u slot)
+{
+    if (chip->pg_reset[slot])
+        chip->pg_phase[slot] = 0;
+    chip->pg_phase[slot] = (chip->pg_phase[slot] + chip->pg_inc[slot]) & 0xfffff;
+}
+
+/******************************************************************************
+ *
+ *   Batch Envelope SSG-EG
+ *   OPN2_EnvelopeSSGEG for one slot
+ *
+ ******************************************************************************/
+static void batch_eg_ssg(ym3438_t *chip, Bit32u slot)
+{
+    Bit8u ssg_eg = chip->ssg_eg[slot];
+    Bit8u direction = 0;
+
+    chip->eg_ssg_pgrst_latch[slot] = 0;
+    chip->eg_ssg_repeat_latch[slot] = 0;
+    chip->eg_ssg_hold_up_latch[slot] = 0;
+    chip->eg_ssg_inv[slot] = 0;
+    if (ssg_eg & 0x08)
+    {
+        direction = chip->eg_ssg_dir[slot];
+        if (chip->eg_level[slot] & 0x200)
+        {
+            // Reset, repeat and alternate once past the SSG-EG limit
+            if ((ssg_eg & 0x03) == 0x00)
+                chip->eg_ssg_pgrst_latch[slot] = 1;
+            if ((ssg_eg & 0x01) == 0x00)
+                chip->eg_ssg_repeat_latch[slot] = 1;
+            if ((ssg_eg & 0x03) == 0x02)
+                direction ^= 1;
+            if ((ssg_eg & 0x03) == 0x03)
+                direction = 1;
+        }
+        if (chip->eg_kon_latch[slot] && ((ssg_eg & 0x07) == 0x05 || (ssg_eg & 0x07) == 0x03))
+            chip->eg_ssg_hold_up_latch[slot] = 1;
+        direction &= chip->eg_kon[slot];
+        chip->eg_ssg_inv[slot] = (chip->eg_ssg_dir[slot] ^ ((ssg_eg >> 2) & 0x01)) & chip->eg_kon[slot];
+    }
+    chip->eg_ssg_dir[slot] = direction;
+    chip->eg_ssg_enable[slot] = (ssg_eg >> 3) & 0x01;
+}
+
+/******************************************************************************
+ *
+ *   Batch Envelope rate
+ *   Rate OPN2_EnvelopePrepare selects for one slot
+ *
+ ******************************************************************************/
+static Bit8u batch_eg_rate(ym3438_t *chip, Bit32u slot)
+{
+    Bit8u rate_sel = chip->eg_state[slot];
+
+    if ((chip->eg_kon[slot] && chip->eg_ssg_repeat_latch[slot]) || (!chip->eg_kon[slot] && chip->eg_kon_latch[slot]))
+        rate_sel = eg_num_attack;
+    switch (rate_sel)
+    {
+    case eg_num_attack:
+        return chip->ar[slot];
+    case eg_num_decay:
+        return chip->dr[slot];
+    case eg_num_sustain:
+        return chip->sr[slot];
+    default:
+        return (chip->rr[slot] << 1) | 0x01;
+    }
+}
+
+/******************************************************************************
+ *
+ *   Batch Envelope increment
+ *   Step OPN2_EnvelopePrepare derives from a rate and key scale one cycle
+ *   later, with the envelope counter locks of that cycle
+ *
+ ******************************************************************************/
+static Bit8u batch_eg_increment(ym3438_t *chip, Bit8u eg_rate, Bit8u eg_ksv, Bit8u *ratemax)
+{
+    Bit8u rate;
+    Bit8u sum;
+    Bit8u inc = 0;
+
+    rate = (eg_rate << 1) + eg_ksv;
+    if (rate > 0x3f)
+        rate = 0x3f;
+    sum = ((rate >> 2) + chip->eg_shift_lock) & 0x0f;
+    if (eg_rate != 0 && chip->eg_quotient == 2)
+    {
+        if (rate < 48)
+        {
+            switch (sum)
+            {
+            case 12:
+                inc = 1;
+                break;
+            case 13:
+                inc = (rate >> 1) & 0x01;
+                break;
+            case 14:
+                inc = rate & 0x01;
+                break;
+            default:
+                break;
+            }
+        }
+        else
+        {
+            inc = batch_eg_stephi[rate & 0x03][chip->eg_timer_low_lock] + (rate >> 2) - 11;
+            if (inc > 4)
+                inc = 4;
+        }
+    }
+    *ratemax = (rate >> 1) == 0x1f;
+    return inc;
+}
+
+/******************************************************************************
+ *
+ *   Batch Envelope output
+ *   OPN2_EnvelopeGenerate for one slot, channel 3 ignores TL in CSM mode
+ *
+ ******************************************************************************/
+static void batch_eg_output(ym3438_t *chip, Bit32u slot, Bit8u lfo_am, Bit8u tl)
+{
+    Bit16u level = chip->eg_level[slot];
+
+    if (chip->eg_ssg_inv[slot])
+        level = 512 - level;
+    level &= 0x3ff;
+    level += lfo_am;
+    if (!(chip->mode_csm && slot % 6 == 2))
+        level += tl << 3;
+    if (level > 0x3ff)
+        level = 0x3ff;
+    chip->eg_out[slot] = level;
+}
+
+/******************************************************************************
+ *
+ *   Batch Envelope ADSR
+ *   OPN2_EnvelopeADSR for one slot with the step, sustain level and total
+ *   level it was prepared with
+ *
+ ******************************************************************************/
+static void batch_eg_adsr(ym3438_t *chip, Bit32u slot, Bit8u eg_inc, Bit8u eg_ratemax, Bit8u eg_sl, Bit8u eg_tl)
+{
+    Bit8u nkon = chip->eg_kon_latch[slot];
+    Bit8u okon = chip->eg_kon[slot];
+    Bit8u kon_event;
+    Bit8u koff_event;
+    Bit8u eg_off;
+    Bit16s level;
+    Bit16s nextlevel = 0;
+    Bit16s ssg_level;
+    Bit8u nextstate = chip->eg_state[slot];
+    Bit16s inc = 0;
+
+    chip->pg_reset[slot] = (nkon && !okon) || chip->eg_ssg_pgrst_latch[slot];
+    kon_event = (nkon && !okon) || (okon && chip->eg_ssg_repeat_latch[slot]);
+    koff_event = okon && !nkon;
+
+    ssg_level = level = (Bit16s)chip->eg_level[slot];
+    if (chip->eg_ssg_inv[slot])
+    {
+        ssg_level = 512 - level;
+        ssg_level &= 0x3ff;
+    }
+    if (koff_event)
+        level = ssg_level;
+    if (chip->eg_ssg_enable[slot])
+        eg_off = level >> 9;
+    else
+        eg_off = (level & 0x3f0) == 0x3f0;
+    nextlevel = level;
+    if (kon_event)
+    {
+        nextstate = eg_num_attack;
+        // Instant attack
+        if (eg_ratemax)
+            nextlevel = 0;
+        else if (chip->eg_state[slot] == eg_num_attack && level != 0 && eg_inc && nkon)
+            inc = (~level << eg_inc) >> 5;
+    }
+    else
+    {
+        switch (chip->eg_state[slot])
+        {
+        case eg_num_attack:
+            if (level == 0)
+                nextstate = eg_num_decay;
+            else if (eg_inc && !eg_ratemax && nkon)
+                inc = (~level << eg_inc) >> 5;
+            break;
+        case eg_num_decay:
+            if ((level >> 4) == (eg_sl << 1))
+                nextstate = eg_num_sustain;
+            else if (!eg_off && eg_inc)
+            {
+                inc = 1 << (eg_inc - 1);
+                if (chip->eg_ssg_enable[slot])
+                    inc <<= 2;
+            }
+            break;
+        case eg_num_sustain:
+        case eg_num_release:
+            if (!eg_off && eg_inc)
+            {
+                inc = 1 << (eg_inc - 1);
+                if (chip->eg_ssg_enable[slot])
+                    inc <<= 2;
+            }
+            break;
+        default:
+            break;
+        }
+        if (!nkon)
+            nextstate = eg_num_release;
+    }
+    if (chip->eg_kon_csm[slot])
+        nextlevel |= eg_tl << 3;
+
+    // Envelope off
+    if (!kon_event && !chip->eg_ssg_hold_up_latch[slot] && chip->eg_state[slot] != eg_num_attack && eg_off)
+    {
+        nextstate = eg_num_release;
+        nextlevel = 0x3ff;
+    }
+    nextlevel += inc;
+
+    chip->eg_kon[slot] = chip->eg_kon_latch[slot];
+    chip->eg_level[slot] = (Bit16u)nextlevel & 0x3ff;
+    chip->eg_state[slot] = nextstate;
+}
+
+/******************************************************************************
+ *
+ *   Batch Operator cycle
+ *   Channel output, accumulation, modulation and operator stages of one
+ *   cycle, in OPN2_Clock order. Adds the cycle's output to buf like
+ *   OPN2_Generate.
+ *
+ ******************************************************************************/
+static void batch_fm_cycle(ym3438_t *chip, Bit32u cycle, Bit32s *buf)
+{
+    Bit32u channel = cycle % 6;
+    Bit32u slot, prevslot, op, lock, mute, side;
+    Bit8u connect = chip->connect[channel];
+    Bit16s out, acc, add, sum, mod, mod1, mod2, output;
+    Bit16u phase, quarter, level;
+
+    // Channel output, Nuked leaves OPN2_SetChipType of ym3438.c at its read
+    // mode default (ym2612.h maps the name to _OPN2_SetChipType), so there
+    // is no ladder effect
+    lock = channel + (cycle < 12);
+    chip->ch_read = chip->ch_lock;
+    if ((cycle & 3) == 0)
+    {
+        chip->ch_lock = chip->ch_out[lock];
+        chip->ch_lock_l = chip->pan_l[lock];
+        chip->ch_lock_r = chip->pan_r[lock];
+    }
+    if ((cycle >> 2) == 1 && chip->dacen)
+    {
+        out = (Bit16s)chip->dacdata;
+        out <<= 7;
+        out >>= 7;
+    }
+    else
+        out = chip->ch_lock;
+    chip->mol = chip->ch_lock_l && (cycle & 3) ? out : 0;
+    chip->mor = chip->ch_lock_r && (cycle & 3) ? out : 0;
+    mute = (cycle >> 2) == 1 ? chip->mute[5 + chip->dacen] : chip->mute[batch_mute_channel[cycle >> 2]];
+    side = ((cycle >> 2) == 1 && chip->dacen) ? 2 : 0;
+    if (!mute)
+    {
+        buf[side] += chip->mol;
+        buf[side + 1] += chip->mor;
+    }
+
+    // Channel accumulation of the operator that left the pipeline last cycle
+    slot = (cycle + 18) % 24;
+    op = slot / 6;
+    acc = op == 0 ? 0 : chip->ch_acc[channel];
+    add = 0;
+    if (batch_fm_algorithm[op][5][connect])
+        add += chip->fm_out[slot] >> 5;
+    sum = acc + add;
+    if (sum > 255)
+        sum = 255;
+    else if (sum < -256)
+        sum = -256;
+    if (op == 0)
+        chip->ch_out[channel] = chip->ch_acc[channel];
+    chip->ch_acc[channel] = sum;
+
+    // Modulation input of the slot 6 cycles ahead
+    slot = (cycle + 6) % 24;
+    op = slot / 6;
+    prevslot = (cycle + 18) % 24;
+    mod1 = mod2 = 0;
+    if (batch_fm_algorithm[op][0][connect])
+        mod2 |= chip->fm_op1[channel][0];
+    if (batch_fm_algorithm[op][1][connect])
+        mod1 |= chip->fm_op1[channel][1];
+    if (batch_fm_algorithm[op][2][connect])
+        mod1 |= chip->fm_op2[channel];
+    if (batch_fm_algorithm[op][3][connect])
+        mod2 |= chip->fm_out[prevslot];
+    if (batch_fm_algorithm[op][4][connect])
+        mod1 |= chip->fm_out[prevslot];
+    mod = mod1 + mod2;
+    if (op == 0)
+    {
+        // Feedback
+        mod = mod >> (10 - chip->fb[channel]);
+        if (!chip->fb[channel])
+            mod = 0;
+    }
+    else
+        mod >>= 1;
+    chip->fm_mod[slot] = mod;
+    if (prevslot / 6 == 0)
+    {
+        chip->fm_op1[channel][1] = chip->fm_op1[channel][0];
+        chip->fm_op1[channel][0] = chip->fm_out[prevslot];
+    }
+    if (prevslot / 6 == 2)
+        chip->fm_op2[channel] = chip->fm_out[prevslot];
+
+    // Operator output
+    slot = (cycle + 19) % 24;
+    phase = (chip->fm_mod[slot] + (chip->pg_phase[slot] >> 10)) & 0x3ff;
+    if (phase & 0x100)
+        quarter = (phase ^ 0xff) & 0xff;
+    else
+        quarter = phase & 0xff;
+    level = batch_logsin[quarter];
+    level += chip->eg_out[slot] << 2;
+    if (level > 0x1fff)
+        level = 0x1fff;
+    output = ((batch_exp[(level & 0xff) ^ 0xff] | 0x400) << 2) >> (level >> 8);
+    if (phase & 0x200)
+        output = (~output) + 1;
+    output <<= 2;
+    output >>= 2;
+    chip->fm_out[slot] = output;
+}
+
+/******************************************************************************
+ *
+ *   YM2612 Batch generate
+ *   One native sample like OPN2_Generate. Slot s has its envelope rate
+ *   and SSG-EG latched on cycle s, envelope output and step on cycle s+1,
+ *   ADSR on cycle s+2, phase increment on cycle s and phase step on cycle
+ *   s+5 right after its operator output. Work of slots 19-23 that
+ *   wraps into the next sample runs first, from the pipeline registers
+ *   left in the chip.
+ *
+ ******************************************************************************/
+void ym2612_batch_generate(ym3438_t *chip, Bit32s *buf)
+{
+    Bit32u fnum[24];
+    Bit8u block[24], kcode[24];
+    Bit8u rate[24], ksv[24], inc[24], ratemax[24], lfo_am[24];
+    Bit32u slot, cycle;
+
+    if (!batch_ready(chip))
+    {
+        OPN2_Generate(chip, buf);
+        return;
+    }
+    buf[0] = buf[1] = buf[2] = buf[3] = 0;
+
+    // Frequency each slot sees, slot 0 was latched on the last cycle
+    fnum[0] = chip->pg_fnum;
+    block[0] = chip->pg_block;
+    kcode[0] = chip->pg_kcode;
+    for (slot = 1; slot < 24; slot++)
+        batch_pg_source(chip, slot, &fnum[slot], &block[slot], &kcode[slot]);
+
+    // Cycles 0 and 1 end the envelopes of slots 22 and 23
+    batch_eg_adsr(chip, 22, chip->eg_inc, chip->eg_ratemax, chip->eg_sl[1], chip->eg_tl[1]);
+    batch_eg_output(chip, 23, chip->eg_lfo_am, chip->eg_tl[0]);
+    inc[23] = batch_eg_increment(chip, chip->eg_rate, chip->eg_ksv, &ratemax[23]);
+    batch_eg_adsr(chip, 23, inc[23], ratemax[23], chip->eg_sl[0], chip->eg_tl[0]);
+
+    for (cycle = 0; cycle < 24; cycle++)
+        batch_control(chip, cycle);
+
+    // Cycles 0-4 output slots 19-23 and step their phase
+    for (cycle = 0; cycle < 5; cycle++)
+        batch_fm_cycle(chip, cycle, buf);
+    for (slot = 20; slot < 24; slot++)
+    {
+        if (chip->pg_reset[slot])
+            chip->pg_inc[slot] = 0;
+    }
+    for (slot = 19; slot < 24; slot++)
+        batch_pg_step(chip, slot);
+
+    // Envelope generator of this sample's slots, stage by stage
+    for (slot = 0; slot < 24; slot++)
+        batch_eg_ssg(chip, slot);
+    for (slot = 0; slot < 24; slot++)
+    {
+        rate[slot] = batch_eg_rate(chip, slot);
+        ksv[slot] = kcode[slot] >> (chip->ks[slot] ^ 0x03);
+        lfo_am[slot] = chip->am[slot] ? chip->lfo_am >> batch_eg_am_shift[chip->ams[slot % 6]] : 0;
+    }
+    for (slot = 0; slot < 23; slot++)
+        inc[slot] = batch_eg_increment(chip, rate[slot], ksv[slot], &ratemax[slot]);
+    for (slot = 0; slot < 23; slot++)
+        batch_eg_output(chip, slot, lfo_am[slot], chip->tl[slot]);
+    for (slot = 0; slot < 22; slot++)
+        batch_eg_adsr(chip, slot, inc[slot], ratemax[slot], chip->sl[slot], chip->tl[slot]);
+
+    // Cycles 5-23 output slots 0-18
+    for (cycle = 5; cycle < 24; cycle++)
+        batch_fm_cycle(chip, cycle, buf);
+
+    // Phase generator of this sample's slots
+    for (slot = 0; slot < 24; slot++)
+        batch_pg_increment(chip, slot, fnum[slot], block[slot], kcode[slot]);
+    for (slot = 0; slot < 20; slot++)
+    {
+        if (chip->pg_reset[slot])
+            chip->pg_inc[slot] = 0;
+    }
+    for (slot = 0; slot < 19; slot++)
+        batch_pg_step(chip, slot);
+
+    // Pipeline registers as Nuked leaves them after cycle 23
+    chip->eg_inc = inc[22];
+    chip->eg_ratemax = ratemax[22];
+    chip->eg_rate = rate[23];
+    chip->eg_ksv = ksv[23];
+    chip->eg_lfo_am = lfo_am[23];
+    chip->eg_tl[0] = chip->tl[23];
+    chip->eg_tl[1] = chip->tl[22];
+    chip->eg_sl[0] = chip->sl[23];
+    chip->eg_sl[1] = chip->sl[22];
+    chip->eg_read[0] = inc[20] > 0;
+    chip->eg_read_inc = inc[21] > 0;
+    chip->pg_fnum = chip->fnum[0];
+    chip->pg_block = chip->block[0];
+    chip->pg_kcode = chip->kcode[0];
+    chip->cycles = 0;
+    chip->channel = 0;
+    chip->writebuf_samplecnt += 24;
+}
@@ -0,0 +1,2 @@
+// Chip state is ym3438_t of ym2612.h
+void ym2612_batch_generate(ym3438_t *chip, Bit32s *buf);
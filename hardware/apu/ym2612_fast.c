@@ -0,0 +1,802 @@
+#include <string.h>
+#include "ym2612_fast.h"
+#include "hardware/system/state.h"
+
+/******************************************************************************
+ *
+ *   YM2612 fast FM core
+ *   Sample level, table driven FM synthesis behind the same register
+ *   interface as Nuked OPN2. One call generates one native sample
+ *   (master clock / 1008), scaled like the sum of the 24 OPN2_Clock
+ *   outputs so both cores can feed the same output path.
+ *   CSM key on and the test registers are not emulated.
+ *
+ ******************************************************************************/
+
+#define FM_ENV_QUIET 0x340  // Attenuation past which an operator outputs 0
+#define FM_MAX_ATT 0x3FF
+
+// Modulation buses of a channel, see fm_connect
+enum
+{
+    FM_M2 = 0,
+    FM_C1,
+    FM_C2,
+    FM_MEM,
+    FM_OUT
+};
+
+static ym2612_fast_t fm;
+
+// Define log-sin table, quarter wave, 4.8 fixed point attenuation
+static const unsigned short fm_logsin[256] = {
+    0x859, 0x6c3, 0x607, 0x58b, 0x52e, 0x4e4, 0x4a6, 0x471, 0x443, 0x41a, 0x3f5, 0x3d3, 0x3b5, 0x398, 0x37e, 0x365,
+    0x34e, 0x339, 0x324, 0x311, 0x2ff, 0x2ed, 0x2dc, 0x2cd, 0x2bd, 0x2af, 0x2a0, 0x293, 0x286, 0x279, 0x26d, 0x261,
+    0x256, 0x24b, 0x240, 0x236, 0x22c, 0x222, 0x218, 0x20f, 0x206, 0x1fd, 0x1f5, 0x1ec, 0x1e4, 0x1dc, 0x1d4, 0x1cd,
+    0x1c5, 0x1be, 0x1b7, 0x1b0, 0x1a9, 0x1a2, 0x19b, 0x195, 0x18f, 0x188, 0x182, 0x17c, 0x177, 0x171, 0x16b, 0x166,
+    0x160, 0x15b, 0x155, 0x150, 0x14b, 0x146, 0x141, 0x13c, 0x137, 0x133, 0x12e, 0x129, 0x125, 0x121, 0x11c, 0x118,
+    0x114, 0x10f, 0x10b, 0x107, 0x103, 0x0ff, 0x0fb, 0x0f8, 0x0f4, 0x0f0, 0x0ec, 0x0e9, 0x0e5, 0x0e2, 0x0de, 0x0db,
+    0x0d7, 0x0d4, 0x0d1, 0x0cd, 0x0ca, 0x0c7, 0x0c4, 0x0c1, 0x0be, 0x0bb, 0x0b8, 0x0b5, 0x0b2, 0x0af, 0x0ac, 0x0a9,
+    0x0a7, 0x0a4, 0x0a1, 0x09f, 0x09c, 0x099, 0x097, 0x094, 0x092, 0x08f, 0x08d, 0x08a, 0x088, 0x086, 0x083, 0x081,
+    0x07f, 0x07d, 0x07a, 0x078, 0x076, 0x074, 0x072, 0x070, 0x06e, 0x06c, 0x06a, 0x068, 0x066, 0x064, 0x062, 0x060,
+    0x05e, 0x05c, 0x05b, 0x059, 0x057, 0x055, 0x053, 0x052, 0x050, 0x04e, 0x04d, 0x04b, 0x04a, 0x048, 0x046, 0x045,
+    0x043, 0x042, 0x040, 0x03f, 0x03e, 0x03c, 0x03b, 0x039, 0x038, 0x037, 0x035, 0x034, 0x033, 0x031, 0x030, 0x02f,
+    0x02e, 0x02d, 0x02b, 0x02a, 0x029, 0x028, 0x027, 0x026, 0x025, 0x024, 0x023, 0x022, 0x021, 0x020, 0x01f, 0x01e,
+    0x01d, 0x01c, 0x01b, 0x01a, 0x019, 0x018, 0x017, 0x017, 0x016, 0x015, 0x014, 0x014, 0x013, 0x012, 0x011, 0x011,
+    0x010, 0x00f, 0x00f, 0x00e, 0x00d, 0x00d, 0x00c, 0x00c, 0x00b, 0x00a, 0x00a, 0x009, 0x009, 0x008, 0x008, 0x007,
+    0x007, 0x007, 0x006, 0x006, 0x005, 0x005, 0x005, 0x004, 0x004, 0x004, 0x003, 0x003, 0x003, 0x002, 0x002, 0x002,
+    0x002, 0x001, 0x001, 0x001, 0x001, 0x001, 0x001, 0x001, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000};
+
+// Define exponent table, fractional part of 2^x in 10 bits
+static const unsigned short fm_exp[256] = {
+    0x000, 0x003, 0x006, 0x008, 0x00b, 0x00e, 0x011, 0x014, 0x016, 0x019, 0x01c, 0x01f, 0x022, 0x025, 0x028, 0x02a,
+    0x02d, 0x030, 0x033, 0x036, 0x039, 0x03c, 0x03f, 0x042, 0x045, 0x048, 0x04b, 0x04e, 0x051, 0x054, 0x057, 0x05a,
+    0x05d, 0x060, 0x063, 0x066, 0x069, 0x06c, 0x06f, 0x072, 0x075, 0x078, 0x07b, 0x07e, 0x082, 0x085, 0x088, 0x08b,
+    0x08e, 0x091, 0x094, 0x098, 0x09b, 0x09e, 0x0a1, 0x0a4, 0x0a8, 0x0ab, 0x0ae, 0x0b1, 0x0b5, 0x0b8, 0x0bb, 0x0be,
+    0x0c2, 0x0c5, 0x0c8, 0x0cc, 0x0cf, 0x0d2, 0x0d6, 0x0d9, 0x0dc, 0x0e0, 0x0e3, 0x0e7, 0x0ea, 0x0ed, 0x0f1, 0x0f4,
+    0x0f8, 0x0fb, 0x0ff, 0x102, 0x106, 0x109, 0x10c, 0x110, 0x114, 0x117, 0x11b, 0x11e, 0x122, 0x125, 0x129, 0x12c,
+    0x130, 0x134, 0x137, 0x13b, 0x13e, 0x142, 0x146, 0x149, 0x14d, 0x151, 0x154, 0x158, 0x15c, 0x160, 0x163, 0x167,
+    0x16b, 0x16f, 0x172, 0x176, 0x17a, 0x17e, 0x181, 0x185, 0x189, 0x18d, 0x191, 0x195, 0x199, 0x19c, 0x1a0, 0x1a4,
+    0x1a8, 0x1ac, 0x1b0, 0x1b4, 0x1b8, 0x1bc, 0x1c0, 0x1c4, 0x1c8, 0x1cc, 0x1d0, 0x1d4, 0x1d8, 0x1dc, 0x1e0, 0x1e4,
+    0x1e8, 0x1ec, 0x1f0, 0x1f5, 0x1f9, 0x1fd, 0x201, 0x205, 0x209, 0x20e, 0x212, 0x216, 0x21a, 0x21e, 0x223, 0x227,
+    0x22b, 0x230, 0x234, 0x238, 0x23c, 0x241, 0x245, 0x249, 0x24e, 0x252, 0x257, 0x25b, 0x25f, 0x264, 0x268, 0x26d,
+    0x271, 0x276, 0x27a, 0x27f, 0x283, 0x288, 0x28c, 0x291, 0x295, 0x29a, 0x29e, 0x2a3, 0x2a8, 0x2ac, 0x2b1, 0x2b5,
+    0x2ba, 0x2bf, 0x2c4, 0x2c8, 0x2cd, 0x2d2, 0x2d6, 0x2db, 0x2e0, 0x2e5, 0x2e9, 0x2ee, 0x2f3, 0x2f8, 0x2fd, 0x302,
+    0x306, 0x30b, 0x310, 0x315, 0x31a, 0x31f, 0x324, 0x329, 0x32e, 0x333, 0x338, 0x33d, 0x342, 0x347, 0x34c, 0x351,
+    0x356, 0x35b, 0x360, 0x365, 0x36a, 0x370, 0x375, 0x37a, 0x37f, 0x384, 0x38a, 0x38f, 0x394, 0x399, 0x39f, 0x3a4,
+    0x3a9, 0x3ae, 0x3b4, 0x3b9, 0x3bf, 0x3c4, 0x3c9, 0x3cf, 0x3d4, 0x3da, 0x3df, 0x3e4, 0x3ea, 0x3ef, 0x3f5, 0x3fa};
+
+// Define envelope increments, 8 steps per rate row
+static const unsigned char fm_eg_inc[19 * 8] = {
+    0, 1, 0, 1, 0, 1, 0, 1,         // Rates 0-11, 0
+    0, 1, 0, 1, 1, 1, 0, 1,         // Rates 0-11, 1
+    0, 1, 1, 1, 0, 1, 1, 1,         // Rates 0-11, 2
+    0, 1, 1, 1, 1, 1, 1, 1,         // Rates 0-11, 3
+    1, 1, 1, 1, 1, 1, 1, 1,         // Rate 12, 0
+    1, 1, 1, 2, 1, 1, 1, 2,         // Rate 12, 1
+    1, 2, 1, 2, 1, 2, 1, 2,         // Rate 12, 2
+    1, 2, 2, 2, 1, 2, 2, 2,         // Rate 12, 3
+    2, 2, 2, 2, 2, 2, 2, 2,         // Rate 13, 0
+    2, 2, 2, 4, 2, 2, 2, 4,         // Rate 13, 1
+    2, 4, 2, 4, 2, 4, 2, 4,         // Rate 13, 2
+    2, 4, 4, 4, 2, 4, 4, 4,         // Rate 13, 3
+    4, 4, 4, 4, 4, 4, 4, 4,         // Rate 14, 0
+    4, 4, 4, 8, 4, 4, 4, 8,         // Rate 14, 1
+    4, 8, 4, 8, 4, 8, 4, 8,         // Rate 14, 2
+    4, 8, 8, 8, 4, 8, 8, 8,         // Rate 14, 3
+    8, 8, 8, 8, 8, 8, 8, 8,         // Rate 15
+    16, 16, 16, 16, 16, 16, 16, 16, // Rate 15, attack
+    0, 0, 0, 0, 0, 0, 0, 0          // Infinite
+};
+
+// Define envelope rate to fm_eg_inc row, 32 infinite rates, 64 rates, 32 clamped rates
+static const unsigned char fm_eg_rate_select[128] = {
+    144, 144, 144, 144, 144, 144, 144, 144, 144, 144, 144, 144, 144, 144, 144, 144,
+    144, 144, 144, 144, 144, 144, 144, 144, 144, 144, 144, 144, 144, 144, 144, 144,
+    0, 8, 16, 24, 0, 8, 16, 24, 0, 8, 16, 24, 0, 8, 16, 24,
+    0, 8, 16, 24, 0, 8, 16, 24, 0, 8, 16, 24, 0, 8, 16, 24,
+    0, 8, 16, 24, 0, 8, 16, 24, 0, 8, 16, 24, 0, 8, 16, 24,
+    32, 40, 48, 56, 64, 72, 80, 88, 96, 104, 112, 120, 128, 128, 128, 128,
+    128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128,
+    128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128, 128};
+
+// Define envelope rate to envelope counter shift
+static const unsigned char fm_eg_rate_shift[128] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    11, 11, 11, 11, 10, 10, 10, 10, 9, 9, 9, 9, 8, 8, 8, 8,
+    7, 7, 7, 7, 6, 6, 6, 6, 5, 5, 5, 5, 4, 4, 4, 4,
+    3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+// Define key code note from the 4 upper fnum bits
+static const unsigned char fm_fn_note[16] = {0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 3, 3, 3, 3, 3, 3};
+
+// Define detune base values
+static const unsigned char fm_detune[8] = {16, 17, 19, 20, 22, 24, 27, 29};
+
+// Define LFO phase modulation shifts by PMS and LFO step
+static const unsigned char fm_lfo_sh1[8][8] = {
+    {7, 7, 7, 7, 7, 7, 7, 7},
+    {7, 7, 7, 7, 7, 7, 7, 7},
+    {7, 7, 7, 7, 7, 7, 1, 1},
+    {7, 7, 7, 7, 1, 1, 1, 1},
+    {7, 7, 7, 1, 1, 1, 1, 0},
+    {7, 7, 1, 1, 0, 0, 0, 0},
+    {7, 7, 1, 1, 0, 0, 0, 0},
+    {7, 7, 1, 1, 0, 0, 0, 0}};
+static const unsigned char fm_lfo_sh2[8][8] = {
+    {7, 7, 7, 7, 7, 7, 7, 7},
+    {7, 7, 7, 7, 2, 2, 2, 2},
+    {7, 7, 7, 2, 2, 2, 7, 7},
+    {7, 7, 2, 2, 7, 7, 2, 2},
+    {7, 7, 2, 7, 7, 7, 2, 7},
+    {7, 7, 7, 2, 7, 7, 2, 1},
+    {7, 7, 7, 2, 7, 7, 2, 1},
+    {7, 7, 7, 2, 7, 7, 2, 1}};
+
+// Define samples per LFO step
+static const unsigned char fm_lfo_period[8] = {109, 78, 72, 68, 63, 45, 9, 6};
+
+// Define LFO amplitude modulation shift by AMS
+static const unsigned char fm_am_shift[4] = {7, 3, 1, 0};
+
+// Define algorithm routing: S1, S2 and S3 outputs, delayed sample restore
+static const signed char fm_connect[8][4] = {
+    {FM_C1, FM_MEM, FM_C2, FM_M2},    // S1-S2-S3-S4
+    {FM_MEM, FM_MEM, FM_C2, FM_M2},   // (S1+S2)-S3-S4
+    {FM_C2, FM_MEM, FM_C2, FM_M2},    // (S1+(S2-S3))-S4
+    {FM_C1, FM_MEM, FM_C2, FM_C2},    // ((S1-S2)+S3)-S4
+    {FM_C1, FM_OUT, FM_C2, FM_MEM},   // (S1-S2)+(S3-S4)
+    {-1, FM_OUT, FM_OUT, FM_M2},      // S1-(S2+S3+S4)
+    {FM_C1, FM_OUT, FM_OUT, FM_MEM},  // (S1-S2)+S3+S4
+    {FM_OUT, FM_OUT, FM_OUT, FM_MEM}  // S1+S2+S3+S4
+};
+
+/******************************************************************************
+ *
+ *   FM phase increment
+ *   Compute a slot phase increment from fnum/block, detune, multiplier
+ *   and LFO phase modulation
+ *
+ ******************************************************************************/
+static unsigned int fm_phase_inc(fm_slot *slot, unsigned int fnum, unsigned int block, unsigned int pms, unsigned int lfo_pm)
+{
+    unsigned int kcode = (block << 2) | fm_fn_note[fnum >> 7];
+    unsigned int fnum_h = fnum >> 4;
+    unsigned int lfo_l = lfo_pm & 0x0F;
+    unsigned int basefreq, detune = 0, fm_pm, sum;
+
+    fnum <<= 1;
+    if (pms)
+    {
+        if (lfo_l & 0x08)
+            lfo_l ^= 0x0F;
+        fm_pm = (fnum_h >> fm_lfo_sh1[pms][lfo_l]) + (fnum_h >> fm_lfo_sh2[pms][lfo_l]);
+        if (pms > 5)
+            fm_pm <<= pms - 5;
+        fm_pm >>= 2;
+        if (lfo_pm & 0x10)
+            fnum -= fm_pm;
+        else
+            fnum += fm_pm;
+        fnum &= 0xFFF;
+    }
+    basefreq = (fnum << block) >> 2;
+
+    if (slot->dt & 0x03)
+    {
+        if (kcode > 0x1C)
+            kcode = 0x1C;
+        sum = (kcode >> 2) + 9 + (((slot->dt & 0x03) == 3) | (slot->dt & 0x02));
+        detune = fm_detune[((sum & 1) << 2) | (kcode & 0x03)] >> (9 - (sum >> 1));
+    }
+    if (slot->dt & 0x04)
+        basefreq -= detune;
+    else
+        basefreq += detune;
+    basefreq &= 0x1FFFF;
+    return ((basefreq * slot->mul) >> 1) & 0xFFFFF;
+}
+
+/******************************************************************************
+ *
+ *   FM slot frequency
+ *   Get fnum and block of a slot, channel 3 special mode gives each
+ *   of S1, S2 and S3 its own frequency
+ *
+ ******************************************************************************/
+static void fm_slot_frequency(unsigned int channel, unsigned int slot, unsigned int *fnum, unsigned int *block)
+{
+    // Register order S1, S3, S2 maps to 0xA9, 0xA8, 0xAA
+    static const unsigned char fm_3ch_index[3] = {1, 0, 2};
+
+    if (channel == 2 && fm.mode_ch3 && slot < 3)
+    {
+        *fnum = fm.fnum_3ch[fm_3ch_index[slot]];
+        *block = fm.block_3ch[fm_3ch_index[slot]];
+        return;
+    }
+    *fnum = fm.channel[channel].fnum;
+    *block = fm.channel[channel].block;
+}
+
+/******************************************************************************
+ *
+ *   FM envelope output
+ *   Apply SSG-EG inversion and total level to the envelope attenuation
+ *
+ ******************************************************************************/
+static void fm_eg_output(fm_slot *slot)
+{
+    if ((slot->ssg & 0x08) && (slot->ssg_inv ^ (slot->ssg & 0x04)))
+        slot->vol_out = ((0x200 - slot->volume) & FM_MAX_ATT) + slot->tl;
+    else
+        slot->vol_out = slot->volume + slot->tl;
+}
+
+/******************************************************************************
+ *
+ *   FM channel refresh
+ *   Recompute key scaled envelope rates and phase increments after a
+ *   frequency, detune, multiplier or rate register write
+ *
+ ******************************************************************************/
+static void fm_channel_refresh(unsigned int channel)
+{
+    fm_slot *slot;
+    unsigned int i, fnum, block, kcode;
+
+    for (i = 0; i < FM_SLOTS; i++)
+    {
+        slot = &fm.channel[channel].slot[i];
+        fm_slot_frequency(channel, i, &fnum, &block);
+        kcode = (block << 2) | fm_fn_note[fnum >> 7];
+        slot->ksr = kcode >> (3 - slot->ks);
+        slot->inc = fm_phase_inc(slot, fnum, block, 0, 0);
+
+        if (slot->ar + slot->ksr < 32 + 62)
+        {
+            slot->eg_sh_ar = fm_eg_rate_shift[slot->ar + slot->ksr];
+            slot->eg_sel_ar = fm_eg_rate_select[slot->ar + slot->ksr];
+        }
+        else
+        {
+            slot->eg_sh_ar = 0;
+            slot->eg_sel_ar = 17 * 8;
+        }
+        slot->eg_sh_d1r = fm_eg_rate_shift[slot->d1r + slot->ksr];
+        slot->eg_sel_d1r = fm_eg_rate_select[slot->d1r + slot->ksr];
+        slot->eg_sh_d2r = fm_eg_rate_shift[slot->d2r + slot->ksr];
+        slot->eg_sel_d2r = fm_eg_rate_select[slot->d2r + slot->ksr];
+        slot->eg_sh_rr = fm_eg_rate_shift[slot->rr + slot->ksr];
+        slot->eg_sel_rr = fm_eg_rate_select[slot->rr + slot->ksr];
+    }
+}
+
+/******************************************************************************
+ *
+ *   FM key on / key off
+ *
+ ******************************************************************************/
+static void fm_key_on(fm_slot *slot)
+{
+    if (slot->key)
+        return;
+    slot->key = 1;
+    slot->phase = 0;
+    slot->ssg_inv = 0;
+    if (slot->ar + slot->ksr < 32 + 62)
+    {
+        if (slot->volume <= 0)
+            slot->state = slot->sl ? fm_eg_decay : fm_eg_sustain;
+        else
+            slot->state = fm_eg_attack;
+    }
+    else
+    {
+        slot->volume = 0;
+        slot->state = slot->sl ? fm_eg_decay : fm_eg_sustain;
+    }
+    fm_eg_output(slot);
+}
+
+static void fm_key_off(fm_slot *slot)
+{
+    if (!slot->key)
+        return;
+    slot->key = 0;
+    if (slot->state <= fm_eg_release)
+        return;
+    slot->state = fm_eg_release;
+    if (slot->ssg & 0x08)
+    {
+        if (slot->ssg_inv ^ (slot->ssg & 0x04))
+            slot->volume = 0x200 - slot->volume;
+        if (slot->volume >= 0x200)
+        {
+            slot->volume = FM_MAX_ATT;
+            slot->state = fm_eg_off;
+        }
+        slot->vol_out = slot->volume + slot->tl;
+    }
+}
+
+/******************************************************************************
+ *
+ *   FM envelope step
+ *   Advance one slot envelope on an envelope counter tick
+ *
+ ******************************************************************************/
+static void fm_eg_step(fm_slot *slot, unsigned int cnt)
+{
+    unsigned int inc;
+
+    switch (slot->state)
+    {
+    case fm_eg_attack:
+        if (cnt & ((1 << slot->eg_sh_ar) - 1))
+            break;
+        inc = fm_eg_inc[slot->eg_sel_ar + ((cnt >> slot->eg_sh_ar) & 7)];
+        slot->volume += (~slot->volume * (int)inc) >> 4;
+        if (slot->volume <= 0)
+        {
+            slot->volume = 0;
+            slot->state = slot->sl ? fm_eg_decay : fm_eg_sustain;
+        }
+        fm_eg_output(slot);
+        break;
+    case fm_eg_decay:
+        if (cnt & ((1 << slot->eg_sh_d1r) - 1))
+            break;
+        inc = fm_eg_inc[slot->eg_sel_d1r + ((cnt >> slot->eg_sh_d1r) & 7)];
+        if (!(slot->ssg & 0x08))
+            slot->volume += inc;
+        else if (slot->volume < 0x200)
+            slot->volume += 4 * inc;
+        fm_eg_output(slot);
+        if (slot->volume >= (int)slot->sl)
+            slot->state = fm_eg_sustain;
+        break;
+    case fm_eg_sustain:
+        if (cnt & ((1 << slot->eg_sh_d2r) - 1))
+            break;
+        inc = fm_eg_inc[slot->eg_sel_d2r + ((cnt >> slot->eg_sh_d2r) & 7)];
+        if (!(slot->ssg & 0x08))
+        {
+            slot->volume += inc;
+            if (slot->volume >= FM_MAX_ATT)
+                slot->volume = FM_MAX_ATT;
+        }
+        else if (slot->volume < 0x200)
+            slot->volume += 4 * inc;
+        fm_eg_output(slot);
+        break;
+    case fm_eg_release:
+        if (cnt & ((1 << slot->eg_sh_rr) - 1))
+            break;
+        inc = fm_eg_inc[slot->eg_sel_rr + ((cnt >> slot->eg_sh_rr) & 7)];
+        if (!(slot->ssg & 0x08))
+        {
+            slot->volume += inc;
+            if (slot->volume >= FM_MAX_ATT)
+            {
+                slot->volume = FM_MAX_ATT;
+                slot->state = fm_eg_off;
+            }
+        }
+        else
+        {
+            if (slot->volume < 0x200)
+                slot->volume += 4 * inc;
+            if (slot->volume >= 0x200)
+            {
+                slot->volume = FM_MAX_ATT;
+                slot->state = fm_eg_off;
+            }
+        }
+        slot->vol_out = slot->volume + slot->tl;
+        break;
+    }
+}
+
+/******************************************************************************
+ *
+ *   FM SSG-EG update
+ *   Handle hold, alternate and repeat once the attenuation crosses 0x200
+ *
+ ******************************************************************************/
+static void fm_ssg_update(fm_slot *slot)
+{
+    if (!(slot->ssg & 0x08) || slot->volume < 0x200 || slot->state <= fm_eg_release)
+        return;
+    if (slot->ssg & 0x01)
+    {
+        // Hold
+        if (slot->ssg & 0x02)
+            slot->ssg_inv = 4;
+        if (slot->state != fm_eg_attack && !(slot->ssg_inv ^ (slot->ssg & 0x04)))
+            slot->volume = FM_MAX_ATT;
+    }
+    else
+    {
+        // Repeat, alternate toggles the inversion instead of resetting the phase
+        if (slot->ssg & 0x02)
+            slot->ssg_inv ^= 4;
+        else
+            slot->phase = 0;
+        if (slot->state != fm_eg_attack)
+        {
+            if (slot->ar + slot->ksr < 32 + 62)
+                slot->state = fm_eg_attack;
+            else
+            {
+                slot->volume = 0;
+                slot->state = slot->sl ? fm_eg_decay : fm_eg_sustain;
+            }
+        }
+    }
+    fm_eg_output(slot);
+}
+
+/******************************************************************************
+ *
+ *   FM operator
+ *   Look up log-sin attenuation, add envelope and convert back through
+ *   the exponent table. Returns a 14 bit signed operator output.
+ *
+ ******************************************************************************/
+static inline int fm_op(fm_slot *slot, int mod, unsigned int am)
+{
+    unsigned int env = slot->vol_out + (slot->am ? am : 0);
+    unsigned int index, level;
+    int output;
+
+    if (env >= FM_ENV_QUIET)
+        return 0;
+    index = ((slot->phase >> 10) + mod) & 0x3FF;
+    level = fm_logsin[(index & 0x100) ? (~index & 0xFF) : (index & 0xFF)] + (env << 2);
+    output = ((fm_exp[(level & 0xFF) ^ 0xFF] | 0x400) << 2) >> (level >> 8);
+    return (index & 0x200) ? -output : output;
+}
+
+static inline void fm_route(int *bus, int to, int value)
+{
+    // Carriers are summed at 9 bits like the chip accumulator
+    bus[to] += to == FM_OUT ? value >> 5 : value;
+}
+
+/******************************************************************************
+ *
+ *   FM channel output
+ *   Run the four operators of a channel in chip order S1, S3, S2, S4,
+ *   advance their phases and return the clamped 9 bit channel output
+ *
+ ******************************************************************************/
+static int fm_channel_output(unsigned int index, unsigned int lfo_am, unsigned int lfo_pm)
+{
+    fm_channel *ch = &fm.channel[index];
+    const signed char *route = fm_connect[ch->algorithm];
+    unsigned int am = lfo_am >> fm_am_shift[ch->ams];
+    unsigned int i, fnum, block;
+    int bus[5] = {0, 0, 0, 0, 0};
+    int feedback;
+
+    bus[route[3]] = ch->mem_value;
+
+    // S1 with self feedback, its output is used one sample late
+    feedback = ch->op1_out[0] + ch->op1_out[1];
+    ch->op1_out[0] = ch->op1_out[1];
+    if (route[0] < 0)
+        bus[FM_MEM] = bus[FM_C1] = bus[FM_C2] = ch->op1_out[0];
+    else
+        fm_route(bus, route[0], ch->op1_out[0]);
+    ch->op1_out[1] = fm_op(&ch->slot[0], ch->feedback ? feedback >> (10 - ch->feedback) : 0, am);
+
+    fm_route(bus, route[2], fm_op(&ch->slot[1], bus[FM_M2] >> 1, am));
+    fm_route(bus, route[1], fm_op(&ch->slot[2], bus[FM_C1] >> 1, am));
+    fm_route(bus, FM_OUT, fm_op(&ch->slot[3], bus[FM_C2] >> 1, am));
+    ch->mem_value = bus[FM_MEM];
+
+    if (ch->pms && fm.lfo_en)
+    {
+        for (i = 0; i < FM_SLOTS; i++)
+        {
+            fm_slot_frequency(index, i, &fnum, &block);
+            ch->slot[i].phase += fm_phase_inc(&ch->slot[i], fnum, block, ch->pms, lfo_pm);
+            ch->slot[i].phase &= 0xFFFFF;
+        }
+    }
+    else
+    {
+        for (i = 0; i < FM_SLOTS; i++)
+            ch->slot[i].phase = (ch->slot[i].phase + ch->slot[i].inc) & 0xFFFFF;
+    }
+
+    if (bus[FM_OUT] > 255)
+        return 255;
+    if (bus[FM_OUT] < -256)
+        return -256;
+    return bus[FM_OUT];
+}
+
+/******************************************************************************
+ *
+ *   FM register write
+ *
+ ******************************************************************************/
+static void fm_write_register(unsigned int address, unsigned int value)
+{
+    unsigned int bank = address >> 8;
+    unsigned int reg = address & 0xFF;
+    unsigned int index;
+    fm_channel *ch;
+    fm_slot *slot;
+
+    if (reg < 0x30)
+    {
+        if (bank)
+            return;
+        switch (reg)
+        {
+        case 0x22: // LFO
+            fm.lfo_en = (value >> 3) & 1;
+            fm.lfo_freq = value & 0x07;
+            if (!fm.lfo_en)
+            {
+                fm.lfo_cnt = 0;
+                fm.lfo_timer = 0;
+            }
+            break;
+        case 0x27: // Channel 3 mode, timers are handled by ym2612.c
+            fm.mode_ch3 = (value >> 6) != 0;
+            fm_channel_refresh(2);
+            break;
+        case 0x28: // Key on/off
+            index = value & 0x03;
+            if (index == 3)
+                break;
+            ch = &fm.channel[index + ((value & 0x04) ? 3 : 0)];
+            (value & 0x10) ? fm_key_on(&ch->slot[0]) : fm_key_off(&ch->slot[0]);
+            (value & 0x20) ? fm_key_on(&ch->slot[2]) : fm_key_off(&ch->slot[2]);
+            (value & 0x40) ? fm_key_on(&ch->slot[1]) : fm_key_off(&ch->slot[1]);
+            (value & 0x80) ? fm_key_on(&ch->slot[3]) : fm_key_off(&ch->slot[3]);
+            break;
+        case 0x2A: // DAC data
+            fm.dacdata = ((int)value - 0x80) * 2;
+            break;
+        case 0x2B: // DAC enable
+            fm.dacen = value >> 7;
+            break;
+        }
+        return;
+    }
+
+    index = reg & 0x03;
+    if (index == 3)
+        return;
+    index += bank * 3;
+    ch = &fm.channel[index];
+    slot = &ch->slot[(reg >> 2) & 0x03];
+
+    switch (reg & 0xF0)
+    {
+    case 0x30: // DT, MUL
+        slot->dt = (value >> 4) & 0x07;
+        slot->mul = (value & 0x0F) ? (value & 0x0F) << 1 : 1;
+        fm_channel_refresh(index);
+        return;
+    case 0x40: // TL
+        slot->tl = (value & 0x7F) << 3;
+        fm_eg_output(slot);
+        return;
+    case 0x50: // KS, AR
+        slot->ks = value >> 6;
+        slot->ar = (value & 0x1F) ? 32 + ((value & 0x1F) << 1) : 0;
+        fm_channel_refresh(index);
+        return;
+    case 0x60: // AM, D1R
+        slot->am = value >> 7;
+        slot->d1r = (value & 0x1F) ? 32 + ((value & 0x1F) << 1) : 0;
+        fm_channel_refresh(index);
+        return;
+    case 0x70: // D2R
+        slot->d2r = (value & 0x1F) ? 32 + ((value & 0x1F) << 1) : 0;
+        fm_channel_refresh(index);
+        return;
+    case 0x80: // SL, RR
+        slot->sl = ((value >> 4) == 0x0F ? 0x1F : (value >> 4)) << 5;
+        slot->rr = 34 + ((value & 0x0F) << 2);
+        fm_channel_refresh(index);
+        return;
+    case 0x90: // SSG-EG
+        slot->ssg = value & 0x0F;
+        fm_eg_output(slot);
+        return;
+    }
+
+    switch (reg & 0xFC)
+    {
+    case 0xA0: // Fnum LSB, latches block and fnum MSB
+        ch->fnum = ((fm.fnum_latch & 0x07) << 8) | value;
+        ch->block = (fm.fnum_latch >> 3) & 0x07;
+        fm_channel_refresh(index);
+        break;
+    case 0xA4: // Block, fnum MSB
+        fm.fnum_latch = value & 0x3F;
+        break;
+    case 0xA8: // Channel 3 special mode fnum LSB
+        if (bank)
+            break;
+        fm.fnum_3ch[index] = ((fm.fnum_3ch_latch & 0x07) << 8) | value;
+        fm.block_3ch[index] = (fm.fnum_3ch_latch >> 3) & 0x07;
+        fm_channel_refresh(2);
+        break;
+    case 0xAC: // Channel 3 special mode block, fnum MSB
+        if (!bank)
+            fm.fnum_3ch_latch = value & 0x3F;
+        break;
+    case 0xB0: // Feedback, algorithm
+        ch->feedback = (value >> 3) & 0x07;
+        ch->algorithm = value & 0x07;
+        break;
+    case 0xB4: // Panning, AMS, PMS
+        ch->pan_l = value >> 7;
+        ch->pan_r = (value >> 6) & 1;
+        ch->ams = (value >> 4) & 0x03;
+        ch->pms = value & 0x07;
+        break;
+    }
+}
+
+/******************************************************************************
+ *
+ *   YM2612 fast core reset
+ *
+ ******************************************************************************/
+void ym2612_fast_reset()
+{
+    unsigned int i, j, ladder = fm.ladder, mute = fm.mute;
+    fm_slot *slot;
+
+    memset(&fm, 0, sizeof(ym2612_fast_t));
+    fm.ladder = ladder;
+    fm.mute = mute;
+    fm.eg_cnt = 1;
+    for (i = 0; i < FM_CHANNELS; i++)
+    {
+        fm.channel[i].pan_l = 1;
+        fm.channel[i].pan_r = 1;
+        for (j = 0; j < FM_SLOTS; j++)
+        {
+            slot = &fm.channel[i].slot[j];
+            slot->mul = 1;
+            slot->rr = 34;
+            slot->volume = FM_MAX_ATT;
+            slot->vol_out = FM_MAX_ATT;
+            slot->state = fm_eg_off;
+        }
+        fm_channel_refresh(i);
+    }
+}
+
+/******************************************************************************
+ *
+ *   YM2612 fast core write
+ *   Even ports latch the register address, odd ports write data
+ *
+ ******************************************************************************/
+void ym2612_fast_write(unsigned int port, unsigned int value)
+{
+    value &= 0xFF;
+    if (port & 1)
+        fm_write_register(fm.address, value);
+    else
+        fm.address = ((port & 2) << 7) | value;
+}
+
+/******************************************************************************
+ *
+ *   YM2612 fast core generate
+ *   Generate one native stereo sample, FM channels in buffer[0..1]
+ *   and channel 6 in buffer[2..3] while it plays the DAC
+ *
+ ******************************************************************************/
+void ym2612_fast_generate(short *buffer)
+{
+    unsigned int i, j, lfo_am;
+    int mix[4] = {0, 0, 0, 0}, *side, out, sign, on;
+    fm_channel *ch;
+
+    if (fm.lfo_en && ++fm.lfo_timer >= fm_lfo_period[fm.lfo_freq])
+    {
+        fm.lfo_timer = 0;
+        fm.lfo_cnt = (fm.lfo_cnt + 1) & 0x7F;
+    }
+    lfo_am = ((fm.lfo_cnt & 0x40) ? (fm.lfo_cnt & 0x3F) : (fm.lfo_cnt ^ 0x3F)) << 1;
+
+    // Envelopes are clocked every third sample
+    if (++fm.eg_timer == 3)
+    {
+        fm.eg_timer = 0;
+        fm.eg_cnt = (fm.eg_cnt + 1) & 0xFFF;
+        if (!fm.eg_cnt)
+            fm.eg_cnt = 1;
+        for (i = 0; i < FM_CHANNELS; i++)
+            for (j = 0; j < FM_SLOTS; j++)
+                fm_eg_step(&fm.channel[i].slot[j], fm.eg_cnt);
+    }
+
+    for (i = 0; i < FM_CHANNELS; i++)
+    {
+        ch = &fm.channel[i];
+        for (j = 0; j < FM_SLOTS; j++)
+            fm_ssg_update(&ch->slot[j]);
+        out = fm_channel_output(i, lfo_am, fm.lfo_cnt >> 2);
+        if (i == 5 && fm.dacen)
+            out = fm.dacdata;
+        ch->out = out;
+        if ((fm.mute >> (i == 5 ? 5 + fm.dacen : i)) & 1)
+            continue;
+        side = (i == 5 && fm.dacen) ? &mix[2] : mix;
+        if (fm.ladder)
+        {
+            // YM2612 DAC: one pulse of the value plus three of the sign
+            sign = out >= 0 ? 1 : -1;
+            on = out + (out >= 0);
+            side[0] += 3 * ((ch->pan_l ? on : sign) + 3 * sign);
+            side[1] += 3 * ((ch->pan_r ? on : sign) + 3 * sign);
+        }
+        else
+        {
+            side[0] += ch->pan_l ? 3 * out : 0;
+            side[1] += ch->pan_r ? 3 * out : 0;
+        }
+    }
+    for (i = 0; i < 4; i++)
+        buffer[i] = mix[i];
+}
+
+/******************************************************************************
+ *
+ *   YM2612 fast core silent
+ *   Every slot has finished its release and the DAC is off, the output
+ *   stays at its idle level until the next register write
+ *
+ ******************************************************************************/
+int ym2612_fast_silent()
+{
+    unsigned int i, j;
+    if (fm.dacen)
+        return 0;
+    for (i = 0; i < FM_CHANNELS; i++)
+        for (j = 0; j < FM_SLOTS; j++)
+            if (fm.channel[i].slot[j].state != fm_eg_off)
+                return 0;
+    return 1;
+}
+
+void ym2612_fast_set_ladder(int enable)
+{
+    fm.ladder = enable;
+}
+
+void ym2612_fast_set_mute(unsigned int mute)
+{
+    fm.mute = mute;
+}
+
+/******************************************************************************
+ *
+ *   Fast core state
+ *   Hand out the chip for state_save
+ *
+ ******************************************************************************/
+unsigned int ym2612_fast_state_blocks(state_block *blocks)
+{
+    blocks[0].data = &fm;
+    blocks[0].size = sizeof(fm);
+    return 1;
+}
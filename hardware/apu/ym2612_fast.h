@@ -0,0 +1,83 @@
+#define FM_SLOTS 4
+#define FM_CHANNELS 6
+
+enum
+{
+    fm_eg_off = 0,
+    fm_eg_release,
+    fm_eg_sustain,
+    fm_eg_decay,
+    fm_eg_attack
+};
+
+typedef struct _fm_slot
+{
+    /* Registers */
+    unsigned char dt;
+    unsigned char mul;     // Multiplier x2, 1 for MUL=0
+    unsigned char ks;
+    unsigned char am;
+    unsigned char ssg;
+    unsigned char ksr;     // Rate scaling from the key code
+    unsigned int tl;       // Total level in envelope units
+    unsigned int sl;       // Sustain level in envelope units
+    unsigned int ar, d1r, d2r, rr;
+    /* Phase generator */
+    unsigned int phase;    // 20 bit accumulator, sine index in bits 10-19
+    unsigned int inc;
+    /* Envelope generator */
+    unsigned char key;
+    unsigned char state;
+    unsigned char ssg_inv;
+    int volume;            // 10 bit attenuation
+    unsigned int vol_out;  // Attenuation with total level applied
+    unsigned char eg_sh_ar, eg_sel_ar;
+    unsigned char eg_sh_d1r, eg_sel_d1r;
+    unsigned char eg_sh_d2r, eg_sel_d2r;
+    unsigned char eg_sh_rr, eg_sel_rr;
+} fm_slot;
+
+typedef struct _fm_channel
+{
+    fm_slot slot[FM_SLOTS];  // Register order: S1, S3, S2, S4
+    unsigned int fnum;
+    unsigned int block;
+    unsigned char algorithm;
+    unsigned char feedback;
+    unsigned char pan_l, pan_r;
+    unsigned char ams, pms;
+    int op1_out[2];
+    int mem_value;
+    int out;
+} fm_channel;
+
+typedef struct _ym2612_fast_t
+{
+    fm_channel channel[FM_CHANNELS];
+    unsigned int address;
+    unsigned char fnum_latch;
+    unsigned char fnum_3ch_latch;
+    unsigned int fnum_3ch[3];
+    unsigned int block_3ch[3];
+    unsigned char mode_ch3;
+    unsigned char lfo_en;
+    unsigned char lfo_freq;
+    unsigned int lfo_cnt;
+    unsigned int lfo_timer;
+    unsigned int eg_cnt;
+    unsigned int eg_timer;
+    unsigned char dacen;
+    int dacdata;
+    unsigned char ladder;
+    unsigned int mute;
+} ym2612_fast_t;
+
+void ym2612_fast_reset();
+void ym2612_fast_write(unsigned int port, unsigned int value);
+void ym2612_fast_generate(short *buffer);
+int ym2612_fast_silent();
+void ym2612_fast_set_ladder(int enable);
+void ym2612_fast_set_mute(unsigned int mute);
+// Blocks are state_block of hardware/system/state.h
+struct _state_block;
+unsigned int ym2612_fast_state_blocks(struct _state_block *blocks);
@@ -1,6 +1,12 @@
 #include <libs/Z80/Z80.h>
 #include "z80.h"
 #include "hardware/bus/sega3155308.h"
+#include "hardware/apu/sn76489.h"
+#include "hardware/debug/disasm.h"
+#include "hardware/debug/watchpoint.h"
+#include "hardware/debug/profiler.h"
+#include "hardware/debug/timing.h"
+#include "hardware/system/state.h"
 
 #define M68K_FREQ_DIVISOR   7
 #define Z80_FREQ_DIVISOR    14
@@ -9,12 +15,34 @@ int bus_ack = 0;
 int reset = 0;
 int zclk = 0;
 int initialized = 0;
+// Master clock reached by the Z80 and cycles of the running timeslice
+unsigned long long z80_clock = 0;
+int z80_slice = 0;
+int z80_running = 0;
 
 unsigned char *Z80_RAM;
 static Z80 cpu;
+// Write generations of the disassembly cache
+extern unsigned int disasm_z80_pages[DISASM_Z80_PAGES];
+// Watched pages, only accesses of the Z80 itself are checked
+extern unsigned char watchpoint_pages[WATCHPOINT_PAGES / 8];
+extern int profiler_running;
 
 void ResetZ80(register Z80 *R);
 
+/******************************************************************************
+ * 
+ *   Z80 Disassembler read
+ *   Z80 RAM as the Z80 sees it, without bus side effects or watchpoints.
+ *   The YM2612, PSG, VDP and banked 68K space read as open bus.
+ * 
+ ******************************************************************************/
+unsigned int z80_read_disassembler_8(unsigned int address)
+{
+    address &= 0xFFFF;
+    return address < 0x4000 ? Z80_RAM[address] : 0xFF;
+}
+
 /** DAsm() ***************************************************/
 /** DAsm() will disassemble the code at adress A and put    **/
 /** the output text into S. It will return the number of    **/
@@ -32,27 +60,27 @@ int DAsm(char *S,word A)
   C='\0';
   J=0;
 
-  switch(RdZ80(B))
+  switch(z80_read_disassembler_8(B))
   {
-    case 0xCB: B++;T=MnemonicsCB[RdZ80(B++)];break;
-    case 0xED: B++;T=MnemonicsED[RdZ80(B++)];break;
+    case 0xCB: B++;T=MnemonicsCB[z80_read_disassembler_8(B++)];break;
+    case 0xED: B++;T=MnemonicsED[z80_read_disassembler_8(B++)];break;
     case 0xDD: B++;C='X';
-               if(RdZ80(B)!=0xCB) T=MnemonicsXX[RdZ80(B++)];
+               if(z80_read_disassembler_8(B)!=0xCB) T=MnemonicsXX[z80_read_disassembler_8(B++)];
                else
-               { B++;Offset=RdZ80(B++);J=1;T=MnemonicsXCB[RdZ80(B++)]; }
+               { B++;Offset=z80_read_disassembler_8(B++);J=1;T=MnemonicsXCB[z80_read_disassembler_8(B++)]; }
                break;
     case 0xFD: B++;C='Y';
-               if(RdZ80(B)!=0xCB) T=MnemonicsXX[RdZ80(B++)];
+               if(z80_read_disassembler_8(B)!=0xCB) T=MnemonicsXX[z80_read_disassembler_8(B++)];
                else
-               { B++;Offset=RdZ80(B++);J=1;T=MnemonicsXCB[RdZ80(B++)]; }
+               { B++;Offset=z80_read_disassembler_8(B++);J=1;T=MnemonicsXCB[z80_read_disassembler_8(B++)]; }
                break;
-    default:   T=Mnemonics[RdZ80(B++)];
+    default:   T=Mnemonics[z80_read_disassembler_8(B++)];
   }
 
   if(P=strchr(T,'^'))
   {
     strncpy(R,T,P-T);R[P-T]='\0';
-    sprintf(H,"%02X",RdZ80(B++));
+    sprintf(H,"%02X",z80_read_disassembler_8(B++));
     strcat(R,H);strcat(R,P+1);
   }
   else strcpy(R,T);
@@ -61,14 +89,14 @@ int DAsm(char *S,word A)
   if(P=strchr(R,'*'))
   {
     strncpy(S,R,P-R);S[P-R]='\0';
-    sprintf(H,"%02X",RdZ80(B++));
+    sprintf(H,"%02X",z80_read_disassembler_8(B++));
     strcat(S,H);strcat(S,P+1);
   }
   else
     if(P=strchr(R,'@'))
     {
       strncpy(S,R,P-R);S[P-R]='\0';
-      if(!J) Offset=RdZ80(B++);
+      if(!J) Offset=z80_read_disassembler_8(B++);
       strcat(S,Offset&0x80? "-":"+");
       J=Offset&0x80? 256-Offset:Offset;
       sprintf(H,"%02X",J);
@@ -78,7 +106,7 @@ int DAsm(char *S,word A)
       if(P=strchr(R,'#'))
       {
         strncpy(S,R,P-R);S[P-R]='\0';
-        sprintf(H,"%04X",RdZ80(B)+256*RdZ80(B+1));
+        sprintf(H,"%04X",z80_read_disassembler_8(B)+256*z80_read_disassembler_8(B+1));
         strcat(S,H);strcat(S,P+1);
         B+=2;
       }
@@ -102,16 +130,40 @@ void z80_pulse_reset()
     reset=0;
 }
 
-void z80_execute(unsigned int target)
+/******************************************************************************
+ * 
+ *   Z80 CPU execute
+ *   Run the Z80 until it catches up with master clock "target"
+ * 
+ ******************************************************************************/
+void z80_execute(unsigned long long target)
 {
-    extern int cycle_counter;
     int rem;
-    int mclk = cycle_counter * M68K_FREQ_DIVISOR;
-    zclk = (target-mclk) / Z80_FREQ_DIVISOR;
-    if (zclk >= target)
+    if (z80_clock >= target)
         return;
-    rem = ExecZ80(&cpu, zclk);
-    zclk = target - rem*Z80_FREQ_DIVISOR;
+    z80_slice = (target - z80_clock + Z80_FREQ_DIVISOR - 1) / Z80_FREQ_DIVISOR;
+    z80_running = 1;
+    TIMING_BEGIN(TIMING_Z80);
+    rem = ExecZ80(&cpu, z80_slice);
+    TIMING_END(TIMING_Z80);
+    z80_running = 0;
+    zclk = z80_slice - rem;
+    if (profiler_running)
+        profiler_z80(cpu.PC.W, zclk);
+    z80_clock += zclk * Z80_FREQ_DIVISOR;
+}
+
+/******************************************************************************
+ * 
+ *   Z80 CPU master clock
+ *   Return master clock at the current Z80 instruction
+ * 
+ ******************************************************************************/
+unsigned long long z80_get_master_clock()
+{
+    if (!z80_running)
+        return z80_clock;
+    return z80_clock + (z80_slice - cpu.ICount) * Z80_FREQ_DIVISOR;
 }
 
 void z80_set_memory(unsigned int *buffer)
@@ -210,13 +262,48 @@ word z80_get_reg(int reg_i) {
 word LoopZ80(register Z80 *R) {}
 byte RdZ80(register word Addr)
 {
-    return Z80_RAM[Addr];
+    byte value;
+    if ((Addr & 0xE000) == 0x4000) // YM2612 ADDRESS 0x4000 - 0x5FFF
+        value = ym2612_read_memory_8(Addr);
+    else
+        value = Z80_RAM[Addr];
+    if (WATCHPOINT_Z80_ARMED(Addr) && z80_running)
+        watchpoint_read(WATCHPOINT_Z80, Addr, 1, value);
+    return value;
 }
 void WrZ80(register word Addr, register byte Value)
 {
+    if (WATCHPOINT_Z80_ARMED(Addr) && z80_running)
+        watchpoint_write(WATCHPOINT_Z80, Addr, 1, Value);
+    if ((Addr & 0xE000) == 0x4000) // YM2612 ADDRESS 0x4000 - 0x5FFF
+    {
+        ym2612_write_memory_8(Addr, Value);
+        return;
+    }
+    if ((Addr & 0xFFF9) == 0x7F11) // SN76489 ADDRESS 0x7F11 - 0x7F17
+    {
+        sn76489_write(Value);
+        return;
+    }
     Z80_RAM[Addr] = Value;
+    DISASM_TOUCH_Z80(Addr);
 }
 byte InZ80(register word Port) {}
 void OutZ80(register word Port, register byte Value) {}
 void PatchZ80(register Z80 *R) {}
-void DebugZ80(register Z80 *R) {}
\ No newline at end of file
+void DebugZ80(register Z80 *R) {}
+
+/******************************************************************************
+ * 
+ *   Z80 State
+ *   Hand out the CPU and its bus and clock state for state_save
+ * 
+ ******************************************************************************/
+unsigned int z80_state_blocks(state_block *blocks)
+{
+    state_block list[] = {
+        STATE_BLOCK(cpu), STATE_BLOCK(bus_ack), STATE_BLOCK(reset), STATE_BLOCK(zclk),
+        STATE_BLOCK(z80_clock), STATE_BLOCK(z80_slice)};
+    memcpy(blocks, list, sizeof(list));
+    return sizeof(list) / sizeof(list[0]);
+}
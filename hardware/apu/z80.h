@@ -1,5 +1,7 @@
 void z80_write_ctrl(unsigned int address, unsigned int value);
 unsigned int z80_read_ctrl(unsigned int address);
+void z80_execute(unsigned long long target);
+unsigned long long z80_get_master_clock();
 
 
 static const char *Mnemonics[256] =
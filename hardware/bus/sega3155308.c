@@ -2,9 +2,12 @@
 #include <string.h>
 #include <libs/Musashi/m68k.h>
 #include "sega3155308.h"
+#include "hardware/debug/disasm.h"
+#include "hardware/system/state.h"
 
 // Setup CPU Memory
-unsigned char ROM[MAX_ROM_SIZE];      // 68K Main Program
+unsigned char ROM_default[MAX_ROM_SIZE];  // 68K Main Program
+unsigned char *ROM = ROM_default;         // Cartridge of the machine in the globals, see kaiser_machine_lock
 unsigned char RAM[MAX_RAM_SIZE];      // 68K RAM
 unsigned char ZRAM[MAX_Z80_RAM_SIZE]; // Z80 RAM
 unsigned char TMSS[0x4];
@@ -13,6 +16,12 @@ unsigned char TMSS[0x4];
 int tmss_state = 0;
 int tmss_count = 0;
 
+// FNV-1a hash of the loaded cartridge, ties save states to it
+unsigned int rom_hash = 0;
+
+// Write generations of the disassembly cache
+extern unsigned int disasm_m68k_pages[DISASM_M68K_PAGES];
+
 /******************************************************************************
  * 
  *   Load a Sega Genesis Cartridge into CPU Memory              
@@ -20,6 +29,8 @@ int tmss_count = 0;
  ******************************************************************************/
 void load_cartridge(unsigned char *buffer, size_t size)
 {
+    size_t i;
+
     // Clear all volatile memory
     memset(ROM, 0, MAX_ROM_SIZE);
     memset(RAM, 0, MAX_RAM_SIZE);
@@ -32,6 +43,11 @@ void load_cartridge(unsigned char *buffer, size_t size)
     // Copy file contents to CPU ROM memory
     memcpy(ROM, buffer, size);
     set_region();
+    disasm_flush();
+
+    rom_hash = 2166136261u;
+    for (i = 0; i < size; i++)
+        rom_hash = (rom_hash ^ buffer[i]) * 16777619u;
 }
 
 /******************************************************************************
@@ -48,6 +64,8 @@ void power_on()
     m68k_init();
     // Initialize Z80 CPU
     z80_init();
+    // Initialize SN76489 PSG, before YM2612 which sets its output rate
+    sn76489_init();
     // Initialize YM2612 chip
     ym2612_init();
 }
@@ -236,9 +254,11 @@ void sega3155308_write_memory_8(unsigned int address, unsigned int value)
     {
     case ROM_ADDR:
         ROM[address] = value;
+        DISASM_TOUCH_ROM(address);
         return;
     case ROM_ADDR_MIRROR:
         ROM[mirror_address] = value;
+        DISASM_TOUCH_ROM(mirror_address);
         return;
     case Z80_RAM_ADDR:
         z80_write_memory_8(address & 0x1FFF, value);
@@ -251,6 +271,7 @@ void sega3155308_write_memory_8(unsigned int address, unsigned int value)
         return;
     case Z80_ROM_ADDR:
         ROM[address] = (value & 0xFF);
+        DISASM_TOUCH_ROM(address);
         return;
     case IO_CTRL:
         sega3155345_write_ctrl(address & 0x1F, value);
@@ -272,6 +293,7 @@ void sega3155308_write_memory_8(unsigned int address, unsigned int value)
         return;
     case RAM_ADDR:
         RAM[address & 0xFFFF] = value;
+        DISASM_TOUCH_RAM(address);
         return;
     default:
         printf("write(%x, %x)\n", address, value);
@@ -290,6 +312,7 @@ void sega3155308_write_memory_16(unsigned int address, unsigned int value)
     case ROM_ADDR_MIRROR:
         ROM[mirror_address] = (value << 8) & 0xFF;
         ROM[mirror_address + 1] = value & 0xFF;
+        DISASM_TOUCH_ROM(mirror_address);
         return;
     case Z80_RAM_ADDR:
         z80_write_memory_16(address & 0x1FFF, value);
@@ -303,6 +326,7 @@ void sega3155308_write_memory_16(unsigned int address, unsigned int value)
     case Z80_ROM_ADDR:
         ROM[address] = (value << 8) & 0xFF;
         ROM[address + 1] = value & 0xFF;
+        DISASM_TOUCH_ROM(address);
         return;
     case VDP_ADDR:
         sega3155313_write_memory_16(address & 0xFFFF, value);
@@ -314,4 +338,20 @@ void sega3155308_write_memory_16(unsigned int address, unsigned int value)
         return;
     }
     return;
-}
\ No newline at end of file
+}
+
+/******************************************************************************
+ * 
+ *   Bus State
+ *   Hand out work RAM, Z80 RAM and TMSS for state_save. ROM is not part
+ *   of a state, it is identified by rom_hash.
+ * 
+ ******************************************************************************/
+unsigned int sega3155308_state_blocks(state_block *blocks)
+{
+    state_block list[] = {
+        STATE_BLOCK(RAM), STATE_BLOCK(ZRAM), STATE_BLOCK(TMSS),
+        STATE_BLOCK(tmss_state), STATE_BLOCK(tmss_count)};
+    memcpy(blocks, list, sizeof(list));
+    return sizeof(list) / sizeof(list[0]);
+}
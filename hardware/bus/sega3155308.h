@@ -35,6 +35,25 @@ enum sega3155308_pad_button
     PAD_S
 };
 
+typedef struct _run_input
+{
+    unsigned int frame;     // Frame of the batch the buttons apply from
+    unsigned int pad;       // Pad 0 or 1
+    unsigned int buttons;   // Bit per sega3155308_pad_button, set is pressed
+} run_input;
+
+typedef struct _run_status
+{
+    unsigned int frames;            // Frames run
+    unsigned long long cycles;      // Master clocks run
+    unsigned int video_frames;      // Framebuffers written to the video buffer
+    unsigned int audio_frames;      // Frames written to the audio buffer
+    int breakpoint;                 // Breakpoint that stopped the batch, -1 if none
+    unsigned int pc;                // 68K PC when the batch ended, the breakpoint address after a stop
+} run_status;
+
+#define RUN_VIDEO_BYTES (320 * 240 * 4)   // Frame size in the video buffer, see sega3155313_take_frame
+
 void load_cartridge(unsigned char *buffer, size_t size);
 void power_on();
 void reset_emulation();
@@ -45,4 +64,7 @@ unsigned int sega3155308_map_address(unsigned int address);
 unsigned int sega3155308_read_memory_8(unsigned int address);
 unsigned int sega3155308_read_memory_16(unsigned int address);
 void sega3155308_write_memory_8(unsigned int address, unsigned int value);
-void sega3155308_write_memory_16(unsigned int address, unsigned int value);
\ No newline at end of file
+void sega3155308_write_memory_16(unsigned int address, unsigned int value);
+unsigned int run_frames(unsigned int frames, const run_input *inputs, unsigned int input_count,
+                        unsigned char *video, unsigned int video_every,
+                        void *audio, unsigned int audio_capacity, run_status *status);
\ No newline at end of file
@@ -6,6 +6,12 @@
 #include "hardware/bus/sega3155308.h"
 #include "hardware/io/sega3155345.h"
 #include "hardware/vdp/sega3155313.h"
+#include "hardware/apu/audio.h"
+#include "hardware/system/state.h"
+#include "hardware/system/movie.h"
+#include "hardware/debug/breakpoint.h"
+#include "hardware/debug/watchpoint.h"
+#include "hardware/debug/timing.h"
 
 #define MCLOCK_NTSC 53693175 // NTSC CLOCK
 
@@ -14,6 +20,13 @@ int lines_per_frame = 262; // NTSC: 262 lines
                            // PAL: 313 lines
 // Define cycle counter
 unsigned int *cycle_counter;
+// Define master clock counter
+// frame() hands out 68K timeslices in master clocks (M68K_CYCLES_PER_LINE per line)
+unsigned long long master_clock = 0;
+// Define 68K timeslice running state
+int m68k_running = 0;
+// Define watched pages, see hardware/debug/watchpoint.c
+extern unsigned char watchpoint_pages[WATCHPOINT_PAGES / 8];
 
 /******************************************************************************
  * 
@@ -23,7 +36,10 @@ unsigned int *cycle_counter;
  ******************************************************************************/
 unsigned int m68k_read_memory_8(unsigned int address)
 {
-    return sega3155308_read_memory_8(address);
+    unsigned int value = sega3155308_read_memory_8(address);
+    if (WATCHPOINT_M68K_ARMED(address))
+        watchpoint_read(WATCHPOINT_M68K, address, 1, value);
+    return value;
 }
 
 /******************************************************************************
@@ -34,7 +50,10 @@ unsigned int m68k_read_memory_8(unsigned int address)
  ******************************************************************************/
 unsigned int m68k_read_memory_16(unsigned int address)
 {
-    return sega3155308_read_memory_16(address);
+    unsigned int value = sega3155308_read_memory_16(address);
+    if (WATCHPOINT_M68K_ARMED(address))
+        watchpoint_read(WATCHPOINT_M68K, address, 2, value);
+    return value;
 }
 
 /******************************************************************************
@@ -57,6 +76,8 @@ unsigned int m68k_read_memory_32(unsigned int address)
  ******************************************************************************/
 void m68k_write_memory_8(unsigned int address, unsigned int value)
 {
+    if (WATCHPOINT_M68K_ARMED(address))
+        watchpoint_write(WATCHPOINT_M68K, address, 1, value & 0xFF);
     sega3155308_write_memory_8(address, value);
     return;
 }
@@ -69,6 +90,8 @@ void m68k_write_memory_8(unsigned int address, unsigned int value)
  ******************************************************************************/
 void m68k_write_memory_16(unsigned int address, unsigned int value)
 {
+    if (WATCHPOINT_M68K_ARMED(address))
+        watchpoint_write(WATCHPOINT_M68K, address, 2, value & 0xFFFF);
     sega3155308_write_memory_16(address, value);
     return;
 }
@@ -86,90 +109,239 @@ void m68k_write_memory_32(unsigned int address, unsigned int value)
     return;
 }
 
+/******************************************************************************
+ * 
+ *   Master clock
+ *   Return current master clock as seen by the CPU being executed
+ * 
+ ******************************************************************************/
+unsigned long long get_master_clock()
+{
+    extern int z80_running;
+
+    if (z80_running)
+        return z80_get_master_clock();
+    if (m68k_running)
+        return master_clock + m68k_cycles_run();
+    return master_clock;
+}
+
+// Define where frame() stopped at a breakpoint, 0 at the start of a frame
+static int frame_step = 0;
+static int frame_line, frame_hint_counter;
+// Define 68K cycles left of the slice being run
+static int frame_slice;
+
+/******************************************************************************
+ * 
+ *   68K CPU timeslice
+ *   Execute up to "cycles" on the 68K, advance master clock by the cycles
+ *   used and take them off "cycles". Returns 1 when a breakpoint stopped
+ *   the 68K before the slice was used up.
+ * 
+ ******************************************************************************/
+static int m68k_run_slice(int *cycles)
+{
+    int used;
+
+    m68k_running = 1;
+    TIMING_BEGIN(TIMING_M68K);
+    used = m68k_execute(*cycles);
+    TIMING_END(TIMING_M68K);
+    m68k_running = 0;
+    master_clock += used;
+    *cycles -= used;
+    return breakpoint_take_stop();
+}
+
+// Run a 68K slice of frame(), a breakpoint leaves frame() and the next
+// call enters again at the rest of the slice
+#define FRAME_SLICE(step, cycles)          \
+    frame_slice = (cycles);                \
+    case step:                             \
+    if (m68k_run_slice(&frame_slice))      \
+    {                                      \
+        frame_step = step;                 \
+        TIMING_END(TIMING_FRAME);          \
+        return 0;                          \
+    }
+
 /******************************************************************************
  * 
  *   68K CPU Main Loop
  *   Perform a frame which is called every 1/60th second on NTSC
- *   and called every 1/50th on PAL
+ *   and called every 1/50th on PAL. Returns 0 when a breakpoint stopped
+ *   the 68K, the next call carries on from there.
  * 
  ******************************************************************************/
-void frame()
+int frame()
 {
-    extern unsigned char sega3155313_regs[0x20], *screen, *audio;
+    extern unsigned char sega3155313_regs[0x20];
     extern unsigned int sega3155313_status;
     extern int screen_width, screen_height;
-    int hint_counter = sega3155313_regs[10];
-    int line;
-    extern int zclk;
-
-    cycle_counter = 0;
 
-    screen_width = (sega3155313_regs[12] & 0x01) ? 320 : 256;
-    screen_height = (sega3155313_regs[1] & 0x08) ? 240 : 224;
+    TIMING_BEGIN(TIMING_FRAME);
+    switch (frame_step)
+    {
+    case 0:
+        // Pads change here only, from the frontend or a movie
+        movie_frame();
+        cycle_counter = 0;
 
-    sega3155313_clear_vblank();
+        screen_width = (sega3155313_regs[12] & 0x01) ? 320 : 256;
+        screen_height = (sega3155313_regs[1] & 0x08) ? 240 : 224;
 
-    memset(screen, 0, 320 * 240 * 4); /* clear the screen before rendering */
-    memset(audio, 0, 1080 * 2);       /* clear the audio before rendering */
+        sega3155313_clear_vblank();
+        frame_hint_counter = sega3155313_regs[10];
 
-    for (line = 0; line < screen_height; line++)
-    {
-        m68k_execute(2560 + 120);
-        z80_execute(2560 + 120);
-
-        if (--hint_counter < 0)
+        for (frame_line = 0; frame_line < screen_height; frame_line++)
         {
-            hint_counter = sega3155313_regs[10];
-            if (sega3155313_regs[0] & 0x10)
+            FRAME_SLICE(1, 2560 + 120);
+            z80_execute(master_clock);
+
+            if (--frame_hint_counter < 0)
             {
-                m68k_set_irq(4); /* HInt */
-                //m68k_execute(7000);
+                frame_hint_counter = sega3155313_regs[10];
+                if (sega3155313_regs[0] & 0x10)
+                {
+                    m68k_set_irq(4); /* HInt */
+                    //m68k_execute(7000);
+                }
             }
+
+            sega3155313_set_hblank();
+            FRAME_SLICE(2, 64 + 313 + 259); /* HBlank */
+            sega3155313_clear_hblank();
+
+            TIMING_BEGIN(TIMING_VDP);
+            sega3155313_render_line(frame_line); /* render line */
+            TIMING_END(TIMING_VDP);
+
+            ym2612_update();
+            FRAME_SLICE(3, 104);
         }
+        sega3155313_set_vblank();
+
+        FRAME_SLICE(4, 588);
+
+        sega3155313_status |= 0x80;
 
-        sega3155313_set_hblank();
-        m68k_execute(64 + 313 + 259); /* HBlank */
-        sega3155313_clear_hblank();
+        FRAME_SLICE(5, 200);
 
-        int enable_planes = BIT(sega3155313_regs[1], 6);
-        if (enable_planes)
-            sega3155313_render_line(line); /* render line */
+        if (sega3155313_regs[1] & 0x20)
+        {
+            m68k_set_irq(6); /* HInt */
+        }
 
+        FRAME_SLICE(6, 3420 - 788);
+        frame_line++;
+
+        for (; frame_line < lines_per_frame; frame_line++)
+        {
+            FRAME_SLICE(7, 3420);
+        }
+        z80_execute(master_clock);
         ym2612_update();
-        m68k_execute(104);
     }
-    sega3155313_set_vblank();
+    frame_step = 0;
+    TIMING_END(TIMING_FRAME);
+    timing_frame_done();
+    return 1;
+}
 
-    m68k_execute(588);
+/******************************************************************************
+ * 
+ *   Run frames
+ *   Run a batch of "frames" frames in one call. "inputs" is sorted by
+ *   frame, each entry sets the buttons of its pad from that frame of the
+ *   batch on. With a "video" buffer every "video_every"-th framebuffer
+ *   is appended to it, or only the last one when "video_every" is 0.
+ *   With an "audio" buffer the audio ring is drained into it after every
+ *   frame, up to "audio_capacity" frames in the mixer output format,
+ *   the rest stays in the ring. Call audio_set_latency(0) first so rate
+ *   control stays out of the way. A breakpoint ends the batch inside a
+ *   frame, "status" tells which one and the PC, the next batch finishes
+ *   that frame first. Returns the frames completed, "status" may be
+ *   NULL.
+ * 
+ ******************************************************************************/
+unsigned int run_frames(unsigned int frames, const run_input *inputs, unsigned int input_count,
+                        unsigned char *video, unsigned int video_every,
+                        void *audio, unsigned int audio_capacity, run_status *status)
+{
+    unsigned long long start = master_clock;
+    unsigned int n, next = 0, button, fill, video_frames = 0, audio_frames = 0;
+    unsigned int frame_bytes = audio_get_frame_bytes();
+    int stopped = 0;
 
-    sega3155313_status |= 0x80;
+    for (n = 0; n < frames; n++)
+    {
+        for (; next < input_count && inputs[next].frame <= n; next++)
+        {
+            for (button = 0; button < 8; button++)
+            {
+                if (inputs[next].buttons & (1 << button))
+                    sega3155345_pad_press_button(inputs[next].pad, button);
+                else
+                    sega3155345_pad_release_button(inputs[next].pad, button);
+            }
+        }
 
-    m68k_execute(200);
+        if (!frame())
+        {
+            stopped = 1;
+            break;
+        }
 
-    if (sega3155313_regs[1] & 0x20)
-    {
-        m68k_set_irq(6); /* HInt */
+        if (video && (video_every ? (n + 1) % video_every == 0 : n + 1 == frames))
+            memcpy(video + (unsigned long)video_frames++ * RUN_VIDEO_BYTES, sega3155313_take_frame(), RUN_VIDEO_BYTES);
+        if (audio)
+        {
+            fill = audio_get_fill();
+            if (fill > audio_capacity - audio_frames)
+                fill = audio_capacity - audio_frames;
+            audio_frames += audio_read((unsigned char *)audio + (unsigned long)audio_frames * frame_bytes, fill);
+        }
     }
 
-    m68k_execute(3420 - 788);
-    line++;
-
-    for (; line < lines_per_frame; line++)
+    if (status)
     {
-        m68k_execute(3420); /**/
+        status->frames = n;
+        status->cycles = master_clock - start;
+        status->video_frames = video_frames;
+        status->audio_frames = audio_frames;
+        status->breakpoint = stopped ? breakpoint_get_hit() : BREAKPOINT_NONE;
+        status->pc = m68k_get_reg(NULL, M68K_REG_PC);
     }
+    return n;
 }
 
+// The disassembler reads past the bus watchpoints
 unsigned int m68k_read_disassembler_16(unsigned int address)
 {
-    return m68k_read_memory_16(address);
+    return sega3155308_read_memory_16(address);
 }
 unsigned int m68k_read_disassembler_32(unsigned int address)
 {
-    return m68k_read_memory_32(address);
+    return (sega3155308_read_memory_16(address) << 16) | sega3155308_read_memory_16(address + 2);
 }
 
 unsigned int get_cycle_counter()
 {
     return m68k_cycles_run();
 }
+
+/******************************************************************************
+ * 
+ *   68K clock state
+ *   Hand out the master clock, frame length and the place in the frame
+ *   for state_save, the CPU itself is saved through the Musashi context
+ * 
+ ******************************************************************************/
+unsigned int m68k_state_blocks(state_block *blocks)
+{
+    state_block list[] = {STATE_BLOCK(master_clock), STATE_BLOCK(lines_per_frame), STATE_BLOCK(frame_step),
+                          STATE_BLOCK(frame_line), STATE_BLOCK(frame_hint_counter), STATE_BLOCK(frame_slice)};
+    memcpy(blocks, list, sizeof(list));
+    return sizeof(list) / sizeof(list[0]);
+}
@@ -0,0 +1,27 @@
+#include "libs/Musashi/m68kconf.h"
+#include "hardware/debug/breakpoint.h"
+#include "hardware/debug/profiler.h"
+
+/******************************************************************************
+ *
+ *   Musashi configuration
+ *   Musashi's own defaults with the instruction hook as an inline check
+ *   of the breakpoint pages and of the profiler. Musashi expands the
+ *   hook at the top of the m68k_execute loop, a hit breaks out of that
+ *   loop before the instruction runs and m68k_execute returns the
+ *   cycles used so far. Built in through MUSASHI_CNF, see BREAKPOINTS
+ *   in the Makefile.
+ *
+ ******************************************************************************/
+
+#undef M68K_INSTRUCTION_HOOK
+#undef M68K_INSTRUCTION_CALLBACK
+#define M68K_INSTRUCTION_HOOK OPT_SPECIFY_HANDLER
+#define M68K_INSTRUCTION_CALLBACK(pc) \
+    if (BREAKPOINT_PAGE_ARMED(pc) && breakpoint_check(pc)) \
+        break; \
+    else if (profiler_running) \
+        profiler_m68k(pc)
+
+extern unsigned char breakpoint_pages[BREAKPOINT_PAGES / 8];
+extern int profiler_running;
@@ -0,0 +1,127 @@
+#include "breakpoint.h"
+
+/******************************************************************************
+ *
+ *   Breakpoints
+ *   68K execution breakpoints checked from Musashi's instruction hook,
+ *   see hardware/cpu/musashi_conf.h. The hook tests one bit of
+ *   breakpoint_pages per instruction and only calls breakpoint_check
+ *   in pages holding a breakpoint. A hit leaves m68k_execute before the
+ *   instruction runs, frame() returns and resumes from there next time.
+ *
+ ******************************************************************************/
+
+// Define a bit per page holding an armed breakpoint
+unsigned char breakpoint_pages[BREAKPOINT_PAGES / 8];
+// Define armed breakpoints, BREAKPOINT_NO_ADDRESS when free
+static unsigned int breakpoint_addresses[BREAKPOINT_MAX] = {
+    BREAKPOINT_NO_ADDRESS, BREAKPOINT_NO_ADDRESS, BREAKPOINT_NO_ADDRESS, BREAKPOINT_NO_ADDRESS,
+    BREAKPOINT_NO_ADDRESS, BREAKPOINT_NO_ADDRESS, BREAKPOINT_NO_ADDRESS, BREAKPOINT_NO_ADDRESS,
+    BREAKPOINT_NO_ADDRESS, BREAKPOINT_NO_ADDRESS, BREAKPOINT_NO_ADDRESS, BREAKPOINT_NO_ADDRESS,
+    BREAKPOINT_NO_ADDRESS, BREAKPOINT_NO_ADDRESS, BREAKPOINT_NO_ADDRESS, BREAKPOINT_NO_ADDRESS};
+// Define breakpoint of the last stop and the address that resumes past it
+static int breakpoint_hit = BREAKPOINT_NONE;
+static unsigned int breakpoint_resume = BREAKPOINT_NO_ADDRESS;
+static int breakpoint_stopped = 0;
+
+static void breakpoint_update_pages()
+{
+    unsigned int page;
+    int i;
+
+    for (i = 0; i < BREAKPOINT_PAGES / 8; i++)
+        breakpoint_pages[i] = 0;
+    for (i = 0; i < BREAKPOINT_MAX; i++)
+    {
+        if (breakpoint_addresses[i] == BREAKPOINT_NO_ADDRESS)
+            continue;
+        page = breakpoint_addresses[i] >> BREAKPOINT_PAGE_BITS;
+        breakpoint_pages[page >> 3] |= 1 << (page & 7);
+    }
+    // A stop at a breakpoint that changed resumes normally
+    breakpoint_resume = BREAKPOINT_NO_ADDRESS;
+}
+
+/******************************************************************************
+ *
+ *   Breakpoint set/clear
+ *   Arm breakpoint "index" at a 68K address. Arm them between frames or
+ *   while the emulation thread is paused. Returns 0 for a bad index.
+ *
+ ******************************************************************************/
+int breakpoint_set(int index, unsigned int address)
+{
+    if (index < 0 || index >= BREAKPOINT_MAX)
+        return 0;
+    breakpoint_addresses[index] = address & 0xFFFFFF;
+    breakpoint_update_pages();
+    return 1;
+}
+
+void breakpoint_clear(int index)
+{
+    if (index < 0 || index >= BREAKPOINT_MAX)
+        return;
+    breakpoint_addresses[index] = BREAKPOINT_NO_ADDRESS;
+    breakpoint_update_pages();
+}
+
+void breakpoint_clear_all()
+{
+    int i;
+    for (i = 0; i < BREAKPOINT_MAX; i++)
+        breakpoint_addresses[i] = BREAKPOINT_NO_ADDRESS;
+    breakpoint_update_pages();
+}
+
+unsigned int breakpoint_get_address(int index)
+{
+    if (index < 0 || index >= BREAKPOINT_MAX)
+        return BREAKPOINT_NO_ADDRESS;
+    return breakpoint_addresses[index];
+}
+
+// Breakpoint the 68K last stopped at, BREAKPOINT_NONE if none
+int breakpoint_get_hit()
+{
+    return breakpoint_hit;
+}
+
+/******************************************************************************
+ *
+ *   Breakpoint check
+ *   Called by the hook before the instruction at "pc" runs, in a page
+ *   with a breakpoint. Returns 1 to stop. The instruction a stop was
+ *   at runs when the 68K gets there the next time.
+ *
+ ******************************************************************************/
+int breakpoint_check(unsigned int pc)
+{
+    int i;
+
+    pc &= 0xFFFFFF;
+    if (pc == breakpoint_resume)
+    {
+        breakpoint_resume = BREAKPOINT_NO_ADDRESS;
+        return 0;
+    }
+    for (i = 0; i < BREAKPOINT_MAX; i++)
+    {
+        if (breakpoint_addresses[i] == pc)
+        {
+            breakpoint_hit = i;
+            breakpoint_resume = pc;
+            breakpoint_stopped = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Whether a breakpoint ended the last m68k_execute, cleared by the call
+int breakpoint_take_stop()
+{
+    int stopped = breakpoint_stopped;
+    breakpoint_stopped = 0;
+    return stopped;
+}
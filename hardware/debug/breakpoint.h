@@ -0,0 +1,17 @@
+#define BREAKPOINT_MAX 16               // Execution breakpoints that can be armed at once
+#define BREAKPOINT_PAGE_BITS 8          // Breakpoint pages of 256 bytes
+#define BREAKPOINT_PAGES ((1 << 24) >> BREAKPOINT_PAGE_BITS)
+#define BREAKPOINT_NONE -1
+#define BREAKPOINT_NO_ADDRESS 0xFFFFFFFF
+
+// Whether the page of "pc" holds a breakpoint, one load and test, needs breakpoint_pages
+#define BREAKPOINT_PAGE_ARMED(pc) \
+    (breakpoint_pages[((pc) & 0xFFFFFF) >> (BREAKPOINT_PAGE_BITS + 3)] & (1 << (((pc) >> BREAKPOINT_PAGE_BITS) & 7)))
+
+int breakpoint_set(int index, unsigned int address);
+void breakpoint_clear(int index);
+void breakpoint_clear_all();
+unsigned int breakpoint_get_address(int index);
+int breakpoint_get_hit();
+int breakpoint_check(unsigned int pc);
+int breakpoint_take_stop();
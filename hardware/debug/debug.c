@@ -0,0 +1,59 @@
+#include <string.h>
+#include "libs/Musashi/m68k.h"
+#include "debug.h"
+#include "hardware/vdp/sega3155313.h"
+#include "hardware/system/emulation.h"
+
+/******************************************************************************
+ *
+ *   Debug snapshot
+ *   Everything the debugger windows show, copied out in one call. The
+ *   frontend formats it, the core only copies. Taken while the emulation
+ *   thread runs it may straddle a frame boundary.
+ *
+ ******************************************************************************/
+
+extern unsigned char sega3155313_regs[REG_SIZE];
+extern unsigned short CRAM[CRAM_MAX_SIZE];
+extern unsigned short VSRAM[VSRAM_MAX_SIZE];
+extern unsigned int sega3155313_status;
+extern int control_code;
+extern unsigned int control_address;
+extern int control_pending;
+extern int dma_fill_pending;
+extern unsigned int sega3155313_laddress_r, sega3155313_laddress_w;
+extern unsigned int sega3155313_vram_writes;
+extern unsigned long long master_clock;
+
+unsigned short z80_get_reg(int reg_i);
+unsigned int get_cycle_counter();
+
+void debug_snapshot(debug_state *state)
+{
+    int i;
+
+    state->version = DEBUG_SNAPSHOT_VERSION;
+    state->size = sizeof(debug_state);
+    state->master_clock = master_clock;
+    state->frames = emulation_get_frames();
+    state->m68k_cycles = get_cycle_counter();
+    for (i = 0; i < DEBUG_M68K_REGS; i++)
+        state->m68k_regs[i] = m68k_get_reg(NULL, M68K_REG_D0 + i);
+    for (i = 0; i < DEBUG_Z80_REGS; i++)
+        state->z80_regs[i] = z80_get_reg(i);
+
+    memcpy(state->vdp_regs, sega3155313_regs, DEBUG_VDP_REGS);
+    memcpy(state->cram, CRAM, sizeof(state->cram));
+    memcpy(state->vsram, VSRAM, sizeof(state->vsram));
+    state->vdp_status = sega3155313_status;
+    state->vdp_hvcounter = sega3155313_hvcounter();
+    state->vdp_control_code = control_code;
+    state->vdp_control_address = control_address;
+    state->vdp_control_pending = control_pending;
+    state->vdp_read_address = sega3155313_laddress_r;
+    state->vdp_write_address = sega3155313_laddress_w;
+    state->dma_source = (REG23_DMA_SRCADDR_HIGH | REG21_DMA_SRCADDR_LOW) << 1;
+    state->dma_length = REG19_DMA_LENGTH;
+    state->dma_fill_pending = dma_fill_pending;
+    state->vram_writes = sega3155313_vram_writes;
+}
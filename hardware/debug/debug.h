@@ -0,0 +1,33 @@
+#define DEBUG_SNAPSHOT_VERSION 1
+#define DEBUG_M68K_REGS 20      // D0-D7, A0-A7, PC, SR, SP, USP
+#define DEBUG_Z80_REGS 8        // AF, BC, DE, HL, IX, IY, PC, SP
+#define DEBUG_VDP_REGS 0x20     // REG_SIZE
+#define DEBUG_CRAM_SIZE 0x40    // CRAM_MAX_SIZE
+#define DEBUG_VSRAM_SIZE 0x40   // VSRAM_MAX_SIZE
+
+typedef struct _debug_state
+{
+    unsigned int version;                       // DEBUG_SNAPSHOT_VERSION
+    unsigned int size;                          // sizeof(debug_state)
+    unsigned long long master_clock;            // Master clocks since power on
+    unsigned int frames;                        // Frames run by the emulation thread
+    unsigned int m68k_cycles;                   // 68K cycles run in the current timeslice
+    unsigned int m68k_regs[DEBUG_M68K_REGS];
+    unsigned short z80_regs[DEBUG_Z80_REGS];
+    unsigned char vdp_regs[DEBUG_VDP_REGS];
+    unsigned short cram[DEBUG_CRAM_SIZE];
+    unsigned short vsram[DEBUG_VSRAM_SIZE];
+    unsigned int vdp_status;
+    unsigned int vdp_hvcounter;
+    unsigned int vdp_control_code;
+    unsigned int vdp_control_address;
+    unsigned int vdp_control_pending;
+    unsigned int vdp_read_address;              // Last data port read address
+    unsigned int vdp_write_address;             // Last data port write address
+    unsigned int dma_source;                    // Source of the next 68K DMA, in bytes
+    unsigned int dma_length;                    // Words of the next DMA, 0 is 0x10000
+    unsigned int dma_fill_pending;
+    unsigned int vram_writes;                   // Changes whenever VRAM is written
+} debug_state;
+
+void debug_snapshot(debug_state *state);
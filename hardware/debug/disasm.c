@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <string.h>
+#include "libs/Musashi/m68k.h"
+#include "disasm.h"
+
+/******************************************************************************
+ *
+ *   Disassembly cache
+ *   Batch disassembly of the 68K and Z80 into fixed size records. Lines
+ *   are cached by address and stay valid until a write lands in one of
+ *   the pages the instruction was read from, so a listing that does not
+ *   change costs a table lookup per line.
+ *
+ ******************************************************************************/
+
+typedef struct _disasm_entry
+{
+    int valid;
+    int first_page, last_page;          // Pages the instruction was read from
+    unsigned int first_gen, last_gen;   // Their write generations when it was decoded
+    disasm_line line;
+} disasm_entry;
+
+// Define write generations per page, bumped by the bus and the Z80 on writes
+unsigned int disasm_m68k_pages[DISASM_M68K_PAGES];
+unsigned int disasm_z80_pages[DISASM_Z80_PAGES];
+// Define line caches
+static disasm_entry disasm_m68k_cache[DISASM_CACHE_LINES];
+static disasm_entry disasm_z80_cache[DISASM_CACHE_LINES];
+
+unsigned int z80_disassemble(unsigned char *screen_buffer, unsigned int address);
+unsigned int z80_read_disassembler_8(unsigned int address);
+
+static void disasm_copy(disasm_line *line, const char *text)
+{
+    size_t length = strlen(text);
+    if (length >= DISASM_TEXT_SIZE)
+        length = DISASM_TEXT_SIZE - 1;
+    memcpy(line->text, text, length);
+    line->text[length] = 0;
+}
+
+/******************************************************************************
+ *
+ *   68K line
+ *   Only ROM and RAM are cached, anything else may read I/O and is
+ *   disassembled every time. Bcc, BSR, DBcc and JMP/JSR to an absolute
+ *   address all end in "$target" in Musashi's syntax.
+ *
+ ******************************************************************************/
+static int disasm_m68k_page(unsigned int address)
+{
+    address &= 0xFFFFFF;
+    if (address < 0x400000)
+        return address >> DISASM_PAGE_BITS;
+    if (address >= 0xE00000)
+        return DISASM_M68K_RAM_PAGE + ((address & 0xFFFF) >> DISASM_PAGE_BITS);
+    return -1;
+}
+
+static unsigned int disasm_m68k_target(const char *text)
+{
+    size_t mnemonic = strcspn(text, " .");
+    const char *operand;
+
+    if (!(text[0] == 'b' && mnemonic == 3) && strncmp(text, "db", 2) &&
+        strncmp(text, "jmp", 3) && strncmp(text, "jsr", 3))
+        return DISASM_NO_TARGET;
+    operand = text + strcspn(text, " ");
+    if (strrchr(operand, ','))
+        operand = strrchr(operand, ',') + 1;
+    while (*operand == ' ')
+        operand++;
+    if (*operand != '$')
+        return DISASM_NO_TARGET;
+    return strtoul(operand + 1, NULL, 16) & 0xFFFFFF;
+}
+
+static void disasm_m68k_decode(unsigned int address, disasm_line *line)
+{
+    // Musashi formats into a buffer of 100
+    char text[128];
+
+    line->address = address;
+    line->length = m68k_disassemble(text, address, M68K_CPU_TYPE_68000);
+    disasm_copy(line, text);
+    line->target = disasm_m68k_target(line->text);
+}
+
+/******************************************************************************
+ *
+ *   Z80 line
+ *   Only Z80 RAM is read and cached, the rest of the Z80 space shows as
+ *   open bus. Targets come from the opcode: DJNZ, JR, JP, CALL and RST.
+ *
+ ******************************************************************************/
+static int disasm_z80_page(unsigned int address)
+{
+    address &= 0xFFFF;
+    if (address < 0x4000)
+        return address >> DISASM_PAGE_BITS;
+    return -1;
+}
+
+static void disasm_z80_decode(unsigned int address, disasm_line *line)
+{
+    char text[128];
+    unsigned int opcode;
+
+    address &= 0xFFFF;
+    opcode = z80_read_disassembler_8(address);
+    line->address = address;
+    line->length = z80_disassemble((unsigned char *)text, address);
+    disasm_copy(line, text);
+    line->target = DISASM_NO_TARGET;
+    if (opcode == 0x10 || opcode == 0x18 || (opcode & 0xE7) == 0x20)
+        line->target = (address + 2 + (signed char)z80_read_disassembler_8(address + 1)) & 0xFFFF;
+    else if (opcode == 0xC3 || opcode == 0xCD || (opcode & 0xC7) == 0xC2 || (opcode & 0xC7) == 0xC4)
+        line->target = z80_read_disassembler_8(address + 1) | z80_read_disassembler_8(address + 2) << 8;
+    else if ((opcode & 0xC7) == 0xC7)
+        line->target = opcode & 0x38;
+}
+
+/******************************************************************************
+ *
+ *   Cached line
+ *   Fill "line" from the cache or decode it and cache it
+ *
+ ******************************************************************************/
+static void disasm_cached(disasm_entry *cache, const unsigned int *pages, int (*page)(unsigned int),
+                          void (*decode)(unsigned int, disasm_line *), unsigned int address, disasm_line *line)
+{
+    disasm_entry *entry = &cache[(address ^ address >> 1) & (DISASM_CACHE_LINES - 1)];
+    int first = page(address);
+
+    if (first < 0)
+    {
+        decode(address, line);
+        return;
+    }
+    if (entry->valid && entry->line.address == address && entry->first_page == first &&
+        pages[first] == entry->first_gen && pages[entry->last_page] == entry->last_gen)
+    {
+        *line = entry->line;
+        return;
+    }
+
+    decode(address, line);
+    entry->valid = 1;
+    entry->first_page = first;
+    entry->first_gen = pages[first];
+    entry->last_page = page(address + line->length - 1);
+    if (entry->last_page < 0)
+        entry->last_page = first;
+    entry->last_gen = pages[entry->last_page];
+    entry->line = *line;
+}
+
+/******************************************************************************
+ *
+ *   Disassemble
+ *   "count" consecutive instructions from "address" into "lines",
+ *   returns the lines written
+ *
+ ******************************************************************************/
+unsigned int disasm_m68k(unsigned int address, unsigned int count, disasm_line *lines)
+{
+    unsigned int n;
+    for (n = 0; n < count; n++)
+    {
+        disasm_cached(disasm_m68k_cache, disasm_m68k_pages, disasm_m68k_page, disasm_m68k_decode, address, &lines[n]);
+        address += lines[n].length;
+    }
+    return n;
+}
+
+unsigned int disasm_z80(unsigned int address, unsigned int count, disasm_line *lines)
+{
+    unsigned int n;
+    for (n = 0; n < count; n++)
+    {
+        disasm_cached(disasm_z80_cache, disasm_z80_pages, disasm_z80_page, disasm_z80_decode, address, &lines[n]);
+        address = (address + lines[n].length) & 0xFFFF;
+    }
+    return n;
+}
+
+/******************************************************************************
+ *
+ *   Disassembly flush
+ *   Drop every cached line, for changes that bypass the bus such as
+ *   loading a cartridge
+ *
+ ******************************************************************************/
+void disasm_flush()
+{
+    memset(disasm_m68k_cache, 0, sizeof(disasm_m68k_cache));
+    memset(disasm_z80_cache, 0, sizeof(disasm_z80_cache));
+}
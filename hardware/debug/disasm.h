@@ -0,0 +1,24 @@
+#define DISASM_TEXT_SIZE 64         // Disassembly text per line, nul terminated
+#define DISASM_CACHE_LINES 1024     // Cached lines per CPU, direct mapped by address
+#define DISASM_PAGE_BITS 8          // Writes invalidate cached lines in pages of 256 bytes
+#define DISASM_M68K_RAM_PAGE (0x400000 >> DISASM_PAGE_BITS)
+#define DISASM_M68K_PAGES (DISASM_M68K_RAM_PAGE + (0x10000 >> DISASM_PAGE_BITS))
+#define DISASM_Z80_PAGES (0x10000 >> DISASM_PAGE_BITS)
+#define DISASM_NO_TARGET 0xFFFFFFFF
+
+// Mark the page of a ROM, 68K RAM or Z80 address as written, needs disasm_m68k_pages/disasm_z80_pages
+#define DISASM_TOUCH_ROM(address) (disasm_m68k_pages[((address) & 0x3FFFFF) >> DISASM_PAGE_BITS]++)
+#define DISASM_TOUCH_RAM(address) (disasm_m68k_pages[DISASM_M68K_RAM_PAGE + (((address) & 0xFFFF) >> DISASM_PAGE_BITS)]++)
+#define DISASM_TOUCH_Z80(address) (disasm_z80_pages[((address) & 0xFFFF) >> DISASM_PAGE_BITS]++)
+
+typedef struct _disasm_line
+{
+    unsigned int address;
+    unsigned int length;                // Instruction length in bytes
+    unsigned int target;                // Static branch, jump or call target, DISASM_NO_TARGET if none
+    char text[DISASM_TEXT_SIZE];
+} disasm_line;
+
+unsigned int disasm_m68k(unsigned int address, unsigned int count, disasm_line *lines);
+unsigned int disasm_z80(unsigned int address, unsigned int count, disasm_line *lines);
+void disasm_flush();
@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libs/Musashi/m68k.h"
+#include "profiler.h"
+
+/******************************************************************************
+ *
+ *   Profiler
+ *   Sampling profiler of the 68K and the Z80. The 68K is followed from
+ *   Musashi's instruction hook while profiler_running is set: every
+ *   "period" cycles the instruction that ran is charged the period, and
+ *   JSR, BSR, RTS, RTR, RTE and autovectored interrupts keep a call
+ *   tree whose nodes measure inclusive cycles exactly, from entry to
+ *   return. The Z80 has no instruction hook, its PC is sampled at the
+ *   end of each timeslice and charged the slice. Export with the
+ *   emulation thread stopped or paused.
+ *
+ ******************************************************************************/
+
+#define PROFILER_PROBES 32      // Slots searched before an address or node is given up
+
+enum
+{
+    PROFILER_NEXT = 0,          // The last instruction falls through or branches
+    PROFILER_CALL,              // The last instruction was JSR or BSR
+    PROFILER_RETURN             // The last instruction was RTS, RTR or RTE
+};
+
+typedef struct _profiler_count
+{
+    unsigned int address;
+    unsigned long long cycles;  // 0 for a free slot
+} profiler_count;
+
+typedef struct _profiler_node
+{
+    unsigned int parent;
+    unsigned int entry;             // Routine address, PROFILER_ROOT for the root
+    unsigned int level;             // Interrupt level of a handler, 0 for called routines
+    unsigned int calls;
+    unsigned long long self;        // Sampled cycles with the node on top of the stack
+    unsigned long long inclusive;   // Cycles from entries to returns
+} profiler_node;
+
+typedef struct _profiler_frame
+{
+    unsigned int node;
+    unsigned int sp;                // A7 at entry, the frame is left when A7 rises above it
+    unsigned long long clock;       // Master clock at entry
+} profiler_frame;
+
+typedef struct _profiler_routine
+{
+    unsigned int entry, level, calls;
+    unsigned long long inclusive, self;
+} profiler_routine;
+
+// Define profiling state, profiler_running is tested by the instruction hook
+int profiler_running = 0;
+static unsigned int profiler_period = PROFILER_PERIOD;
+static unsigned long long profiler_next, profiler_m68k_cycles, profiler_z80_cycles;
+static unsigned long long profiler_m68k_lost, profiler_z80_lost;
+static unsigned int profiler_last_pc, profiler_last_sp;
+static int profiler_pending;
+// Define autovector handlers, read when profiling starts
+static unsigned int profiler_vectors[8];
+
+// Define instruction histograms
+static profiler_count profiler_m68k_counts[PROFILER_SLOTS];
+static profiler_count profiler_z80_counts[PROFILER_SLOTS];
+
+// Define call tree, node 0 is the root, and its lookup by parent and entry
+static profiler_node profiler_nodes[PROFILER_NODES];
+static unsigned int profiler_node_count;
+static unsigned int profiler_node_slots[PROFILER_NODES * 2];
+static profiler_frame profiler_stack[PROFILER_DEPTH];
+static unsigned int profiler_depth;
+
+// Define export scratch
+static profiler_count profiler_sorted[PROFILER_SLOTS];
+static profiler_routine profiler_routines[PROFILER_NODES];
+static unsigned long long profiler_open[PROFILER_NODES];
+
+unsigned long long get_master_clock();
+unsigned int m68k_read_disassembler_16(unsigned int address);
+unsigned int m68k_read_disassembler_32(unsigned int address);
+
+#define PROFILER_TOP (profiler_depth ? profiler_stack[profiler_depth - 1].node : 0)
+
+static void profiler_count_add(profiler_count *counts, unsigned int address, unsigned long long cycles,
+                               unsigned long long *lost)
+{
+    unsigned int slot = (address * 2654435761u >> 16) & (PROFILER_SLOTS - 1), probes;
+
+    for (probes = 0; probes < PROFILER_PROBES; probes++, slot = (slot + 1) & (PROFILER_SLOTS - 1))
+    {
+        if (!counts[slot].cycles)
+            counts[slot].address = address;
+        if (counts[slot].address == address)
+        {
+            counts[slot].cycles += cycles;
+            return;
+        }
+    }
+    *lost += cycles;
+}
+
+// Node of "entry" called from "parent", created on first use, PROFILER_ROOT when the tree is full
+static unsigned int profiler_child(unsigned int parent, unsigned int entry, unsigned int level)
+{
+    unsigned int slot = ((parent * 31 + entry + level) * 2654435761u >> 16) & (PROFILER_NODES * 2 - 1);
+    unsigned int probes, node;
+
+    for (probes = 0; probes < PROFILER_PROBES; probes++, slot = (slot + 1) & (PROFILER_NODES * 2 - 1))
+    {
+        node = profiler_node_slots[slot];
+        if (!node)
+        {
+            if (profiler_node_count == PROFILER_NODES)
+                return PROFILER_ROOT;
+            node = profiler_node_count++;
+            profiler_nodes[node].parent = parent;
+            profiler_nodes[node].entry = entry;
+            profiler_nodes[node].level = level;
+            profiler_node_slots[slot] = node;
+            return node;
+        }
+        if (profiler_nodes[node].parent == parent && profiler_nodes[node].entry == entry &&
+            profiler_nodes[node].level == level)
+            return node;
+    }
+    return PROFILER_ROOT;
+}
+
+static void profiler_push(unsigned int entry, unsigned int level, unsigned int sp, unsigned long long now)
+{
+    unsigned int node;
+
+    // Calls deeper than the stack or the tree are charged to their caller
+    if (profiler_depth == PROFILER_DEPTH)
+        return;
+    node = profiler_child(PROFILER_TOP, entry, level);
+    if (node == PROFILER_ROOT)
+        return;
+    profiler_nodes[node].calls++;
+    profiler_stack[profiler_depth].node = node;
+    profiler_stack[profiler_depth].sp = sp;
+    profiler_stack[profiler_depth].clock = now;
+    profiler_depth++;
+}
+
+/******************************************************************************
+ *
+ *   Profiler start/stop
+ *   Forget the last profile and sample every "period" 68K cycles, 0 for
+ *   PROFILER_PERIOD. The call tree starts at the root, calls already
+ *   running when profiling starts are left without being counted.
+ *   Returns 0 when Musashi was built without the instruction hook
+ *   (BREAKPOINTS=0), nothing would feed the profile.
+ *
+ ******************************************************************************/
+int profiler_start(unsigned int period)
+{
+    unsigned int level;
+
+#ifdef M68K_NO_INSTRUCTION_HOOK
+    return 0;
+#endif
+    profiler_running = 0;
+    profiler_period = period ? period : PROFILER_PERIOD;
+    memset(profiler_m68k_counts, 0, sizeof(profiler_m68k_counts));
+    memset(profiler_z80_counts, 0, sizeof(profiler_z80_counts));
+    memset(profiler_nodes, 0, sizeof(profiler_nodes));
+    memset(profiler_node_slots, 0, sizeof(profiler_node_slots));
+    profiler_nodes[0].entry = PROFILER_ROOT;
+    profiler_node_count = 1;
+    profiler_depth = 0;
+    profiler_m68k_cycles = profiler_z80_cycles = profiler_m68k_lost = profiler_z80_lost = 0;
+
+    for (level = 1; level < 8; level++)
+        profiler_vectors[level] = m68k_read_disassembler_32(0x60 + level * 4) & 0xFFFFFF;
+    profiler_next = get_master_clock() + profiler_period;
+    profiler_last_pc = m68k_get_reg(NULL, M68K_REG_PC) & 0xFFFFFF;
+    profiler_last_sp = m68k_get_reg(NULL, M68K_REG_A7);
+    profiler_pending = PROFILER_NEXT;
+    profiler_running = 1;
+    return 1;
+}
+
+void profiler_stop()
+{
+    profiler_running = 0;
+}
+
+int profiler_is_running()
+{
+    return profiler_running;
+}
+
+/******************************************************************************
+ *
+ *   Profiler 68K
+ *   Called by the instruction hook before the instruction at "pc" runs.
+ *   Samples due are charged to the instruction before, then the call
+ *   tree follows what that instruction did. Interrupts are recognised
+ *   by the PC reaching the autovector handler of the level now masked
+ *   with the stack grown.
+ *
+ ******************************************************************************/
+void profiler_m68k(unsigned int pc)
+{
+    unsigned long long now = get_master_clock(), cycles;
+    unsigned int sp = m68k_get_reg(NULL, M68K_REG_A7);
+    unsigned int level, opcode;
+
+    pc &= 0xFFFFFF;
+    if (now >= profiler_next)
+    {
+        cycles = ((now - profiler_next) / profiler_period + 1) * profiler_period;
+        profiler_next += cycles;
+        profiler_count_add(profiler_m68k_counts, profiler_last_pc, cycles, &profiler_m68k_lost);
+        profiler_nodes[PROFILER_TOP].self += cycles;
+        profiler_m68k_cycles += cycles;
+    }
+
+    if (profiler_pending == PROFILER_RETURN)
+    {
+        // Leave every frame below the stack pointer, returns that skip
+        // frames or jump out of routines unwind too
+        while (profiler_depth && profiler_stack[profiler_depth - 1].sp < sp)
+        {
+            profiler_depth--;
+            profiler_nodes[profiler_stack[profiler_depth].node].inclusive += now - profiler_stack[profiler_depth].clock;
+        }
+    }
+    for (level = 1; level < 8 && pc != profiler_vectors[level]; level++)
+        ;
+    if (level < 8 && sp < profiler_last_sp && ((m68k_get_reg(NULL, M68K_REG_SR) >> 8) & 7) == level)
+        profiler_push(pc, level, sp, now);
+    else if (profiler_pending == PROFILER_CALL)
+        profiler_push(pc, 0, sp, now);
+
+    opcode = m68k_read_disassembler_16(pc);
+    if ((opcode & 0xFFC0) == 0x4E80 || (opcode & 0xFF00) == 0x6100)
+        profiler_pending = PROFILER_CALL;
+    else if (opcode == 0x4E75 || opcode == 0x4E77 || opcode == 0x4E73)
+        profiler_pending = PROFILER_RETURN;
+    else
+        profiler_pending = PROFILER_NEXT;
+    profiler_last_pc = pc;
+    profiler_last_sp = sp;
+}
+
+/******************************************************************************
+ *
+ *   Profiler Z80
+ *   Called after a Z80 timeslice of "cycles" Z80 cycles that ended at "pc"
+ *
+ ******************************************************************************/
+void profiler_z80(unsigned int pc, unsigned int cycles)
+{
+    if (!cycles)
+        return;
+    profiler_count_add(profiler_z80_counts, pc & 0xFFFF, cycles, &profiler_z80_lost);
+    profiler_z80_cycles += cycles;
+}
+
+// 68K cycles sampled since profiler_start
+unsigned long long profiler_get_cycles()
+{
+    return profiler_m68k_cycles;
+}
+
+static int profiler_compare_count(const void *a, const void *b)
+{
+    const profiler_count *x = a, *y = b;
+    if (x->cycles != y->cycles)
+        return x->cycles < y->cycles ? 1 : -1;
+    return (x->address > y->address) - (x->address < y->address);
+}
+
+static int profiler_compare_routine(const void *a, const void *b)
+{
+    const profiler_routine *x = a, *y = b;
+    if (x->inclusive != y->inclusive)
+        return x->inclusive < y->inclusive ? 1 : -1;
+    return (x->entry > y->entry) - (x->entry < y->entry);
+}
+
+static void profiler_write_counts(FILE *file, const profiler_count *counts, int digits)
+{
+    unsigned int i, n = 0;
+
+    for (i = 0; i < PROFILER_SLOTS; i++)
+        if (counts[i].cycles)
+            profiler_sorted[n++] = counts[i];
+    qsort(profiler_sorted, n, sizeof(profiler_count), profiler_compare_count);
+    for (i = 0; i < n; i++)
+        fprintf(file, "%0*x %llu\n", digits, profiler_sorted[i].address, profiler_sorted[i].cycles);
+}
+
+/******************************************************************************
+ *
+ *   Profiler routines
+ *   Merge the call tree nodes of every routine. A routine's inclusive
+ *   cycles leave out recursive calls so they count once, and include
+ *   the routines still running. Returns the routines in
+ *   profiler_routines, by inclusive cycles.
+ *
+ ******************************************************************************/
+static unsigned int profiler_merge()
+{
+    unsigned long long now = get_master_clock();
+    unsigned int i, j, n = 0, node;
+    int recursive;
+
+    memset(profiler_open, 0, sizeof(profiler_open));
+    for (i = 0; i < profiler_depth; i++)
+        profiler_open[profiler_stack[i].node] += now - profiler_stack[i].clock;
+
+    for (i = 1; i < profiler_node_count; i++)
+    {
+        recursive = 0;
+        for (node = profiler_nodes[i].parent; node && !recursive; node = profiler_nodes[node].parent)
+            recursive = profiler_nodes[node].entry == profiler_nodes[i].entry &&
+                        profiler_nodes[node].level == profiler_nodes[i].level;
+        for (j = 0; j < n; j++)
+            if (profiler_routines[j].entry == profiler_nodes[i].entry &&
+                profiler_routines[j].level == profiler_nodes[i].level)
+                break;
+        if (j == n)
+        {
+            memset(&profiler_routines[n], 0, sizeof(profiler_routine));
+            profiler_routines[n].entry = profiler_nodes[i].entry;
+            profiler_routines[n].level = profiler_nodes[i].level;
+            n++;
+        }
+        profiler_routines[j].calls += profiler_nodes[i].calls;
+        profiler_routines[j].self += profiler_nodes[i].self;
+        if (!recursive)
+            profiler_routines[j].inclusive += profiler_nodes[i].inclusive + profiler_open[i];
+    }
+    qsort(profiler_routines, n, sizeof(profiler_routine), profiler_compare_routine);
+    return n;
+}
+
+static void profiler_write_name(FILE *file, unsigned int node)
+{
+    if (profiler_nodes[node].entry == PROFILER_ROOT)
+        fprintf(file, "68k");
+    else if (profiler_nodes[node].level)
+        fprintf(file, "int%u_%06x", profiler_nodes[node].level, profiler_nodes[node].entry);
+    else
+        fprintf(file, "%06x", profiler_nodes[node].entry);
+}
+
+/******************************************************************************
+ *
+ *   Profiler export flat
+ *   Write routines with calls, inclusive and self cycles, then the
+ *   cycles of every instruction address, most expensive first. Returns
+ *   0 when the file can't be written.
+ *
+ ******************************************************************************/
+int profiler_export_flat(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    unsigned int i, n;
+
+    if (!file)
+        return 0;
+    n = profiler_merge();
+    fprintf(file, "# 68k: %llu cycles, sampled every %u, %llu at addresses not counted\n", profiler_m68k_cycles,
+            profiler_period, profiler_m68k_lost);
+    fprintf(file, "# routine calls inclusive self\n");
+    fprintf(file, "68k 0 %llu %llu\n", profiler_m68k_cycles, profiler_nodes[0].self);
+    for (i = 0; i < n; i++)
+    {
+        if (profiler_routines[i].level)
+            fprintf(file, "int%u_", profiler_routines[i].level);
+        fprintf(file, "%06x %u %llu %llu\n", profiler_routines[i].entry, profiler_routines[i].calls,
+                profiler_routines[i].inclusive, profiler_routines[i].self);
+    }
+    fprintf(file, "# address cycles\n");
+    profiler_write_counts(file, profiler_m68k_counts, 6);
+    fprintf(file, "# z80: %llu cycles, sampled per timeslice, %llu at addresses not counted\n", profiler_z80_cycles,
+            profiler_z80_lost);
+    fprintf(file, "# address cycles\n");
+    profiler_write_counts(file, profiler_z80_counts, 4);
+    return !fclose(file);
+}
+
+/******************************************************************************
+ *
+ *   Profiler export collapsed
+ *   Write one "caller;...;routine cycles" line per call path for
+ *   flamegraph.pl and compatible viewers, self cycles of 68K routines
+ *   under "68k" and Z80 addresses under "z80". Returns 0 when the file
+ *   can't be written.
+ *
+ ******************************************************************************/
+int profiler_export_collapsed(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    unsigned int path[PROFILER_DEPTH + 1];
+    unsigned int i, depth, node;
+
+    if (!file)
+        return 0;
+    for (i = 0; i < profiler_node_count; i++)
+    {
+        if (!profiler_nodes[i].self)
+            continue;
+        depth = 0;
+        for (node = i; node; node = profiler_nodes[node].parent)
+            path[depth++] = node;
+        profiler_write_name(file, 0);
+        while (depth--)
+        {
+            fputc(';', file);
+            profiler_write_name(file, path[depth]);
+        }
+        fprintf(file, " %llu\n", profiler_nodes[i].self);
+    }
+    for (i = 0; i < PROFILER_SLOTS; i++)
+        if (profiler_z80_counts[i].cycles)
+            fprintf(file, "z80;%04x %llu\n", profiler_z80_counts[i].address, profiler_z80_counts[i].cycles);
+    return !fclose(file);
+}
@@ -0,0 +1,14 @@
+#define PROFILER_PERIOD 64              // Default 68K cycles between samples
+#define PROFILER_SLOTS 0x4000           // Instruction addresses counted per CPU
+#define PROFILER_NODES 0x2000           // Call tree nodes, one per routine and caller path
+#define PROFILER_DEPTH 64               // Calls and interrupts tracked deep
+#define PROFILER_ROOT 0xFFFFFFFF        // Entry of the call tree root, code outside any tracked call
+
+int profiler_start(unsigned int period);
+void profiler_stop();
+int profiler_is_running();
+void profiler_m68k(unsigned int pc);
+void profiler_z80(unsigned int pc, unsigned int cycles);
+unsigned long long profiler_get_cycles();
+int profiler_export_flat(const char *filename);
+int profiler_export_collapsed(const char *filename);
@@ -0,0 +1,201 @@
+#define _POSIX_C_SOURCE 199309L
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "timing.h"
+
+/******************************************************************************
+ *
+ *   Timing
+ *   Host time spent in every subsystem per frame. Scopes nest, a scope
+ *   opened inside another pauses it so each subsystem gets only its own
+ *   time. frame() ends a frame with timing_frame_done, which moves the
+ *   totals into a window of the last TIMING_WINDOW frames the frontend
+ *   reads percentiles from.
+ *
+ ******************************************************************************/
+
+// Define whether scopes are timed, tested inline by TIMING_BEGIN/TIMING_END
+int timing_enabled = 0;
+
+// Define open scopes of the emulation thread and the totals of this frame
+static unsigned int timing_stack[TIMING_DEPTH];
+static unsigned long long timing_started[TIMING_DEPTH];
+static int timing_depth = 0;
+static unsigned long long timing_frame_start;
+static unsigned long long timing_totals[TIMING_SUBSYSTEMS];
+// Define whether the frame being timed started before timing_start
+static int timing_partial = 0;
+
+// Define window of nanoseconds per frame, read by the frontend
+static pthread_mutex_t timing_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int timing_window[TIMING_SUBSYSTEMS][TIMING_WINDOW];
+static unsigned int timing_next[TIMING_SUBSYSTEMS], timing_count[TIMING_SUBSYSTEMS];
+
+unsigned long long timing_now()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/******************************************************************************
+ *
+ *   Timing start/stop
+ *   Start timing with an empty window. A frame stopped at a breakpoint
+ *   when timing starts is not counted.
+ *
+ ******************************************************************************/
+void timing_start()
+{
+    timing_reset();
+    timing_depth = 0;
+    memset(timing_totals, 0, sizeof(timing_totals));
+    timing_partial = 1;
+    timing_enabled = 1;
+}
+
+void timing_stop()
+{
+    timing_enabled = 0;
+}
+
+void timing_reset()
+{
+    pthread_mutex_lock(&timing_lock);
+    memset(timing_next, 0, sizeof(timing_next));
+    memset(timing_count, 0, sizeof(timing_count));
+    pthread_mutex_unlock(&timing_lock);
+}
+
+/******************************************************************************
+ *
+ *   Timing scope
+ *   TIMING_FRAME is timed whole, every other scope pauses the one it is
+ *   opened in. A scope closed without being open, after timing started
+ *   inside it, is ignored.
+ *
+ ******************************************************************************/
+void timing_begin(unsigned int subsystem)
+{
+    unsigned long long now = timing_now();
+
+    if (subsystem == TIMING_FRAME)
+    {
+        timing_frame_start = now;
+        return;
+    }
+    if (timing_depth == TIMING_DEPTH)
+        return;
+    if (timing_depth)
+        timing_totals[timing_stack[timing_depth - 1]] += now - timing_started[timing_depth - 1];
+    timing_stack[timing_depth] = subsystem;
+    timing_started[timing_depth++] = now;
+}
+
+void timing_end(unsigned int subsystem)
+{
+    unsigned long long now = timing_now();
+
+    if (subsystem == TIMING_FRAME)
+    {
+        if (timing_frame_start)
+            timing_totals[TIMING_FRAME] += now - timing_frame_start;
+        timing_frame_start = 0;
+        return;
+    }
+    if (!timing_depth || timing_stack[timing_depth - 1] != subsystem)
+        return;
+    timing_depth--;
+    timing_totals[subsystem] += now - timing_started[timing_depth];
+    // Resume the scope this one paused
+    if (timing_depth)
+        timing_started[timing_depth - 1] = now;
+}
+
+static void timing_push(unsigned int subsystem, unsigned long long elapsed)
+{
+    timing_window[subsystem][timing_next[subsystem]] = elapsed > 0xFFFFFFFF ? 0xFFFFFFFF : elapsed;
+    timing_next[subsystem] = (timing_next[subsystem] + 1) % TIMING_WINDOW;
+    if (timing_count[subsystem] < TIMING_WINDOW)
+        timing_count[subsystem]++;
+}
+
+/******************************************************************************
+ *
+ *   Timing frame done
+ *   Move the totals of a completed frame into the window, frames stopped
+ *   at breakpoints count once with every part of them
+ *
+ ******************************************************************************/
+void timing_frame_done()
+{
+    unsigned int i;
+
+    if (!timing_enabled)
+        return;
+    if (!timing_partial)
+    {
+        pthread_mutex_lock(&timing_lock);
+        for (i = 0; i < TIMING_SUBSYSTEMS; i++)
+            if (i != TIMING_SCALE)
+                timing_push(i, timing_totals[i]);
+        pthread_mutex_unlock(&timing_lock);
+    }
+    timing_partial = 0;
+    memset(timing_totals, 0, sizeof(timing_totals));
+}
+
+// Add a sample timed outside frame(), from any thread
+void timing_sample(unsigned int subsystem, unsigned long long elapsed)
+{
+    if (subsystem >= TIMING_SUBSYSTEMS)
+        return;
+    pthread_mutex_lock(&timing_lock);
+    timing_push(subsystem, elapsed);
+    pthread_mutex_unlock(&timing_lock);
+}
+
+static int timing_compare(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+    return x < y ? -1 : x > y;
+}
+
+/******************************************************************************
+ *
+ *   Timing stats
+ *   Mean, nearest-rank percentiles and maximum of a subsystem over the
+ *   window, in milliseconds per frame. Returns 0 for a bad subsystem or
+ *   an empty window.
+ *
+ ******************************************************************************/
+int timing_get_stats(unsigned int subsystem, timing_stats *stats)
+{
+    unsigned int sorted[TIMING_WINDOW];
+    unsigned long long sum = 0;
+    unsigned int i, n;
+
+    memset(stats, 0, sizeof(timing_stats));
+    if (subsystem >= TIMING_SUBSYSTEMS)
+        return 0;
+    pthread_mutex_lock(&timing_lock);
+    n = timing_count[subsystem];
+    memcpy(sorted, timing_window[subsystem], n * sizeof(unsigned int));
+    pthread_mutex_unlock(&timing_lock);
+    if (!n)
+        return 0;
+
+    qsort(sorted, n, sizeof(unsigned int), timing_compare);
+    for (i = 0; i < n; i++)
+        sum += sorted[i];
+    stats->frames = n;
+    stats->mean = sum / 1e6 / n;
+    stats->p50 = sorted[(n * 50 + 99) / 100 - 1] / 1e6;
+    stats->p95 = sorted[(n * 95 + 99) / 100 - 1] / 1e6;
+    stats->p99 = sorted[(n * 99 + 99) / 100 - 1] / 1e6;
+    stats->max = sorted[n - 1] / 1e6;
+    return 1;
+}
@@ -0,0 +1,44 @@
+#define TIMING_WINDOW 600               // Frames kept for the percentiles, 10 seconds on NTSC
+#define TIMING_DEPTH 8                  // Nested scopes, DMA inside the 68K inside a frame
+
+// Open and close a scope on the emulation thread, one flag test while off
+#define TIMING_BEGIN(subsystem) \
+    if (timing_enabled)         \
+        timing_begin(subsystem)
+#define TIMING_END(subsystem) \
+    if (timing_enabled)       \
+        timing_end(subsystem)
+
+enum timing_subsystem
+{
+    TIMING_M68K,    // 68K execution, without the DMA and Z80 it triggers
+    TIMING_Z80,     // Z80 execution
+    TIMING_VDP,     // sega3155313_render_line
+    TIMING_DMA,     // 68K, fill and copy DMA
+    TIMING_YM2612,  // YM2612 synthesis
+    TIMING_SCALE,   // Frontend scaling, one sample per scaled frame
+    TIMING_FRAME,   // A whole frame(), everything above but scaling
+    TIMING_SUBSYSTEMS
+};
+
+typedef struct _timing_stats
+{
+    unsigned int frames;    // Samples in the window
+    double mean;            // Milliseconds per frame
+    double p50;
+    double p95;
+    double p99;
+    double max;
+} timing_stats;
+
+extern int timing_enabled;
+
+void timing_start();
+void timing_stop();
+void timing_reset();
+unsigned long long timing_now();
+void timing_begin(unsigned int subsystem);
+void timing_end(unsigned int subsystem);
+void timing_frame_done();
+void timing_sample(unsigned int subsystem, unsigned long long elapsed);
+int timing_get_stats(unsigned int subsystem, timing_stats *stats);
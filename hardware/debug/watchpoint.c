@@ -0,0 +1,238 @@
+#include <pthread.h>
+#include <string.h>
+#include "libs/Musashi/m68k.h"
+#include "watchpoint.h"
+
+/******************************************************************************
+ *
+ *   Watchpoints
+ *   Read, write and value watchpoints on the 68K and Z80 buses and on
+ *   VDP memory. The memory paths test one bit of watchpoint_pages per
+ *   access and only call watchpoint_read/watchpoint_write in pages
+ *   holding a watchpoint, the rest keep their direct path. Hits go to a
+ *   ring the frontend drains with watchpoint_get_hits.
+ *
+ ******************************************************************************/
+
+typedef struct _watchpoint
+{
+    int armed;
+    unsigned int space;
+    unsigned int start, end;    // Inclusive range in the space
+    unsigned int access;        // watchpoint_access flags
+    unsigned int match, mask;
+} watchpoint;
+
+// Define a bit per page holding an armed watchpoint
+unsigned char watchpoint_pages[WATCHPOINT_PAGES / 8];
+static watchpoint watchpoints[WATCHPOINT_MAX];
+
+// Define hit ring, written by the emulation thread and drained by the frontend
+static pthread_mutex_t watchpoint_lock = PTHREAD_MUTEX_INITIALIZER;
+static watchpoint_hit watchpoint_hits[WATCHPOINT_HITS];
+static unsigned int watchpoint_first = 0, watchpoint_count = 0, watchpoint_dropped = 0;
+
+static const unsigned int watchpoint_bases[WATCHPOINT_SPACES] = {
+    WATCHPOINT_M68K_BASE, WATCHPOINT_Z80_BASE, WATCHPOINT_VRAM_BASE, WATCHPOINT_CRAM_BASE, WATCHPOINT_VSRAM_BASE};
+static const unsigned int watchpoint_masks[WATCHPOINT_SPACES] = {0xFFFFFF, 0xFFFF, 0xFFFF, 0x7F, 0x7F};
+
+extern unsigned char *ROM;
+extern unsigned char RAM[], ZRAM[], VRAM[];
+extern unsigned short CRAM[], VSRAM[];
+extern int z80_running;
+
+unsigned long long get_master_clock();
+unsigned long long z80_get_master_clock();
+unsigned short z80_get_reg(int reg_i);
+
+static void watchpoint_update_pages()
+{
+    unsigned int page, last;
+    int i;
+
+    memset(watchpoint_pages, 0, sizeof(watchpoint_pages));
+    for (i = 0; i < WATCHPOINT_MAX; i++)
+    {
+        if (!watchpoints[i].armed)
+            continue;
+        page = watchpoint_bases[watchpoints[i].space] + (watchpoints[i].start >> WATCHPOINT_PAGE_BITS);
+        last = watchpoint_bases[watchpoints[i].space] + (watchpoints[i].end >> WATCHPOINT_PAGE_BITS);
+        for (; page <= last; page++)
+            watchpoint_pages[page >> 3] |= 1 << (page & 7);
+    }
+}
+
+/******************************************************************************
+ *
+ *   Watchpoint set/clear
+ *   Arm watchpoint "index" on "start" to "end" of an address space, for
+ *   reads, writes or both. With WATCHPOINT_VALUE only accesses whose
+ *   value masked with "mask" equals "match" hit. Arm them between
+ *   frames or while the emulation thread is paused. Returns 0 for a bad
+ *   index, space or range.
+ *
+ ******************************************************************************/
+int watchpoint_set(int index, unsigned int space, unsigned int start, unsigned int end, unsigned int access,
+                   unsigned int match, unsigned int mask)
+{
+    if (index < 0 || index >= WATCHPOINT_MAX || space >= WATCHPOINT_SPACES ||
+        !(access & (WATCHPOINT_READ | WATCHPOINT_WRITE)))
+        return 0;
+    start &= watchpoint_masks[space];
+    end &= watchpoint_masks[space];
+    if (end < start)
+        return 0;
+    watchpoints[index].armed = 1;
+    watchpoints[index].space = space;
+    watchpoints[index].start = start;
+    watchpoints[index].end = end;
+    watchpoints[index].access = access;
+    // Without WATCHPOINT_VALUE every value hits, (value & 0) == 0
+    watchpoints[index].match = access & WATCHPOINT_VALUE ? match & mask : 0;
+    watchpoints[index].mask = access & WATCHPOINT_VALUE ? mask : 0;
+    watchpoint_update_pages();
+    return 1;
+}
+
+void watchpoint_clear(int index)
+{
+    if (index < 0 || index >= WATCHPOINT_MAX)
+        return;
+    watchpoints[index].armed = 0;
+    watchpoint_update_pages();
+}
+
+void watchpoint_clear_all()
+{
+    int i;
+    for (i = 0; i < WATCHPOINT_MAX; i++)
+        watchpoints[i].armed = 0;
+    watchpoint_update_pages();
+}
+
+/******************************************************************************
+ *
+ *   Watchpoint peek
+ *   Value at an address without the side effects of a bus read, only
+ *   memory has one
+ *
+ ******************************************************************************/
+static unsigned int watchpoint_peek_byte(unsigned int space, unsigned int address)
+{
+    switch (space)
+    {
+    case WATCHPOINT_M68K:
+        if (address < 0x800000)
+            return ROM[address & 0x3FFFFF];
+        if (address >= 0xE00000)
+            return RAM[address & 0xFFFF];
+        if ((address & 0xFFC000) == 0xA00000)
+            return ZRAM[address & 0x1FFF];
+        return WATCHPOINT_NO_VALUE;
+    case WATCHPOINT_Z80:
+        return address < 0x4000 ? ZRAM[address] : WATCHPOINT_NO_VALUE;
+    case WATCHPOINT_VRAM:
+        return VRAM[address & 0xFFFF];
+    }
+    return WATCHPOINT_NO_VALUE;
+}
+
+static unsigned int watchpoint_peek(unsigned int space, unsigned int address, unsigned int size)
+{
+    unsigned int high, low;
+
+    // CRAM and VSRAM hold words
+    if (space == WATCHPOINT_CRAM)
+        return CRAM[(address & 0x7F) >> 1];
+    if (space == WATCHPOINT_VSRAM)
+        return VSRAM[(address & 0x7F) >> 1];
+    high = watchpoint_peek_byte(space, address);
+    if (size == 1 || high == WATCHPOINT_NO_VALUE)
+        return high;
+    low = watchpoint_peek_byte(space, address + 1);
+    return low == WATCHPOINT_NO_VALUE ? low : high << 8 | low;
+}
+
+/******************************************************************************
+ *
+ *   Watchpoint access
+ *   Record a hit for every watchpoint covering the access, the ring
+ *   drops its oldest hit when full
+ *
+ ******************************************************************************/
+static void watchpoint_access(unsigned int space, unsigned int address, unsigned int size, unsigned int access,
+                              unsigned int old_value, unsigned int new_value)
+{
+    watchpoint_hit *hit;
+    unsigned int last;
+    int i;
+
+    address &= watchpoint_masks[space];
+    last = address + size - 1;
+    for (i = 0; i < WATCHPOINT_MAX; i++)
+    {
+        if (!watchpoints[i].armed || watchpoints[i].space != space || !(watchpoints[i].access & access) ||
+            last < watchpoints[i].start || address > watchpoints[i].end ||
+            (new_value & watchpoints[i].mask) != watchpoints[i].match)
+            continue;
+
+        pthread_mutex_lock(&watchpoint_lock);
+        if (watchpoint_count == WATCHPOINT_HITS)
+        {
+            watchpoint_first = (watchpoint_first + 1) % WATCHPOINT_HITS;
+            watchpoint_count--;
+            watchpoint_dropped++;
+        }
+        hit = &watchpoint_hits[(watchpoint_first + watchpoint_count++) % WATCHPOINT_HITS];
+        hit->index = i;
+        hit->space = space;
+        hit->access = access;
+        hit->address = address;
+        hit->size = size;
+        hit->z80 = z80_running;
+        hit->pc = z80_running ? z80_get_reg(6) : m68k_get_reg(NULL, M68K_REG_PPC) & 0xFFFFFF;
+        hit->cycle = z80_running ? z80_get_master_clock() : get_master_clock();
+        hit->old_value = old_value;
+        hit->new_value = new_value;
+        pthread_mutex_unlock(&watchpoint_lock);
+    }
+}
+
+// Called after a read in a watched page with the value read
+void watchpoint_read(unsigned int space, unsigned int address, unsigned int size, unsigned int value)
+{
+    watchpoint_access(space, address, size, WATCHPOINT_READ, value, value);
+}
+
+// Called before a write in a watched page, while the old value is still there
+void watchpoint_write(unsigned int space, unsigned int address, unsigned int size, unsigned int value)
+{
+    watchpoint_access(space, address, size, WATCHPOINT_WRITE, watchpoint_peek(space, address, size), value);
+}
+
+/******************************************************************************
+ *
+ *   Watchpoint hits
+ *   Move up to "max" hits, oldest first, into "hits" and return how many.
+ *   watchpoint_get_dropped counts the hits the ring lost.
+ *
+ ******************************************************************************/
+unsigned int watchpoint_get_hits(watchpoint_hit *hits, unsigned int max)
+{
+    unsigned int n;
+
+    pthread_mutex_lock(&watchpoint_lock);
+    for (n = 0; n < max && watchpoint_count; n++)
+    {
+        hits[n] = watchpoint_hits[watchpoint_first];
+        watchpoint_first = (watchpoint_first + 1) % WATCHPOINT_HITS;
+        watchpoint_count--;
+    }
+    pthread_mutex_unlock(&watchpoint_lock);
+    return n;
+}
+
+unsigned int watchpoint_get_dropped()
+{
+    return __atomic_load_n(&watchpoint_dropped, __ATOMIC_RELAXED);
+}
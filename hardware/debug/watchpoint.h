@@ -0,0 +1,63 @@
+#define WATCHPOINT_MAX 16               // Watchpoints that can be armed at once
+#define WATCHPOINT_HITS 4096            // Hits kept, the oldest are dropped first
+#define WATCHPOINT_PAGE_BITS 8          // Watched pages of 256 bytes
+#define WATCHPOINT_NO_VALUE 0xFFFFFFFF  // Old value of a write to I/O, unknown without side effects
+
+// Define pages of every address space, one bit each in watchpoint_pages
+#define WATCHPOINT_M68K_BASE 0
+#define WATCHPOINT_Z80_BASE (WATCHPOINT_M68K_BASE + ((1 << 24) >> WATCHPOINT_PAGE_BITS))
+#define WATCHPOINT_VRAM_BASE (WATCHPOINT_Z80_BASE + ((1 << 16) >> WATCHPOINT_PAGE_BITS))
+#define WATCHPOINT_CRAM_BASE (WATCHPOINT_VRAM_BASE + ((1 << 16) >> WATCHPOINT_PAGE_BITS))
+#define WATCHPOINT_VSRAM_BASE (WATCHPOINT_CRAM_BASE + 1)
+#define WATCHPOINT_PAGES (WATCHPOINT_VSRAM_BASE + 8)
+
+// Whether a page holds a watchpoint, one load and test, needs watchpoint_pages
+#define WATCHPOINT_PAGE_ARMED(page) (watchpoint_pages[(page) >> 3] & (1 << ((page) & 7)))
+#define WATCHPOINT_M68K_ARMED(address) \
+    WATCHPOINT_PAGE_ARMED(WATCHPOINT_M68K_BASE + (((address) & 0xFFFFFF) >> WATCHPOINT_PAGE_BITS))
+#define WATCHPOINT_Z80_ARMED(address) \
+    WATCHPOINT_PAGE_ARMED(WATCHPOINT_Z80_BASE + (((address) & 0xFFFF) >> WATCHPOINT_PAGE_BITS))
+#define WATCHPOINT_VRAM_ARMED(address) \
+    WATCHPOINT_PAGE_ARMED(WATCHPOINT_VRAM_BASE + (((address) & 0xFFFF) >> WATCHPOINT_PAGE_BITS))
+#define WATCHPOINT_CRAM_ARMED() WATCHPOINT_PAGE_ARMED(WATCHPOINT_CRAM_BASE)
+#define WATCHPOINT_VSRAM_ARMED() WATCHPOINT_PAGE_ARMED(WATCHPOINT_VSRAM_BASE)
+
+enum watchpoint_space
+{
+    WATCHPOINT_M68K,    // 68K bus, 0x000000 - 0xFFFFFF
+    WATCHPOINT_Z80,     // Z80 bus, 0x0000 - 0xFFFF, accesses of the Z80 itself
+    WATCHPOINT_VRAM,    // VDP VRAM, 0x0000 - 0xFFFF, through the data port and DMA
+    WATCHPOINT_CRAM,    // VDP CRAM, 0x00 - 0x7F
+    WATCHPOINT_VSRAM,   // VDP VSRAM, 0x00 - 0x7F
+    WATCHPOINT_SPACES
+};
+
+enum watchpoint_access
+{
+    WATCHPOINT_READ = 1,
+    WATCHPOINT_WRITE = 2,
+    WATCHPOINT_VALUE = 4    // Only accesses with (value & mask) == match
+};
+
+typedef struct _watchpoint_hit
+{
+    unsigned long long cycle;   // Master clock of the access
+    unsigned int index;         // Watchpoint that matched
+    unsigned int space;         // watchpoint_space
+    unsigned int access;        // WATCHPOINT_READ or WATCHPOINT_WRITE
+    unsigned int address;
+    unsigned int size;          // Bytes accessed
+    unsigned int z80;           // Set when the Z80 made the access
+    unsigned int pc;            // Instruction that made the access, the one starting a DMA for DMA
+    unsigned int old_value;     // Before a write, the value read for reads
+    unsigned int new_value;
+} watchpoint_hit;
+
+int watchpoint_set(int index, unsigned int space, unsigned int start, unsigned int end, unsigned int access,
+                   unsigned int match, unsigned int mask);
+void watchpoint_clear(int index);
+void watchpoint_clear_all();
+void watchpoint_read(unsigned int space, unsigned int address, unsigned int size, unsigned int value);
+void watchpoint_write(unsigned int space, unsigned int address, unsigned int size, unsigned int value);
+unsigned int watchpoint_get_hits(watchpoint_hit *hits, unsigned int max);
+unsigned int watchpoint_get_dropped();
@@ -1,8 +1,10 @@
 #include <string.h>
 #include <stdlib.h>
+#include "hardware/debug/timing.h"
 // #include <libs/hqx/src/hqx.h>
 
-extern unsigned int *screen, *scaled_screen;
+extern unsigned int *scaled_screen;
+unsigned char *sega3155313_peek_frame();
 
 const int width = 320, height = 240;
 int hqx_init = 0;
@@ -221,11 +223,17 @@ struct s_filters
 
 void scale_filter(const char *filter, int scale)
 {
+    unsigned long long start;
+
     for (int i=0; i<sizeof(filters)/sizeof(struct s_filters); i++)
     {
         if (!strcmp(filter, filters[i].name) || scale == 1)
         {
-            (filters[i].fn)(scaled_screen, screen, scale);
+            // Scale the frame the frontend took, timed on the frontend thread
+            start = timing_enabled ? timing_now() : 0;
+            (filters[i].fn)(scaled_screen, (unsigned int *)sega3155313_peek_frame(), scale);
+            if (timing_enabled)
+                timing_sample(TIMING_SCALE, timing_now() - start);
             break;
         }
 
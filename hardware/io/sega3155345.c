@@ -1,18 +1,39 @@
 #include "sega3155345.h"
 #include "hardware/bus/sega3155308.h"
+#include "hardware/system/state.h"
 
 unsigned short button_state[3];
+// Define buttons held on the frontend, latched into button_state at the start of a frame
+unsigned short sega3155345_pad_input[3];
 unsigned short sega3155345_pad_state[3];
 unsigned char io_reg[16] = {0x80, 0x7f, 0x7f, 0x00, 0x7f, 0x7f, 0x40, 0xff, 0, 0, 0xff, 0, 0, 0xff, 0, 0}; /* initial state */
 
 void sega3155345_pad_press_button(int pad, int button)
 {
-    button_state[pad] |= (1 << button);
+    sega3155345_pad_input[pad] |= (1 << button);
 }
 
 void sega3155345_pad_release_button(int pad, int button)
 {
-    button_state[pad] &= ~(1 << button);
+    sega3155345_pad_input[pad] &= ~(1 << button);
+}
+
+/******************************************************************************
+ * 
+ *   Pad buttons
+ *   Presses arrive from the frontend at any time, the pads only see them
+ *   at the start of a frame when set_buttons latches them (see
+ *   movie_frame), so a run does not depend on when keys were handled
+ * 
+ ******************************************************************************/
+unsigned int sega3155345_pad_get_input(int pad)
+{
+    return sega3155345_pad_input[pad];
+}
+
+void sega3155345_pad_set_buttons(int pad, unsigned int buttons)
+{
+    button_state[pad] = buttons;
 }
 
 void sega3155345_pad_write(int pad, int value)
@@ -86,4 +107,17 @@ unsigned int sega3155345_read_ctrl(unsigned int address)
 void sega3155345_set_reg(unsigned int reg, unsigned int value) {
     io_reg[reg] = value;
     return;
-}
\ No newline at end of file
+}
+
+/******************************************************************************
+ * 
+ *   SEGA 315-5345 State
+ *   Hand out the I/O registers and pad lines for state_save
+ * 
+ ******************************************************************************/
+unsigned int sega3155345_state_blocks(state_block *blocks)
+{
+    state_block list[] = {STATE_BLOCK(io_reg), STATE_BLOCK(button_state), STATE_BLOCK(sega3155345_pad_state)};
+    memcpy(blocks, list, sizeof(list));
+    return sizeof(list) / sizeof(list[0]);
+}
@@ -1,5 +1,7 @@
 void sega3155345_pad_press_button(int pad, int button);
 void sega3155345_pad_release_button(int pad, int button);
+unsigned int sega3155345_pad_get_input(int pad);
+void sega3155345_pad_set_buttons(int pad, unsigned int buttons);
 void sega3155345_pad_write(int pad, int value);
 unsigned char sega3155345_pad_read(int pad);
 void sega3155345_write_ctrl(unsigned int address, unsigned int value);
@@ -0,0 +1,215 @@
+#define _POSIX_C_SOURCE 199309L
+#include <pthread.h>
+#include <time.h>
+#include "libs/Musashi/m68k.h"
+#include "emulation.h"
+#include "rewind.h"
+#include "hardware/bus/sega3155308.h"
+#include "hardware/vdp/sega3155313.h"
+#include "hardware/apu/audio.h"
+
+/******************************************************************************
+ *
+ *   Emulation thread
+ *   Runs frames away from the frontend. The frontend only sends commands
+ *   through atomics and takes completed frames with sega3155313_take_frame,
+ *   frame pacing follows the audio ring fill level or the clock.
+ *
+ ******************************************************************************/
+
+#define EMULATION_MCLOCK 53693175   // NTSC master clock
+
+static pthread_t emu_thread;
+// Define thread state and commands, written by the frontend
+static int emu_running = 0;
+static int emu_quit = 0;
+static int emu_paused = 0;
+static int emu_fast_forward = 0;
+static int emu_rewind = 0;
+static int emu_pacing = EMULATION_PACE_AUDIO;
+static unsigned int emu_steps = 0;
+static unsigned int emu_resets = 0;
+// Define completed frames and breakpoint stops, written by the thread
+static unsigned int emu_frames = 0;
+static unsigned int emu_stops = 0;
+
+extern int lines_per_frame;
+int frame();
+
+static double emulation_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void emulation_sleep(double seconds)
+{
+    struct timespec wait;
+    wait.tv_sec = (time_t)seconds;
+    wait.tv_nsec = (long)((seconds - wait.tv_sec) * 1e9);
+    nanosleep(&wait, NULL);
+}
+
+/******************************************************************************
+ *
+ *   Emulation pace
+ *   Wait until the next frame is due. "next" is when the previous frame
+ *   was due and becomes when this one is.
+ *
+ ******************************************************************************/
+static void emulation_pace(double *next)
+{
+    double period = (double)lines_per_frame * M68K_CYCLES_PER_LINE / EMULATION_MCLOCK;
+    double now = emulation_now();
+    unsigned int latency = audio_get_latency();
+
+    if (__atomic_load_n(&emu_pacing, __ATOMIC_RELAXED) == EMULATION_PACE_AUDIO && latency)
+    {
+        // The audio consumer sets the pace, a stalled one only slows frames down
+        while (audio_get_fill() >= latency && now < *next + EMULATION_AUDIO_TIMEOUT * period)
+        {
+            emulation_sleep(EMULATION_POLL_NS / 1e9);
+            now = emulation_now();
+        }
+        *next = now;
+        return;
+    }
+
+    *next += period;
+    if (*next > now)
+        emulation_sleep(*next - now);
+    else if (now - *next > EMULATION_MAX_LAG * period)
+        *next = now;
+}
+
+static void *emulation_loop(void *arg)
+{
+    double next = emulation_now();
+    int rewinding;
+
+    while (!__atomic_load_n(&emu_quit, __ATOMIC_ACQUIRE))
+    {
+        if (__atomic_exchange_n(&emu_resets, 0, __ATOMIC_ACQ_REL))
+        {
+            m68k_pulse_halt();
+            reset_emulation();
+        }
+
+        if (__atomic_load_n(&emu_paused, __ATOMIC_ACQUIRE))
+        {
+            if (!__atomic_load_n(&emu_steps, __ATOMIC_ACQUIRE))
+            {
+                emulation_sleep(EMULATION_POLL_NS / 1e9);
+                next = emulation_now();
+                continue;
+            }
+            __atomic_sub_fetch(&emu_steps, 1, __ATOMIC_ACQ_REL);
+        }
+        else if (!__atomic_load_n(&emu_fast_forward, __ATOMIC_ACQUIRE))
+            emulation_pace(&next);
+        else
+            next = emulation_now();
+
+        // Rewinding loads the previous snapshot and runs a frame to show it
+        rewinding = __atomic_load_n(&emu_rewind, __ATOMIC_ACQUIRE);
+        if (rewinding)
+            rewind_step();
+        if (!frame())
+        {
+            // Stopped inside the frame, the frontend resumes it
+            __atomic_store_n(&emu_steps, 0, __ATOMIC_RELEASE);
+            __atomic_store_n(&emu_paused, 1, __ATOMIC_RELEASE);
+            __atomic_add_fetch(&emu_stops, 1, __ATOMIC_RELEASE);
+            continue;
+        }
+        if (!rewinding)
+            rewind_capture();
+        __atomic_add_fetch(&emu_frames, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+/******************************************************************************
+ *
+ *   Emulation start/stop
+ *   Start the thread once a cartridge is loaded and powered on, stop it
+ *   before touching the core from the frontend in any other way
+ *
+ ******************************************************************************/
+int emulation_start()
+{
+    if (emu_running)
+        return 1;
+    __atomic_store_n(&emu_quit, 0, __ATOMIC_RELEASE);
+    if (pthread_create(&emu_thread, NULL, emulation_loop, NULL))
+        return 0;
+    emu_running = 1;
+    return 1;
+}
+
+void emulation_stop()
+{
+    if (!emu_running)
+        return;
+    __atomic_store_n(&emu_quit, 1, __ATOMIC_RELEASE);
+    pthread_join(emu_thread, NULL);
+    emu_running = 0;
+}
+
+int emulation_running()
+{
+    return emu_running;
+}
+
+/******************************************************************************
+ *
+ *   Emulation commands
+ *   Taken by the thread between frames. Steps run single frames while
+ *   paused, fast forward runs frames without pacing, rewind runs them
+ *   from the rewind history backwards. A breakpoint pauses the thread
+ *   inside a frame, a step or unpausing finishes that frame.
+ *
+ ******************************************************************************/
+void emulation_pause(int paused)
+{
+    if (!paused)
+        __atomic_store_n(&emu_steps, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&emu_paused, paused, __ATOMIC_RELEASE);
+}
+
+void emulation_step()
+{
+    __atomic_add_fetch(&emu_steps, 1, __ATOMIC_ACQ_REL);
+}
+
+void emulation_fast_forward(int enabled)
+{
+    __atomic_store_n(&emu_fast_forward, enabled, __ATOMIC_RELEASE);
+}
+
+void emulation_rewind(int enabled)
+{
+    __atomic_store_n(&emu_rewind, enabled, __ATOMIC_RELEASE);
+}
+
+void emulation_reset()
+{
+    __atomic_add_fetch(&emu_resets, 1, __ATOMIC_ACQ_REL);
+}
+
+void emulation_set_pacing(int pacing)
+{
+    __atomic_store_n(&emu_pacing, pacing, __ATOMIC_RELAXED);
+}
+
+unsigned int emulation_get_frames()
+{
+    return __atomic_load_n(&emu_frames, __ATOMIC_ACQUIRE);
+}
+
+// Times a breakpoint paused the thread, see breakpoint_get_hit for which one
+unsigned int emulation_get_stops()
+{
+    return __atomic_load_n(&emu_stops, __ATOMIC_ACQUIRE);
+}
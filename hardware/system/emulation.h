@@ -0,0 +1,21 @@
+#define EMULATION_POLL_NS 1000000       // Sleep while waiting on a command or the audio ring
+#define EMULATION_AUDIO_TIMEOUT 4       // Frame periods to wait on a stalled audio consumer
+#define EMULATION_MAX_LAG 4             // Frame periods behind the clock before it is reset
+
+enum
+{
+    EMULATION_PACE_AUDIO = 0,   // Run a frame whenever the audio ring drops below its latency
+    EMULATION_PACE_CLOCK        // Run frames at the video rate on the monotonic clock
+};
+
+int emulation_start();
+void emulation_stop();
+int emulation_running();
+void emulation_pause(int paused);
+void emulation_step();
+void emulation_fast_forward(int enabled);
+void emulation_rewind(int enabled);
+void emulation_reset();
+void emulation_set_pacing(int pacing);
+unsigned int emulation_get_frames();
+unsigned int emulation_get_stops();
@@ -0,0 +1,149 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "machine.h"
+#include "state.h"
+#include "rewind.h"
+#include "hardware/bus/sega3155308.h"
+
+/******************************************************************************
+ *
+ *   Machine slots
+ *   Several consoles kept in one process and run one at a time. This is
+ *   not a reentrant context: the core keeps a single machine in its
+ *   globals, and Musashi and the Z80 core a single CPU each. A slot
+ *   holds a machine while it is out of the globals, its save state and
+ *   its cartridge. Locking a slot takes the core lock and swaps it in
+ *   with state_save and state_load, so threads take turns on the core
+ *   between kaiser_machine_lock and kaiser_machine_unlock. Swaps cost a
+ *   full save state and only happen when another slot is locked. Runs in
+ *   parallel need processes, as tools/farm forks its workers.
+ *
+ ******************************************************************************/
+
+struct _kaiser_machine
+{
+    unsigned char *rom;         // Cartridge, ROM points here while in the globals
+    unsigned int rom_hash;
+    unsigned char *state;       // Machine while another slot is in the globals
+};
+
+static pthread_mutex_t kaiser_lock = PTHREAD_MUTEX_INITIALIZER;
+// Define slot of the machine the process starts with, and the one in the globals
+static kaiser_machine kaiser_default;
+static kaiser_machine *kaiser_current = NULL;
+
+extern unsigned char *ROM;
+extern unsigned char ROM_default[MAX_ROM_SIZE];
+extern unsigned int rom_hash;
+
+// The globals belong to the default slot until another one is locked
+static void kaiser_adopt()
+{
+    if (kaiser_current)
+        return;
+    kaiser_default.rom = ROM_default;
+    kaiser_default.state = malloc(state_size());
+    kaiser_current = &kaiser_default;
+}
+
+static void kaiser_swap(kaiser_machine *machine)
+{
+    kaiser_current->rom_hash = rom_hash;
+    state_save(kaiser_current->state);
+
+    ROM = machine->rom;
+    rom_hash = machine->rom_hash;
+    state_load(machine->state, state_size());
+    kaiser_current = machine;
+
+    // The history is of the machine that left
+    rewind_reset();
+}
+
+/******************************************************************************
+ *
+ *   Machine create
+ *   A new slot holds a copy of the machine in the globals, cartridge
+ *   included. Lock it and load a cartridge to run something else.
+ *   Returns NULL when out of memory.
+ *
+ ******************************************************************************/
+kaiser_machine *kaiser_machine_create()
+{
+    kaiser_machine *machine = calloc(1, sizeof(kaiser_machine));
+
+    pthread_mutex_lock(&kaiser_lock);
+    kaiser_adopt();
+    if (machine)
+    {
+        machine->rom = malloc(MAX_ROM_SIZE);
+        machine->state = malloc(state_size());
+    }
+    if (!machine || !machine->rom || !machine->state || !kaiser_default.state)
+    {
+        pthread_mutex_unlock(&kaiser_lock);
+        if (machine)
+        {
+            free(machine->rom);
+            free(machine->state);
+        }
+        free(machine);
+        return NULL;
+    }
+    memcpy(machine->rom, ROM, MAX_ROM_SIZE);
+    machine->rom_hash = rom_hash;
+    state_save(machine->state);
+    pthread_mutex_unlock(&kaiser_lock);
+    return machine;
+}
+
+/******************************************************************************
+ *
+ *   Machine destroy
+ *   The default machine goes back into the globals if "machine" is in
+ *   them. Not while "machine" is locked.
+ *
+ ******************************************************************************/
+void kaiser_machine_destroy(kaiser_machine *machine)
+{
+    if (!machine)
+        return;
+    pthread_mutex_lock(&kaiser_lock);
+    if (kaiser_current == machine)
+    {
+        ROM = kaiser_default.rom;
+        rom_hash = kaiser_default.rom_hash;
+        state_load(kaiser_default.state, state_size());
+        kaiser_current = &kaiser_default;
+        rewind_reset();
+    }
+    pthread_mutex_unlock(&kaiser_lock);
+    free(machine->rom);
+    free(machine->state);
+    free(machine);
+}
+
+/******************************************************************************
+ *
+ *   Machine lock
+ *   Take the core for "machine", NULL for the default machine. Every
+ *   other core call of the thread goes to it until kaiser_machine_unlock,
+ *   other threads wait in kaiser_machine_lock. The emulation thread must
+ *   be stopped.
+ *
+ ******************************************************************************/
+void kaiser_machine_lock(kaiser_machine *machine)
+{
+    pthread_mutex_lock(&kaiser_lock);
+    kaiser_adopt();
+    if (!machine)
+        machine = &kaiser_default;
+    if (machine != kaiser_current && kaiser_default.state)
+        kaiser_swap(machine);
+}
+
+void kaiser_machine_unlock()
+{
+    pthread_mutex_unlock(&kaiser_lock);
+}
@@ -0,0 +1,6 @@
+typedef struct _kaiser_machine kaiser_machine;
+
+kaiser_machine *kaiser_machine_create();
+void kaiser_machine_destroy(kaiser_machine *machine);
+void kaiser_machine_lock(kaiser_machine *machine);
+void kaiser_machine_unlock();
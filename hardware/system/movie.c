@@ -0,0 +1,248 @@
+#include <stdlib.h>
+#include <string.h>
+#include "movie.h"
+#include "state.h"
+#include "hardware/io/sega3155345.h"
+#include "hardware/bus/sega3155308.h"
+
+/******************************************************************************
+ *
+ *   Input movies
+ *   The save state a run starts from, or a power on flag, and the
+ *   buttons of both pads for each of its frames. Pads change only in
+ *   movie_frame at the start of a frame, so playing a movie back repeats
+ *   the run exactly. Start and stop between frames, with the emulation
+ *   thread stopped or paused.
+ *
+ ******************************************************************************/
+
+static int movie_mode = MOVIE_OFF;
+// Define MOVIE_POWER_ON, starting state unless set and the pads of every
+// frame, MOVIE_PADS bytes each
+static int movie_present = 0;
+static unsigned int movie_flags = 0;
+static unsigned char *movie_state = NULL;
+static unsigned char *movie_input = NULL;
+static unsigned int movie_state_size = 0;
+static unsigned int movie_frames = 0, movie_capacity = 0;
+// Define next frame to record or play
+static unsigned int movie_position = 0;
+static unsigned int movie_rom_hash = 0;
+
+extern unsigned int rom_hash;
+extern unsigned char RAM[], ZRAM[];
+
+/******************************************************************************
+ *
+ *   Movie frame
+ *   Called by frame() before anything runs: the pads take the buttons
+ *   of the movie while playing, or the ones held on the frontend
+ *
+ ******************************************************************************/
+void movie_frame()
+{
+    unsigned char *input;
+    int pad;
+
+    if (movie_mode == MOVIE_PLAY && movie_position == movie_frames)
+        movie_mode = MOVIE_OFF;
+    if (movie_mode == MOVIE_PLAY)
+    {
+        input = movie_input + movie_position++ * MOVIE_PADS;
+        for (pad = 0; pad < MOVIE_PADS; pad++)
+            sega3155345_pad_set_buttons(pad, input[pad]);
+        if (movie_position == movie_frames)
+            movie_mode = MOVIE_OFF;
+        return;
+    }
+
+    for (pad = 0; pad < MOVIE_PADS; pad++)
+        sega3155345_pad_set_buttons(pad, sega3155345_pad_get_input(pad));
+    if (movie_mode != MOVIE_RECORD)
+        return;
+    if (movie_frames == movie_capacity)
+    {
+        input = realloc(movie_input, (movie_capacity ? movie_capacity * 2 : 3600) * MOVIE_PADS);
+        if (!input)
+        {
+            // Keep what was recorded so far
+            movie_mode = MOVIE_OFF;
+            return;
+        }
+        movie_input = input;
+        movie_capacity = movie_capacity ? movie_capacity * 2 : 3600;
+    }
+    input = movie_input + movie_frames++ * MOVIE_PADS;
+    for (pad = 0; pad < MOVIE_PADS; pad++)
+        input[pad] = sega3155345_pad_get_input(pad);
+    movie_position = movie_frames;
+}
+
+static int movie_alloc_state()
+{
+    free(movie_state);
+    movie_state_size = state_size();
+    movie_state = malloc(movie_state_size);
+    return movie_state != NULL;
+}
+
+/******************************************************************************
+ *
+ *   Movie power on
+ *   Machine as load_cartridge, power_on and reset_emulation leave it,
+ *   recording and playing start the same way
+ *
+ ******************************************************************************/
+static void movie_power_on()
+{
+    memset(RAM, 0, MAX_RAM_SIZE);
+    memset(ZRAM, 0, MAX_Z80_RAM_SIZE);
+    power_on();
+    reset_emulation();
+}
+
+/******************************************************************************
+ *
+ *   Movie record
+ *   Start a movie from the machine as it is, or powered on again when
+ *   "power_on" is set, which records no state. Returns 0 without
+ *   memory.
+ *
+ ******************************************************************************/
+int movie_record(int power_on)
+{
+    movie_mode = MOVIE_OFF;
+    movie_frames = movie_position = 0;
+    movie_present = 0;
+    free(movie_state);
+    movie_state = NULL;
+    movie_state_size = 0;
+    movie_flags = power_on ? MOVIE_POWER_ON : 0;
+    if (power_on)
+        movie_power_on();
+    else if (!movie_alloc_state())
+        return 0;
+    else
+        state_save(movie_state);
+    movie_rom_hash = rom_hash;
+    movie_present = 1;
+    movie_mode = MOVIE_RECORD;
+    return 1;
+}
+
+/******************************************************************************
+ *
+ *   Movie play
+ *   Power on or load the starting state of "movie" and play its frames.
+ *   Returns 0 and leaves the machine alone when it is from another build
+ *   or cartridge.
+ *
+ ******************************************************************************/
+int movie_play(const unsigned char *movie, unsigned int size)
+{
+    movie_header header;
+    unsigned char *input;
+    unsigned int expected;
+
+    if (size < sizeof(movie_header))
+        return 0;
+    memcpy(&header, movie, sizeof(header));
+    expected = (header.flags & MOVIE_POWER_ON) ? 0 : state_size();
+    if (memcmp(header.magic, MOVIE_MAGIC, sizeof(header.magic)) || header.version != MOVIE_VERSION ||
+        header.rom_hash != rom_hash || header.state_size != expected ||
+        size < sizeof(header) + header.state_size ||
+        (size - sizeof(header) - header.state_size) / MOVIE_PADS < header.frames)
+        return 0;
+
+    movie_mode = MOVIE_OFF;
+    input = malloc(header.frames * MOVIE_PADS + 1);
+    if (!input)
+        return 0;
+    if (header.flags & MOVIE_POWER_ON)
+    {
+        free(movie_state);
+        movie_state = NULL;
+        movie_state_size = 0;
+        movie_power_on();
+    }
+    else if (!movie_alloc_state())
+    {
+        free(input);
+        movie_present = 0;
+        return 0;
+    }
+    else
+    {
+        memcpy(movie_state, movie + sizeof(header), movie_state_size);
+        if (!state_load(movie_state, movie_state_size))
+        {
+            free(input);
+            movie_present = 0;
+            return 0;
+        }
+    }
+    movie_flags = header.flags & MOVIE_POWER_ON;
+    movie_present = 1;
+    free(movie_input);
+    movie_input = input;
+    memcpy(movie_input, movie + sizeof(header) + movie_state_size, header.frames * MOVIE_PADS);
+    movie_frames = movie_capacity = header.frames;
+    movie_position = 0;
+    movie_rom_hash = rom_hash;
+    movie_mode = MOVIE_PLAY;
+    return 1;
+}
+
+// The movie is kept for movie_save
+void movie_stop()
+{
+    movie_mode = MOVIE_OFF;
+}
+
+int movie_get_mode()
+{
+    return movie_mode;
+}
+
+unsigned int movie_get_frame()
+{
+    return movie_position;
+}
+
+unsigned int movie_get_frames()
+{
+    return movie_frames;
+}
+
+/******************************************************************************
+ *
+ *   Movie save
+ *   Write the movie last recorded or played to "buffer" of movie_size()
+ *   bytes, returns the size, 0 without a movie
+ *
+ ******************************************************************************/
+unsigned int movie_size()
+{
+    if (!movie_present)
+        return 0;
+    return sizeof(movie_header) + movie_state_size + movie_frames * MOVIE_PADS;
+}
+
+unsigned int movie_save(unsigned char *buffer)
+{
+    movie_header header;
+
+    if (!movie_present)
+        return 0;
+    memcpy(header.magic, MOVIE_MAGIC, sizeof(header.magic));
+    header.version = MOVIE_VERSION;
+    header.rom_hash = movie_rom_hash;
+    header.flags = movie_flags;
+    header.state_size = movie_state_size;
+    header.frames = movie_frames;
+    memcpy(buffer, &header, sizeof(header));
+    if (movie_state_size)
+        memcpy(buffer + sizeof(header), movie_state, movie_state_size);
+    memcpy(buffer + sizeof(header) + movie_state_size, movie_input, movie_frames * MOVIE_PADS);
+    return movie_size();
+}
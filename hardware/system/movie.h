@@ -0,0 +1,31 @@
+#define MOVIE_MAGIC "KMOV"
+#define MOVIE_VERSION 2
+#define MOVIE_PADS 2            // Pads recorded per frame, a byte of sega3155308_pad_button bits each
+#define MOVIE_POWER_ON 0x01     // Flag of a movie starting from power on, it has no starting state
+
+enum
+{
+    MOVIE_OFF = 0,              // Pads follow the frontend
+    MOVIE_RECORD,               // Pads follow the frontend and every frame is recorded
+    MOVIE_PLAY                  // Pads follow the movie until its last frame
+};
+
+typedef struct _movie_header
+{
+    char magic[4];              // MOVIE_MAGIC
+    unsigned int version;       // MOVIE_VERSION
+    unsigned int rom_hash;      // Cartridge the movie belongs to, see load_cartridge
+    unsigned int flags;         // MOVIE_POWER_ON
+    unsigned int state_size;    // Bytes of the starting save state after this header, 0 from power on
+    unsigned int frames;        // Frames of MOVIE_PADS bytes after the state
+} movie_header;
+
+void movie_frame();
+int movie_record(int power_on);
+int movie_play(const unsigned char *movie, unsigned int size);
+void movie_stop();
+int movie_get_mode();
+unsigned int movie_get_frame();
+unsigned int movie_get_frames();
+unsigned int movie_size();
+unsigned int movie_save(unsigned char *buffer);
@@ -0,0 +1,355 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rewind.h"
+#include "state.h"
+
+/******************************************************************************
+ *
+ *   Rewind
+ *   History of machine states in a fixed memory budget. The thread that
+ *   runs frames only copies a state aside, a worker XORs it against the
+ *   newest state it kept and stores the difference zero run length
+ *   encoded in a byte ring, dropping the oldest entries when the budget
+ *   is used up. Deltas lead backwards from the newest state, so a step
+ *   back is one decode and a state_load, running a frame after it
+ *   brings back the picture.
+ *
+ ******************************************************************************/
+
+typedef struct _rewind_entry
+{
+    unsigned int offset;    // Position in rewind_ring
+    unsigned int size;
+} rewind_entry;
+
+static pthread_t rewind_thread;
+static pthread_mutex_t rewind_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rewind_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t rewind_idle = PTHREAD_COND_INITIALIZER;
+static int rewind_running = 0;
+static int rewind_quit = 0;
+static int rewind_busy = 0;
+
+// Define states: captured and waiting, being encoded, newest one kept
+static unsigned char *rewind_pending, *rewind_work, *rewind_head;
+static int rewind_pending_full = 0;
+static int rewind_has_head = 0;
+static unsigned int rewind_state_size = 0;
+static unsigned int rewind_interval = REWIND_INTERVAL, rewind_frame = 0;
+
+// Define ring of encoded deltas and its index, oldest entry first
+static unsigned char *rewind_ring;
+static unsigned int rewind_budget = 0;
+static rewind_entry rewind_entries[REWIND_MAX_ENTRIES];
+static unsigned int rewind_first = 0, rewind_count = 0, rewind_bytes = 0;
+// Define encoder output, large enough for the worst case delta
+static unsigned char *rewind_encoded;
+
+static unsigned char *rewind_write_varint(unsigned char *p, unsigned int value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = value | 0x80;
+        value >>= 7;
+    }
+    *p++ = value;
+    return p;
+}
+
+static const unsigned char *rewind_read_varint(const unsigned char *p, unsigned int *value)
+{
+    unsigned int shift = 0;
+    *value = 0;
+    do
+    {
+        *value |= (*p & 0x7F) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    return p;
+}
+
+/******************************************************************************
+ *
+ *   Rewind delta
+ *   Encode "next" XOR "prev" as pairs of an unchanged byte count and a
+ *   changed byte count followed by those bytes XORed. Applying it to
+ *   either state gives the other one.
+ *
+ ******************************************************************************/
+static unsigned int rewind_encode(const unsigned char *next, const unsigned char *prev, unsigned int size,
+                                  unsigned char *output)
+{
+    unsigned char *p = output;
+    unsigned long long a, b;
+    unsigned int i = 0, start;
+
+    while (i < size)
+    {
+        start = i;
+        for (; i + 8 <= size; i += 8)
+        {
+            memcpy(&a, next + i, 8);
+            memcpy(&b, prev + i, 8);
+            if (a != b)
+                break;
+        }
+        while (i < size && next[i] == prev[i])
+            i++;
+        p = rewind_write_varint(p, i - start);
+
+        start = i;
+        while (i < size && next[i] != prev[i])
+            i++;
+        p = rewind_write_varint(p, i - start);
+        for (; start < i; start++)
+            *p++ = next[start] ^ prev[start];
+    }
+    return p - output;
+}
+
+static void rewind_apply(unsigned char *state, const unsigned char *delta, unsigned int size)
+{
+    const unsigned char *end = delta + size;
+    unsigned int i = 0, count;
+
+    while (delta < end)
+    {
+        delta = rewind_read_varint(delta, &count);
+        i += count;
+        delta = rewind_read_varint(delta, &count);
+        for (; count; count--)
+            state[i++] ^= *delta++;
+    }
+}
+
+/******************************************************************************
+ *
+ *   Rewind store
+ *   Append a delta after the newest one, wrapping to the start of the
+ *   ring, and drop the oldest deltas in its way
+ *
+ ******************************************************************************/
+static void rewind_drop_oldest()
+{
+    rewind_bytes -= rewind_entries[rewind_first].size;
+    rewind_first = (rewind_first + 1) % REWIND_MAX_ENTRIES;
+    rewind_count--;
+}
+
+static void rewind_store(const unsigned char *delta, unsigned int size)
+{
+    rewind_entry *entry;
+    unsigned int offset = 0;
+
+    if (size > rewind_budget)
+    {
+        // Older states are out of reach without this delta
+        rewind_first = rewind_count = rewind_bytes = 0;
+        return;
+    }
+    if (rewind_count)
+    {
+        entry = &rewind_entries[(rewind_first + rewind_count - 1) % REWIND_MAX_ENTRIES];
+        offset = entry->offset + entry->size;
+    }
+    if (offset + size > rewind_budget)
+    {
+        // The oldest entries sit between the newest one and the end
+        while (rewind_count && rewind_entries[rewind_first].offset >= offset)
+            rewind_drop_oldest();
+        offset = 0;
+    }
+    while (rewind_count && (rewind_count == REWIND_MAX_ENTRIES ||
+           (rewind_entries[rewind_first].offset < offset + size &&
+            offset < rewind_entries[rewind_first].offset + rewind_entries[rewind_first].size)))
+        rewind_drop_oldest();
+
+    entry = &rewind_entries[(rewind_first + rewind_count) % REWIND_MAX_ENTRIES];
+    entry->offset = offset;
+    entry->size = size;
+    memcpy(rewind_ring + offset, delta, size);
+    rewind_bytes += size;
+    rewind_count++;
+}
+
+static void *rewind_loop(void *arg)
+{
+    unsigned char *swap;
+
+    pthread_mutex_lock(&rewind_lock);
+    for (;;)
+    {
+        while (!rewind_pending_full && !rewind_quit)
+            pthread_cond_wait(&rewind_wake, &rewind_lock);
+        if (rewind_quit)
+            break;
+        swap = rewind_work;
+        rewind_work = rewind_pending;
+        rewind_pending = swap;
+        rewind_pending_full = 0;
+        rewind_busy = 1;
+        pthread_mutex_unlock(&rewind_lock);
+
+        if (rewind_has_head)
+            rewind_store(rewind_encoded, rewind_encode(rewind_work, rewind_head, rewind_state_size, rewind_encoded));
+        swap = rewind_head;
+        rewind_head = rewind_work;
+        rewind_work = swap;
+        rewind_has_head = 1;
+
+        pthread_mutex_lock(&rewind_lock);
+        rewind_busy = 0;
+        pthread_cond_broadcast(&rewind_idle);
+    }
+    pthread_mutex_unlock(&rewind_lock);
+    return NULL;
+}
+
+static void rewind_free()
+{
+    free(rewind_pending);
+    free(rewind_work);
+    free(rewind_head);
+    free(rewind_encoded);
+    free(rewind_ring);
+    rewind_pending = rewind_work = rewind_head = rewind_encoded = rewind_ring = NULL;
+}
+
+// Wait with rewind_lock held until the worker has stored everything
+static void rewind_wait_idle()
+{
+    while (rewind_busy || rewind_pending_full)
+        pthread_cond_wait(&rewind_idle, &rewind_lock);
+}
+
+/******************************************************************************
+ *
+ *   Rewind init
+ *   Keep "budget" bytes of deltas, a snapshot every "interval" frames.
+ *   Returns 0 when the buffers can't be allocated.
+ *
+ ******************************************************************************/
+int rewind_init(unsigned int budget, unsigned int interval)
+{
+    rewind_shutdown();
+    rewind_state_size = state_size();
+    rewind_budget = budget;
+    rewind_interval = interval ? interval : 1;
+    rewind_pending = malloc(rewind_state_size);
+    rewind_work = malloc(rewind_state_size);
+    rewind_head = malloc(rewind_state_size);
+    rewind_encoded = malloc(rewind_state_size * 2 + 16);
+    rewind_ring = malloc(budget);
+    rewind_quit = 0;
+    rewind_pending_full = 0;
+    rewind_reset();
+    if (!rewind_pending || !rewind_work || !rewind_head || !rewind_encoded || !rewind_ring ||
+        pthread_create(&rewind_thread, NULL, rewind_loop, NULL))
+    {
+        rewind_free();
+        return 0;
+    }
+    rewind_running = 1;
+    return 1;
+}
+
+void rewind_shutdown()
+{
+    if (!rewind_running)
+        return;
+    pthread_mutex_lock(&rewind_lock);
+    rewind_quit = 1;
+    pthread_cond_signal(&rewind_wake);
+    pthread_mutex_unlock(&rewind_lock);
+    pthread_join(rewind_thread, NULL);
+    rewind_free();
+    rewind_running = 0;
+}
+
+/******************************************************************************
+ *
+ *   Rewind reset
+ *   Forget the history, on cartridge changes
+ *
+ ******************************************************************************/
+void rewind_reset()
+{
+    pthread_mutex_lock(&rewind_lock);
+    rewind_wait_idle();
+    rewind_first = rewind_count = rewind_bytes = 0;
+    rewind_has_head = 0;
+    rewind_frame = 0;
+    pthread_mutex_unlock(&rewind_lock);
+}
+
+/******************************************************************************
+ *
+ *   Rewind capture
+ *   Call after every frame from the thread that runs them. Costs a
+ *   state_save, a snapshot is skipped while the worker is still busy
+ *   with the previous one.
+ *
+ ******************************************************************************/
+void rewind_capture()
+{
+    int full;
+
+    if (!rewind_running || ++rewind_frame < rewind_interval)
+        return;
+    rewind_frame = 0;
+    pthread_mutex_lock(&rewind_lock);
+    full = rewind_pending_full;
+    pthread_mutex_unlock(&rewind_lock);
+    if (full)
+        return;
+
+    state_save(rewind_pending);
+    pthread_mutex_lock(&rewind_lock);
+    rewind_pending_full = 1;
+    pthread_cond_signal(&rewind_wake);
+    pthread_mutex_unlock(&rewind_lock);
+}
+
+/******************************************************************************
+ *
+ *   Rewind step
+ *   Load the snapshot before the newest one and make it the newest.
+ *   With no older one left the oldest is loaded again and 0 returned.
+ *
+ ******************************************************************************/
+int rewind_step()
+{
+    rewind_entry *entry;
+    int stepped = 0;
+
+    if (!rewind_running)
+        return 0;
+    pthread_mutex_lock(&rewind_lock);
+    rewind_wait_idle();
+    if (rewind_has_head)
+    {
+        if (rewind_count)
+        {
+            entry = &rewind_entries[(rewind_first + rewind_count - 1) % REWIND_MAX_ENTRIES];
+            rewind_apply(rewind_head, rewind_ring + entry->offset, entry->size);
+            rewind_bytes -= entry->size;
+            rewind_count--;
+            stepped = 1;
+        }
+        state_load(rewind_head, rewind_state_size);
+    }
+    rewind_frame = 0;
+    pthread_mutex_unlock(&rewind_lock);
+    return stepped;
+}
+
+unsigned int rewind_get_count()
+{
+    return __atomic_load_n(&rewind_count, __ATOMIC_RELAXED);
+}
+
+unsigned int rewind_get_bytes()
+{
+    return __atomic_load_n(&rewind_bytes, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,11 @@
+#define REWIND_BUDGET (32 << 20)    // Default bytes of compressed history
+#define REWIND_INTERVAL 1           // Default frames between two snapshots
+#define REWIND_MAX_ENTRIES 65536    // Snapshots the history can index
+
+int rewind_init(unsigned int budget, unsigned int interval);
+void rewind_shutdown();
+void rewind_reset();
+void rewind_capture();
+int rewind_step();
+unsigned int rewind_get_count();
+unsigned int rewind_get_bytes();
@@ -0,0 +1,123 @@
+#include <string.h>
+#include "libs/Musashi/m68k.h"
+#include "state.h"
+#include "hardware/debug/disasm.h"
+
+/******************************************************************************
+ *
+ *   Save states
+ *   The whole machine as one contiguous, versioned buffer: a header, the
+ *   Musashi context, then every block the modules hand out, copied with
+ *   memcpy in a fixed order. Save and load between frames, with the
+ *   emulation thread stopped or paused. Output buffers (frames, audio
+ *   ring) and frontend settings are not part of a state.
+ *
+ ******************************************************************************/
+
+// Define blocks of all modules, collected once, their addresses never change
+static state_block state_blocks[STATE_MAX_BLOCKS];
+static unsigned int state_block_count = 0;
+static unsigned int state_blocks_size = 0;
+
+extern unsigned int rom_hash;
+extern unsigned int sega3155313_vram_writes;
+
+unsigned int m68k_state_blocks(state_block *blocks);
+unsigned int sega3155308_state_blocks(state_block *blocks);
+unsigned int sega3155313_state_blocks(state_block *blocks);
+unsigned int sega3155345_state_blocks(state_block *blocks);
+unsigned int z80_state_blocks(state_block *blocks);
+unsigned int ym2612_state_blocks(state_block *blocks);
+unsigned int sn76489_state_blocks(state_block *blocks);
+
+static void state_collect()
+{
+    unsigned int (*const modules[])(state_block *) = {
+        m68k_state_blocks, sega3155308_state_blocks, sega3155313_state_blocks, sega3155345_state_blocks,
+        z80_state_blocks, ym2612_state_blocks, sn76489_state_blocks};
+    unsigned int i;
+
+    if (state_block_count)
+        return;
+    for (i = 0; i < sizeof(modules) / sizeof(modules[0]); i++)
+        state_block_count += modules[i](state_blocks + state_block_count);
+    for (i = 0; i < state_block_count; i++)
+        state_blocks_size += state_blocks[i].size;
+}
+
+/******************************************************************************
+ *
+ *   State size
+ *   Bytes state_save writes, constant for a build
+ *
+ ******************************************************************************/
+unsigned int state_size()
+{
+    state_collect();
+    return sizeof(state_header) + m68k_context_size() + state_blocks_size;
+}
+
+/******************************************************************************
+ *
+ *   State save
+ *   Write the machine to "buffer" of state_size() bytes, returns the size
+ *
+ ******************************************************************************/
+unsigned int state_save(unsigned char *buffer)
+{
+    state_header header;
+    unsigned char *p = buffer + sizeof(state_header);
+    unsigned int i;
+
+    memcpy(header.magic, STATE_MAGIC, sizeof(header.magic));
+    header.version = STATE_VERSION;
+    header.size = state_size();
+    header.rom_hash = rom_hash;
+    memcpy(buffer, &header, sizeof(header));
+
+    p += m68k_get_context(p);
+    for (i = 0; i < state_block_count; i++)
+    {
+        memcpy(p, state_blocks[i].data, state_blocks[i].size);
+        p += state_blocks[i].size;
+    }
+    return header.size;
+}
+
+/******************************************************************************
+ *
+ *   State load
+ *   Restore the machine from a state_save buffer. Returns 0 and leaves
+ *   the machine alone when it is from another build or cartridge.
+ *
+ ******************************************************************************/
+int state_load(const unsigned char *buffer, unsigned int size)
+{
+    state_header header;
+    const unsigned char *p = buffer + sizeof(state_header);
+    unsigned int i;
+
+    if (size < sizeof(state_header))
+        return 0;
+    memcpy(&header, buffer, sizeof(header));
+    if (memcmp(header.magic, STATE_MAGIC, sizeof(header.magic)) || header.version != STATE_VERSION ||
+        header.size != state_size() || size < header.size || header.rom_hash != rom_hash)
+        return 0;
+
+    // The context holds callbacks and cycle tables of the process that
+    // saved it, point them back into this one
+    m68k_set_context((void *)p);
+    m68k_set_cpu_type(M68K_CPU_TYPE_68000);
+    m68k_init();
+    p += m68k_context_size();
+    for (i = 0; i < state_block_count; i++)
+    {
+        memcpy(state_blocks[i].data, p, state_blocks[i].size);
+        p += state_blocks[i].size;
+    }
+
+    // Memory changed behind the bus
+    disasm_flush();
+    sega3155313_vram_writes++;
+    return 1;
+}
@@ -0,0 +1,24 @@
+#define STATE_MAGIC "KSAV"
+#define STATE_VERSION 2
+#define STATE_MAX_BLOCKS 96     // Blocks all modules hand out together
+
+// Block for a variable, see the *_state_blocks functions
+#define STATE_BLOCK(variable) {&(variable), sizeof(variable)}
+
+typedef struct _state_block
+{
+    void *data;
+    unsigned int size;
+} state_block;
+
+typedef struct _state_header
+{
+    char magic[4];              // STATE_MAGIC
+    unsigned int version;       // STATE_VERSION
+    unsigned int size;          // Whole state including this header
+    unsigned int rom_hash;      // Cartridge the state belongs to, see load_cartridge
+} state_header;
+
+unsigned int state_size();
+unsigned int state_save(unsigned char *buffer);
+int state_load(const unsigned char *buffer, unsigned int size);
@@ -2,6 +2,10 @@
 #include <string.h>
 #include "libs/Musashi/m68k.h"
 #include "sega3155313.h"
+#include "hardware/apu/sn76489.h"
+#include "hardware/system/state.h"
+#include "hardware/debug/watchpoint.h"
+#include "hardware/debug/timing.h"
 
 // Setup VDP Memory
 unsigned char VRAM[VRAM_MAX_SIZE];           // VRAM
@@ -11,8 +15,17 @@ unsigned char SAT_CACHE[SAT_CACHE_MAX_SIZE]; // Sprite cache
 unsigned char sega3155313_regs[REG_SIZE];    // Registers
 unsigned short fifo[FIFO_SIZE];              // Fifo
 
-// Define screen buffers: original and scaled
-unsigned char *screen, *scaled_screen;
+// Define frames owned by the VDP: one being rendered, the latest complete
+// one and the one the frontend holds, each with its active area size
+static unsigned char vdp_frame[VDP_FRAMES][VDP_FRAME_BYTES];
+static int vdp_frame_width[VDP_FRAMES] = {320, 320, 320};
+static int vdp_frame_height[VDP_FRAMES] = {224, 224, 224};
+static unsigned int vdp_back = 0, vdp_front = 2;
+// Define latest complete frame, VDP_FRAME_FRESH until the frontend takes it
+static unsigned int vdp_latest = 1;
+
+// Define screen buffers: frame being rendered and scaled
+unsigned char *screen = vdp_frame[0], *scaled_screen;
 
 // Define VDP control code and set initial code
 int control_code = 0;
@@ -44,6 +57,17 @@ int mode_pal;
 // Store last address r/w
 unsigned int sega3155313_laddress_r=0;
 unsigned int sega3155313_laddress_w=0;
+// Count VRAM writes, debuggers redraw tiles only when it changes
+unsigned int sega3155313_vram_writes = 0;
+
+// Watched pages, see hardware/debug/watchpoint.c
+extern unsigned char watchpoint_pages[WATCHPOINT_PAGES / 8];
+
+// VDP trace, port traffic stamped with master clock deltas
+static FILE *vdp_trace = NULL;
+static unsigned long long vdp_trace_clock = 0;
+
+unsigned long long get_master_clock();
 
 /******************************************************************************
  * 
@@ -54,7 +78,7 @@ unsigned int sega3155313_laddress_w=0;
 #define set_pixel(scr, x, y, index)                                                           \
     do                                                                                        \
     {                                                                                         \
-        int pixel = ((240 - screen_height) / 2 + (y)) * 320 + (x) + (320 - screen_width) / 2; \
+        int pixel = (y) * 320 + (x);                                                          \
         scr[pixel * 4 + 0] = (CRAM[index] >> 4) & 0xe0;                                       \
         scr[pixel * 4 + 1] = (CRAM[index]) & 0xe0;                                            \
         scr[pixel * 4 + 2] = (CRAM[index] << 4) & 0xe0;                                       \
@@ -62,16 +86,89 @@ unsigned int sega3155313_laddress_w=0;
 
 /******************************************************************************
  * 
- *  SEGA 315-5313 screen buffers
- *  Set original and scaled screen buffer     
+ *  SEGA 315-5313 scaled buffer
+ *  Set the buffer scale filters write to
  * 
  ******************************************************************************/
-void sega3155313_set_buffers(unsigned char *screen_buffer, unsigned char *scaled_buffer)
+void sega3155313_set_scaled_buffer(unsigned char *scaled_buffer)
 {
-    screen = screen_buffer;
     scaled_screen = scaled_buffer;
 }
 
+/******************************************************************************
+ * 
+ *  SEGA 315-5313 Frame handoff
+ *  Frames are rendered at the top left of a 320x240 buffer, 320 * 4 bytes
+ *  per line. A complete frame is swapped with the latest one, the
+ *  frontend swaps the latest one with the frame it holds, so neither side
+ *  ever sees a buffer the other is using and nothing is copied.
+ *  sega3155313_take_frame does that swap and hands the held frame back to
+ *  the VDP, take once per displayed frame and read it again with
+ *  sega3155313_peek_frame, which never swaps.
+ * 
+ ******************************************************************************/
+static void sega3155313_publish_frame()
+{
+    vdp_frame_width[vdp_back] = screen_width;
+    vdp_frame_height[vdp_back] = screen_height;
+    vdp_back = __atomic_exchange_n(&vdp_latest, vdp_back | VDP_FRAME_FRESH, __ATOMIC_ACQ_REL) & ~VDP_FRAME_FRESH;
+    screen = vdp_frame[vdp_back];
+}
+
+unsigned char *sega3155313_take_frame()
+{
+    if (__atomic_load_n(&vdp_latest, __ATOMIC_ACQUIRE) & VDP_FRAME_FRESH)
+        vdp_front = __atomic_exchange_n(&vdp_latest, vdp_front, __ATOMIC_ACQ_REL) & ~VDP_FRAME_FRESH;
+    return vdp_frame[vdp_front];
+}
+
+unsigned char *sega3155313_peek_frame()
+{
+    return vdp_frame[vdp_front];
+}
+
+int sega3155313_get_frame_width()
+{
+    return vdp_frame_width[vdp_front];
+}
+
+int sega3155313_get_frame_height()
+{
+    return vdp_frame_height[vdp_front];
+}
+
+/******************************************************************************
+ * 
+ *  SEGA 315-5313 Trace
+ *  Event type, master clocks since the previous event as a varint and
+ *  the event payload, 16 bit values little endian
+ * 
+ ******************************************************************************/
+static void sega3155313_trace_varint(unsigned long long value)
+{
+    do
+    {
+        fputc((value & 0x7F) | (value > 0x7F ? 0x80 : 0), vdp_trace);
+        value >>= 7;
+    } while (value);
+}
+
+static void sega3155313_trace_word(unsigned int value)
+{
+    fputc(value & 0xFF, vdp_trace);
+    fputc((value >> 8) & 0xFF, vdp_trace);
+}
+
+static void sega3155313_trace_event(unsigned int type)
+{
+    unsigned long long now = get_master_clock();
+    fputc(type, vdp_trace);
+    // The Z80 clock may trail the 68K one, never go back in time
+    sega3155313_trace_varint(now > vdp_trace_clock ? now - vdp_trace_clock : 0);
+    if (now > vdp_trace_clock)
+        vdp_trace_clock = now;
+}
+
 /******************************************************************************
  * 
  *  SEGA 315-5313 Reset
@@ -80,7 +177,10 @@ void sega3155313_set_buffers(unsigned char *screen_buffer, unsigned char *scaled
  ******************************************************************************/
 void sega3155313_reset()
 {
+    if (vdp_trace)
+        sega3155313_trace_event(TRACE_RESET);
     memset(VRAM, 0, VRAM_MAX_SIZE);
+    sega3155313_vram_writes++;
     memset(CRAM, 0, CRAM_MAX_SIZE);
     memset(VSRAM, 0, VSRAM_MAX_SIZE);
 }
@@ -113,6 +213,8 @@ void sega3155313_clear_hblank()
 void sega3155313_set_vblank()
 {
     sega3155313_status |= 8;
+    // Active display is over, hand the frame to the frontend
+    sega3155313_publish_frame();
 }
 
 /******************************************************************************
@@ -122,6 +224,9 @@ void sega3155313_set_vblank()
  ******************************************************************************/
 void sega3155313_clear_vblank()
 {
+    // VBLANK ends as the frame starts
+    if (vdp_trace)
+        sega3155313_trace_event(TRACE_FRAME);
     sega3155313_status &= ~8;
 }
 
@@ -273,6 +378,12 @@ unsigned int sega3155313_read_memory_16(unsigned int address)
     {
     case 0x0:
     case 0x2:
+        // Data port reads move the address, keep them in the trace
+        if (vdp_trace)
+        {
+            sega3155313_trace_event(TRACE_READ);
+            fputc(address & 0x1F, vdp_trace);
+        }
         return sega3155313_read_data_port_16();
     case 0x4:
     case 0x6:
@@ -320,6 +431,8 @@ unsigned int sega3155313_read_data_port_16()
             // No byteswapping here
             value = VRAM[(control_address)&0xFFFE] << 8;
             value |= VRAM[(control_address | 1) & 0xFFFF];
+            if (WATCHPOINT_VRAM_ARMED(control_address))
+                watchpoint_read(WATCHPOINT_VRAM, control_address & 0xFFFE, 2, value);
             control_address += REG15_DMA_INCREMENT;
             control_address &= 0xFFFF;
             sega3155313_laddress_r = control_address;
@@ -329,6 +442,8 @@ unsigned int sega3155313_read_data_port_16()
                 value = VSRAM[0];
             else
                 value = VSRAM[(control_address & 0x7f) >> 1];
+            if (WATCHPOINT_VSRAM_ARMED())
+                watchpoint_read(WATCHPOINT_VSRAM, control_address & 0x7E, 2, value);
             value = (value & VSRAM_BITMASK) | (fifo[3] & ~VSRAM_BITMASK);
             control_address += REG15_DMA_INCREMENT;
             control_address &= 0x7F;
@@ -336,6 +451,8 @@ unsigned int sega3155313_read_data_port_16()
             return value;
         case 0x8:
             value = CRAM[(control_address & 0x7f) >> 1];
+            if (WATCHPOINT_CRAM_ARMED())
+                watchpoint_read(WATCHPOINT_CRAM, control_address & 0x7E, 2, value);
             value = (value & CRAM_BITMASK) | (fifo[3] & ~CRAM_BITMASK);
             control_address += REG15_DMA_INCREMENT;
             control_address &= 0x7F;
@@ -343,6 +460,8 @@ unsigned int sega3155313_read_data_port_16()
             return value;
         case 0xC: /* 8-Bit memory access */
             value = VRAM[(control_address ^ 1) & 0xFFFF];
+            if (WATCHPOINT_VRAM_ARMED(control_address))
+                watchpoint_read(WATCHPOINT_VRAM, (control_address ^ 1) & 0xFFFF, 1, value);
             value = (value & VRAM8_BITMASK) | (fifo[3] & ~VRAM8_BITMASK);
             control_address += REG15_DMA_INCREMENT;
             control_address &= 0xFFFF;
@@ -370,7 +489,7 @@ void sega3155313_write_memory_8(unsigned int address, unsigned int value)
     case 0x13:
     case 0x15:
     case 0x17:
-        // SN76489 TODO
+        sn76489_write(value);
         return;
     default:
         sega3155313_write_memory_16(address & ~1, (value << 8) | value);
@@ -386,6 +505,13 @@ void sega3155313_write_memory_8(unsigned int address, unsigned int value)
  ******************************************************************************/
 void sega3155313_write_memory_16(unsigned int address, unsigned int value)
 {
+    if (vdp_trace)
+    {
+        sega3155313_trace_event(TRACE_WRITE);
+        fputc(address & 0x1F, vdp_trace);
+        sega3155313_trace_word(value);
+    }
+
     switch (address & 0x1F)
     {
     case 0x0:
@@ -476,13 +602,13 @@ void sega3155313_write_data_port_16(unsigned int value)
             sega3155313_laddress_w = control_address;
             break;
         case 0x3: /* CRAM write */
-            CRAM[(control_address & 0x7f) >> 1] = value;
+            sega3155313_cram_write(control_address, value);
             control_address += REG15_DMA_INCREMENT;
             control_address &= 0xFFFF;
             sega3155313_laddress_w = control_address;
             break;
         case 0x5: /* VSRAM write */
-            VSRAM[(control_address & 0x7f) >> 1] = value;
+            sega3155313_vsram_write(control_address, value);
             control_address += REG15_DMA_INCREMENT;
             control_address &= 0xFFFF;
             sega3155313_laddress_w = control_address;
@@ -502,7 +628,9 @@ void sega3155313_write_data_port_16(unsigned int value)
     if (dma_fill_pending)
     {
         dma_fill_pending = 0;
+        TIMING_BEGIN(TIMING_DMA);
         sega3155313_dma_fill(value);
+        TIMING_END(TIMING_DMA);
     }
 }
 
@@ -984,10 +1112,24 @@ void sega3155313_render_window(int line, int priority)
  ******************************************************************************/
 void sega3155313_render_line(int line)
 {
+    if (vdp_trace)
+    {
+        sega3155313_trace_event(TRACE_LINE);
+        sega3155313_trace_word(line);
+        fputc((screen_width == 320 ? 1 : 0) | (screen_height == 240 ? 2 : 0), vdp_trace);
+    }
+
     /* TODO */
     mode_h40 = REG12_MODE_H40;
     mode_pal = REG1_PAL;
 
+    /* Blank the line while the display is disabled */
+    if (!REG1_DISP_ENABLED)
+    {
+        memset(screen + line * 320 * 4, 0, screen_width * 4);
+        return;
+    }
+
     /* Fill the screen with the backdrop color set in register 7 */
     for (int i = 0; i < screen_width; i++)
     {
@@ -1020,7 +1162,9 @@ void sega3155313_dma_trigger()
     {
     case 0:
     case 1:
+        TIMING_BEGIN(TIMING_DMA);
         sega3155313_dma_m68k();
+        TIMING_END(TIMING_DMA);
         break;
 
     case 2:
@@ -1029,7 +1173,9 @@ void sega3155313_dma_trigger()
         break;
 
     case 3:
+        TIMING_BEGIN(TIMING_DMA);
         sega3155313_dma_copy();
+        TIMING_END(TIMING_DMA);
         break;
     }
 }
@@ -1067,7 +1213,7 @@ void sega3155313_dma_fill(unsigned int value)
         case 0x3: // undocumented and buggy, see vdpfifotesting
             do
             {
-                CRAM[(control_address & 0x7f) >> 1] = fifo[3];
+                sega3155313_cram_write(control_address, fifo[3]);
                 control_address += REG15_DMA_INCREMENT;
                 dma_source++;
             } while (--dma_length);
@@ -1075,7 +1221,7 @@ void sega3155313_dma_fill(unsigned int value)
         case 0x5: // undocumented and buggy, see vdpfifotesting:
             do
             {
-                VSRAM[(control_address & 0x7f) >> 1] = fifo[3];
+                sega3155313_vsram_write(control_address, fifo[3]);
                 control_address += REG15_DMA_INCREMENT;
                 dma_source++;
             } while (--dma_length);
@@ -1111,9 +1257,18 @@ void sega3155313_dma_m68k()
 
     if (dma_length == 0)
         dma_length = 0xFFFF;
+
+    // 68K memory is not part of the trace, record the words fetched
+    if (vdp_trace)
+    {
+        sega3155313_trace_event(TRACE_DMA);
+        sega3155313_trace_varint(dma_length);
+    }
     do
     {
         unsigned int value = m68k_read_memory_16((dma_source_high | dma_source_low) << 1);
+        if (vdp_trace)
+            sega3155313_trace_word(value);
         push_fifo(value);
 
         if (control_code & 0x1)
@@ -1125,10 +1280,10 @@ void sega3155313_dma_m68k()
                 sega3155313_vram_write((control_address ^ 1) & 0xFFFF, value & 0xFF);
                 break;
             case 0x3:
-                CRAM[(control_address & 0x7f) >> 1] = value;
+                sega3155313_cram_write(control_address, value);
                 break;
             case 0x5:
-                VSRAM[(control_address & 0x7f) >> 1] = value;
+                sega3155313_vsram_write(control_address, value);
                 break;
             default:
                 printf("Invalid code during DMA fill\n");
@@ -1186,7 +1341,10 @@ void sega3155313_dma_copy()
 void sega3155313_vram_write(unsigned int address, unsigned int value)
 {
     unsigned int sat_address;
+    if (WATCHPOINT_VRAM_ARMED(address))
+        watchpoint_write(WATCHPOINT_VRAM, address, 1, value & 0xFF);
     VRAM[address] = value;
+    sega3155313_vram_writes++;
     // Update internal SAT Cache
     // used in Castlevania Bloodlines
     if (address >= REG5_SAT_ADDRESS && address < REG5_SAT_ADDRESS + REG5_SAT_SIZE)
@@ -1198,57 +1356,33 @@ void sega3155313_vram_write(unsigned int address, unsigned int value)
 
 /******************************************************************************
  * 
- *   SEGA 315-5313 Get Status
- *   Return current VDP Status
+ *   SEGA 315-5313 CRAM/VSRAM Write
+ *   Write a word to CRAM or VSRAM at the byte address of the data port
  * 
  ******************************************************************************/
-unsigned int sega3155313_get_status()
+void sega3155313_cram_write(unsigned int address, unsigned int value)
 {
-    return sega3155313_status;
+    if (WATCHPOINT_CRAM_ARMED())
+        watchpoint_write(WATCHPOINT_CRAM, address & 0x7E, 2, value & 0xFFFF);
+    CRAM[(address & 0x7f) >> 1] = value;
 }
 
-/******************************************************************************
- * 
- *  SEGA 315-5313 Debug Status
- *  Get current debug status and return it.     
- * 
- ******************************************************************************/
-void sega3155313_get_debug_status(char *s)
+void sega3155313_vsram_write(unsigned int address, unsigned int value)
 {
-    int i = 0;
-    s[0] = 0;
-    s += sprintf(s, "ADDRESS: \t");
-    s += sprintf(s, "[R] %04x\n", sega3155313_laddress_r);
-    s += sprintf(s, "\t\t[W] %04x\n\n", sega3155313_laddress_w);
-    s += sprintf(s, "DMA: \t\t");
-    s += sprintf(s, "%s\n", REG1_DMA_ENABLED ? "ENABLED" : "DISABLED");
-    s += sprintf(s, " - ADDRESS\t\t%04x\n", dma_source);
-    s += sprintf(s, " - LENGTH\t\t%04x\n\n",dma_length);
-    s += sprintf(s, "STATUS: \t");
-    s += sprintf(s, "%04x \n", sega3155313_status);
-    s += sprintf(s, "PLANE A: \t\t");
-    s += sprintf(s, "%04x \n", REG2_NAMETABLE_A);
-    s += sprintf(s, "PLANE B: \t\t");
-    s += sprintf(s, "%04x \n", REG4_NAMETABLE_B);
-    s += sprintf(s, "PLANE WINDOW: \t\t");
-    s += sprintf(s, "%04x \n", REG3_NAMETABLE_W*0x400);
-    s += sprintf(s, "HCOUNTER: \t\t");
-    s += sprintf(s, "%04x \n", REG10_COLUMN_COUNTER);
-    s += sprintf(s, "VCOUNTER: \t\t");
-    s += sprintf(s, "%04x \n", REG10_LINE_COUNTER);
-    s += sprintf(s, "HSCROLL: \t\t");
-    s += sprintf(s, "%04x \n", REG13_HSCROLL_ADDRESS);
+    if (WATCHPOINT_VSRAM_ARMED())
+        watchpoint_write(WATCHPOINT_VSRAM, address & 0x7E, 2, value & 0xFFFF);
+    VSRAM[(address & 0x7f) >> 1] = value;
 }
 
 /******************************************************************************
  * 
- *   SEGA 315-5313 Get CRAM
- *   Return current CRAM buffer
+ *   SEGA 315-5313 Get Status
+ *   Return current VDP Status
  * 
  ******************************************************************************/
-unsigned short sega3155313_get_cram(int index)
+unsigned int sega3155313_get_status()
 {
-    return CRAM[index & 0x3f];
+    return sega3155313_status;
 }
 
 /******************************************************************************
@@ -1319,4 +1453,107 @@ void sega3155313_get_cram_raw(unsigned char *raw_buffer)
     {
         raw_buffer[color] = CRAM[color];
     }
-}
\ No newline at end of file
+}
+/******************************************************************************
+ * 
+ *   SEGA 315-5313 Trace open
+ *   Record VDP traffic to "filename": TRACE_MAGIC, TRACE_VERSION and a
+ *   snapshot of registers, memories and port state, then one event per
+ *   port write, data port read, 68K DMA, rendered line and frame start.
+ *   tools/vdpreplay renders the frames again from the trace alone.
+ * 
+ ******************************************************************************/
+int sega3155313_trace_open(const char *filename)
+{
+    int i;
+
+    sega3155313_trace_close();
+    vdp_trace = fopen(filename, "wb");
+    if (!vdp_trace)
+        return 0;
+    vdp_trace_clock = get_master_clock();
+
+    fwrite(TRACE_MAGIC, 1, 4, vdp_trace);
+    fputc(TRACE_VERSION, vdp_trace);
+    fwrite(sega3155313_regs, 1, REG_SIZE, vdp_trace);
+    fwrite(VRAM, 1, VRAM_MAX_SIZE, vdp_trace);
+    fwrite(SAT_CACHE, 1, SAT_CACHE_MAX_SIZE, vdp_trace);
+    for (i = 0; i < CRAM_MAX_SIZE; i++)
+        sega3155313_trace_word(CRAM[i]);
+    for (i = 0; i < VSRAM_MAX_SIZE; i++)
+        sega3155313_trace_word(VSRAM[i]);
+    for (i = 0; i < FIFO_SIZE; i++)
+        sega3155313_trace_word(fifo[i]);
+    sega3155313_trace_word(control_code);
+    sega3155313_trace_word(control_address);
+    fputc(control_pending, vdp_trace);
+    fputc(dma_fill_pending, vdp_trace);
+    sega3155313_trace_word(sega3155313_status);
+    sega3155313_trace_word(screen_width);
+    sega3155313_trace_word(screen_height);
+    return 1;
+}
+
+void sega3155313_trace_close()
+{
+    if (vdp_trace)
+        fclose(vdp_trace);
+    vdp_trace = NULL;
+}
+
+/******************************************************************************
+ * 
+ *   SEGA 315-5313 Trace restore
+ *   Load the snapshot at the start of a trace held in memory. Returns
+ *   the offset of the first event, 0 if "data" is not a trace.
+ * 
+ ******************************************************************************/
+long sega3155313_trace_restore(const unsigned char *data, long size)
+{
+    const unsigned char *p = data;
+    int i;
+
+    if (size < TRACE_SNAPSHOT_SIZE || memcmp(p, TRACE_MAGIC, 4) || p[4] != TRACE_VERSION)
+        return 0;
+    p += 5;
+    memcpy(sega3155313_regs, p, REG_SIZE);
+    p += REG_SIZE;
+    memcpy(VRAM, p, VRAM_MAX_SIZE);
+    sega3155313_vram_writes++;
+    p += VRAM_MAX_SIZE;
+    memcpy(SAT_CACHE, p, SAT_CACHE_MAX_SIZE);
+    p += SAT_CACHE_MAX_SIZE;
+    for (i = 0; i < CRAM_MAX_SIZE; i++, p += 2)
+        CRAM[i] = p[0] | p[1] << 8;
+    for (i = 0; i < VSRAM_MAX_SIZE; i++, p += 2)
+        VSRAM[i] = p[0] | p[1] << 8;
+    for (i = 0; i < FIFO_SIZE; i++, p += 2)
+        fifo[i] = p[0] | p[1] << 8;
+    control_code = p[0] | p[1] << 8;
+    control_address = p[2] | p[3] << 8;
+    control_pending = p[4];
+    dma_fill_pending = p[5];
+    sega3155313_status = p[6] | p[7] << 8;
+    screen_width = p[8] | p[9] << 8;
+    screen_height = p[10] | p[11] << 8;
+    return TRACE_SNAPSHOT_SIZE;
+}
+
+/******************************************************************************
+ * 
+ *   SEGA 315-5313 State
+ *   Hand out the VDP memories, registers and port latches for state_save
+ * 
+ ******************************************************************************/
+unsigned int sega3155313_state_blocks(state_block *blocks)
+{
+    state_block list[] = {
+        STATE_BLOCK(VRAM), STATE_BLOCK(CRAM), STATE_BLOCK(VSRAM), STATE_BLOCK(SAT_CACHE),
+        STATE_BLOCK(sega3155313_regs), STATE_BLOCK(fifo), STATE_BLOCK(control_code),
+        STATE_BLOCK(control_address), STATE_BLOCK(control_pending), STATE_BLOCK(sega3155313_status),
+        STATE_BLOCK(screen_width), STATE_BLOCK(screen_height), STATE_BLOCK(dma_fill_pending),
+        STATE_BLOCK(hvcounter_latch), STATE_BLOCK(hvcounter_latched), STATE_BLOCK(mode_h40),
+        STATE_BLOCK(mode_pal), STATE_BLOCK(sega3155313_laddress_r), STATE_BLOCK(sega3155313_laddress_w)};
+    memcpy(blocks, list, sizeof(list));
+    return sizeof(list) / sizeof(list[0]);
+}
@@ -45,7 +45,30 @@
 #define Z80_FREQ_DIVISOR 14       // Frequency divisor to Z80 clock
 #define M68K_CYCLES_PER_LINE 3420 // M68K Cycles per Line
 
-void sega3155313_set_buffers(unsigned char *screen_buffer, unsigned char *scaled_buffer);
+#define VDP_FRAMES 3                  // Frames owned by the VDP
+#define VDP_FRAME_BYTES (320 * 240 * 4) // Frame size, 320 * 4 bytes per line
+#define VDP_FRAME_FRESH 4             // Latest frame not taken by the frontend yet
+
+#define TRACE_MAGIC "KVDT"        // VDP trace signature
+#define TRACE_VERSION 1           // VDP trace format version
+#define TRACE_SNAPSHOT_SIZE (5 + REG_SIZE + VRAM_MAX_SIZE + SAT_CACHE_MAX_SIZE + \
+                             2 * (CRAM_MAX_SIZE + VSRAM_MAX_SIZE + FIFO_SIZE) + 12)
+
+enum sega3155313_trace_event
+{
+    TRACE_WRITE = 0, // Port write: port, 16 bit value
+    TRACE_READ,      // Data port read: port
+    TRACE_DMA,       // 68K DMA: varint word count, the words read
+    TRACE_LINE,      // Line rendered: 16 bit line, bit 0 H40 width, bit 1 240 lines
+    TRACE_FRAME,     // Frame start
+    TRACE_RESET      // VDP memories cleared
+};
+
+void sega3155313_set_scaled_buffer(unsigned char *scaled_buffer);
+unsigned char *sega3155313_take_frame();
+unsigned char *sega3155313_peek_frame();
+int sega3155313_get_frame_width();
+int sega3155313_get_frame_height();
 void sega3155313_reset();
 void sega3155313_set_hblank();
 void sega3155313_clear_hblank();
@@ -77,9 +100,12 @@ void sega3155313_dma_fill(unsigned int value);
 void sega3155313_dma_m68k();
 void sega3155313_dma_copy();
 void sega3155313_vram_write(unsigned int address, unsigned int value);
+void sega3155313_cram_write(unsigned int address, unsigned int value);
+void sega3155313_vsram_write(unsigned int address, unsigned int value);
 unsigned int sega3155313_get_status();
-void sega3155313_get_debug_status(char *s);
-unsigned short sega3155313_get_cram(int index);
 void sega3155313_get_vram(unsigned char *raw_buffer, int palette);
 void sega3155313_get_vram_raw(unsigned char *raw_buffer);
-void sega3155313_get_cram_raw(unsigned char *raw_buffer);
\ No newline at end of file
+void sega3155313_get_cram_raw(unsigned char *raw_buffer);
+int sega3155313_trace_open(const char *filename);
+void sega3155313_trace_close();
+long sega3155313_trace_restore(const unsigned char *data, long size);
\ No newline at end of file
@@ -18,6 +18,7 @@ from PyQt5 import QtCore as qt
 from PyQt5 import QtWidgets as qtw
 from PyQt5 import QtGui as qtg
 from PyQt5 import QtMultimedia as qtm
+from PyQt5 import sip
 
 
 '''
@@ -28,9 +29,15 @@ is_windows = hasattr(sys, 'getwindowsversion')
 
 # Import Core as DLL
 core = CDLL('./core.dll' if is_windows else './core.so')
+core.sega3155313_take_frame.restype = c_void_p
+core.sega3155313_peek_frame.restype = c_void_p
+core.emulation_get_frames.restype = c_uint
+core.emulation_get_stops.restype = c_uint
 
 # Define default directories
 screenshot_dir = './screenshots'
+states_dir = './states'
+movies_dir = './movies'
 dumps_dir = './dumps'
 
 # Define default Keyboard Mapping for Joypads
@@ -50,6 +57,106 @@ for button, keys in keymap.items():
     keymap_r[keys[0]] = (button, 0)
     keymap_r[keys[1]] = (button, 1)
 
+
+
+class DebugState(Structure):
+    '''
+    Core state for the debugger windows, mirrors debug_state in
+    hardware/debug/debug.h and is filled by core.debug_snapshot
+    '''
+    _fields_ = [
+        ('version', c_uint),
+        ('size', c_uint),
+        ('master_clock', c_ulonglong),
+        ('frames', c_uint),
+        ('m68k_cycles', c_uint),
+        ('m68k_regs', c_uint * 20),
+        ('z80_regs', c_ushort * 8),
+        ('vdp_regs', c_ubyte * 0x20),
+        ('cram', c_ushort * 0x40),
+        ('vsram', c_ushort * 0x40),
+        ('vdp_status', c_uint),
+        ('vdp_hvcounter', c_uint),
+        ('vdp_control_code', c_uint),
+        ('vdp_control_address', c_uint),
+        ('vdp_control_pending', c_uint),
+        ('vdp_read_address', c_uint),
+        ('vdp_write_address', c_uint),
+        ('dma_source', c_uint),
+        ('dma_length', c_uint),
+        ('dma_fill_pending', c_uint),
+        ('vram_writes', c_uint),
+    ]
+
+
+# Define snapshot of the core shared by all debugger windows
+debug_state = DebugState()
+debug_state_version = 1  # DEBUG_SNAPSHOT_VERSION
+core.debug_snapshot(byref(debug_state))
+if (debug_state.version != debug_state_version
+        or debug_state.size != sizeof(DebugState)):
+    sys.exit('core debug_state does not match kaiser.py, rebuild the core')
+
+
+class WatchpointHit(Structure):
+    '''
+    One watchpoint hit, mirrors watchpoint_hit in
+    hardware/debug/watchpoint.h and is filled by core.watchpoint_get_hits
+    '''
+    _fields_ = [
+        ('cycle', c_ulonglong),
+        ('index', c_uint),
+        ('space', c_uint),
+        ('access', c_uint),
+        ('address', c_uint),
+        ('size', c_uint),
+        ('z80', c_uint),
+        ('pc', c_uint),
+        ('old_value', c_uint),
+        ('new_value', c_uint),
+    ]
+
+
+class TimingStats(Structure):
+    '''
+    Milliseconds per frame of a subsystem, mirrors timing_stats in
+    hardware/debug/timing.h and is filled by core.timing_get_stats
+    '''
+    _fields_ = [
+        ('frames', c_uint),
+        ('mean', c_double),
+        ('p50', c_double),
+        ('p95', c_double),
+        ('p99', c_double),
+        ('max', c_double),
+    ]
+
+
+# Define timed subsystems in timing_subsystem order
+timing_names = ['68k', 'z80', 'vdp', 'dma', 'ym2612', 'scale', 'frame']
+timing_stats = TimingStats()
+
+# Define watchpoint spaces and accesses, see hardware/debug/watchpoint.h
+watch_spaces = ['68k', 'z80', 'vram', 'cram', 'vsram']
+watch_read = 1
+watch_write = 2
+watch_no_value = 0xFFFFFFFF
+watch_hits = (WatchpointHit * 256)()
+
+
+class DisasmLine(Structure):
+    '''
+    One disassembled instruction, mirrors disasm_line in
+    hardware/debug/disasm.h and is filled by core.disasm_m68k/disasm_z80
+    '''
+    _fields_ = [
+        ('address', c_uint),
+        ('length', c_uint),
+        ('target', c_uint),
+        ('text', c_char * 64),
+    ]
+
+
 # Define M68K registers
 registers = ['d0', 'd1', 'd2', 'd3', 'd4', 'd5', 'd6', 'd7',
              'a0', 'a1', 'a2', 'a3', 'a4', 'a5', 'a6', 'a7',
@@ -57,12 +164,20 @@ registers = ['d0', 'd1', 'd2', 'd3', 'd4', 'd5', 'd6', 'd7',
 # Define Z80 registers
 z80_registers = ['af', 'bc', 'de', 'hl', 'ix', 'iy','pc','sp']
 
-# Allocate Screen and Scaled Screen Buffers
-screen_buffer = create_string_buffer(320*240*4)
+# Allocate Scaled Screen Buffer, frames themselves are owned by the core
 scaled_buffer = create_string_buffer(320*240*4)
-# Allocate Audio Stream
-audio_buffer_size = 8192
-audio_buffer = create_string_buffer(audio_buffer_size)
+# Define Audio Stream format and sizes in stereo frames
+audio_rate = 44100
+audio_format_s16 = 0  # MIXER_FORMAT_S16
+audio_latency_frames = 2048
+audio_read_frames = 4096
+# Define emulation thread pacing on the clock, EMULATION_PACE_CLOCK
+emulation_pace_clock = 1
+# Define rewind history: bytes of compressed snapshots and frames between them
+rewind_budget = 32 << 20
+rewind_interval = 1
+# Define key held to run the emulation backwards
+rewind_key = qt.Qt.Key_Backspace
 # Define cycle_counter
 cycle_counter = 0
 # Define status bar as global
@@ -96,6 +211,30 @@ class Cartridge(object):
         return self.title
 
 
+class AudioStream(qt.QIODevice):
+    '''
+    Audio device pulling frames from the core audio ring.
+    '''
+
+    def __init__(self, parent=None):
+        super().__init__(parent)
+        self.frame_bytes = core.audio_get_frame_bytes()
+        self.buffer = create_string_buffer(audio_read_frames * self.frame_bytes)
+        self.open(qt.QIODevice.ReadOnly)
+
+    def readData(self, maxlen):
+        # The core pads missing frames, always hand back what was asked
+        frames = min(maxlen // self.frame_bytes, audio_read_frames)
+        core.audio_read(self.buffer, frames)
+        return self.buffer.raw[:frames * self.frame_bytes]
+
+    def writeData(self, data):
+        return 0
+
+    def bytesAvailable(self):
+        return core.audio_get_fill() * self.frame_bytes + super().bytesAvailable()
+
+
 class Joypads(qtw.QLabel):
     '''
     Controller mapping help window.
@@ -140,8 +279,8 @@ class CramDebug(qtw.QWidget):
         # Iterate over 4 palettes in CRAM (16 colors each)
         for y in range(4):
             for x in range(16):
-                # Get color from CRAM Buffer on VDP
-                color = core.sega3155313_get_cram(y*16+x)
+                # Get color from CRAM in the debug snapshot
+                color = debug_state.cram[y*16+x]
                 # Convert 12-bits palette to RGB
                 red, green, blue = color >> 8, color >> 4, color
                 red, green, blue = (blue & 15) * \
@@ -188,6 +327,7 @@ class VramDebug(qtw.QWidget):
         self.height = 400                   # Set Window Height
         self.width = 520                    # Set Window Width
         self.scroll_position = 0            # Set Scroller Position at 0
+        self.vram_key = None                # VRAM writes and palette drawn
 
         # Allocate a buffer to VRAM Display
         self.vram_buffer = create_string_buffer(2048*64*4)
@@ -231,6 +371,13 @@ class VramDebug(qtw.QWidget):
         Updates VRAM Display
         '''
         super().update()
+        self.sega3155313_regs_status.setText(self.register_status())
+        # Redraw the tiles only when VRAM or the palette changed
+        key = (debug_state.vram_writes, bytes(debug_state.cram)[:32],
+               self.scroll_position)
+        if key == self.vram_key:
+            return
+        self.vram_key = key
         # Get VRAM Buffer from VDP
         core.sega3155313_get_vram(self.vram_buffer, 1)
         # Create an RGB32 Image from VRAM Buffer
@@ -244,7 +391,6 @@ class VramDebug(qtw.QWidget):
         pixmap.scroll(0, 864-self.scroll_position, pixmap.rect())
         # Set pixmap in VRAM Display
         self.display_dump.setPixmap(pixmap)
-        self.sega3155313_regs_status.setText(self.register_status())
 
     def pagination(self):
         '''
@@ -254,9 +400,27 @@ class VramDebug(qtw.QWidget):
         self.scroll_position = self.s1.value()
     
     def register_status(self):
-        registers = create_string_buffer(1024)
-        core.sega3155313_get_debug_status(registers)
-        return registers.value.decode()
+        '''
+        Format VDP status from the debug snapshot
+        '''
+        regs = debug_state.vdp_regs
+        return ('ADDRESS: \t[R] {:04x}\n\t\t[W] {:04x}\n\n'
+                'DMA: \t\t{}\n - ADDRESS\t\t{:06x}\n - LENGTH\t\t{:04x}\n\n'
+                'STATUS: \t{:04x} \n'
+                'PLANE A: \t\t{:04x} \n'
+                'PLANE B: \t\t{:04x} \n'
+                'PLANE WINDOW: \t\t{:04x} \n'
+                'HVCOUNTER: \t\t{:04x} \n'
+                'HSCROLL: \t\t{:04x} \n').format(
+            debug_state.vdp_read_address, debug_state.vdp_write_address,
+            'ENABLED' if regs[1] & 0x10 else 'DISABLED',
+            debug_state.dma_source, debug_state.dma_length,
+            debug_state.vdp_status,
+            (regs[2] >> 3 & 7) << 13,
+            (regs[4] & 7) << 13,
+            (regs[3] >> 1 & 0x1f) * 0x400,
+            debug_state.vdp_hvcounter,
+            regs[13] << 10)
 
     def dump(self):
         '''
@@ -294,6 +458,8 @@ class M68kDebug(qtw.QWidget):
         self.log_size = 10              # Set log size
         self.pc = 0                     # Set CPU PC as 0
         self.lines = []
+        # Allocate disassembly records for the listing
+        self.disassembly = (DisasmLine * self.log_size)()
 
         # CPU Disassembly as List
         self.m68k_debug_disassembly = qtw.QListWidget()
@@ -334,10 +500,12 @@ class M68kDebug(qtw.QWidget):
         super().update()
         # Set current registers status
         self.m68k_regs_status.setText(self.registers_status())
-        # Clear debug list and add new lines of disassembly
-        self.m68k_debug_disassembly.clear()
-        for line in self.m68k_disassembly():
-            self.m68k_debug_disassembly.addItem(qtw.QListWidgetItem(line))
+        # Rebuild the list only when the disassembly changed
+        lines = self.lines
+        if self.m68k_disassembly() != lines:
+            self.m68k_debug_disassembly.clear()
+            for line in self.lines:
+                self.m68k_debug_disassembly.addItem(qtw.QListWidgetItem(line))
 
     def registers_status(self):
         '''
@@ -353,7 +521,7 @@ class M68kDebug(qtw.QWidget):
             if reg_i % 3 == 0:
                 status += '\n'
             # Set register value
-            value = core.m68k_get_reg(0, reg_i)
+            value = debug_state.m68k_regs[reg_i]
             # Format register name and value as status
             status += '{0}={1:08x} '.format(register, value & 0xffffffff)
             # Define current M68K PC
@@ -368,27 +536,21 @@ class M68kDebug(qtw.QWidget):
         '''
         # Defines lines as empty list
         self.lines = []
-        # Iterate over log_size n lines
-        for i in range(self.log_size):
-            # Allocate disassembly buffer
-            disassembly = create_string_buffer(2048)
+        # Disassemble log_size lines at once, cached in the core
+        core.disasm_m68k(self.pc, self.log_size, self.disassembly)
+        for disassembly in self.disassembly:
             # Define current PC as old PC for reference
-            old_pc = self.pc
+            old_pc = disassembly.address
             # Define instruction as empty
             instruction = ''
-            # Get disassembly and save current M68K PC
-            self.pc += core.m68k_disassemble(disassembly, self.pc, 1)
-            # Check if old PC is equal setted breakpoint and pause emulation
-            # in current instruction
+            # Save current M68K PC
+            self.pc = old_pc + disassembly.length
+            # The core stops before the breakpoint, flag its instruction
             if old_pc == breakpoint and breakpoint_state:
-                global pause_emulation
-                pause_emulation = True
-                # add a flag at start of the string to identify current
-                # instruction
                 instruction += '> '
             # Format disassembly and PC addr as string
             instruction += '[0x{:08x}]: {}'.format(
-                old_pc, disassembly.value.decode().lower())
+                old_pc, disassembly.text.decode().lower())
             # Append disassembly in list
             self.lines.append(instruction)
         return self.lines
@@ -412,6 +574,9 @@ class Z80Debug(qtw.QWidget):
         self.width = 320                # Set Window Height
         self.log_size = 10              # Set log size
         self.pc = 0                     # Set CPU PC as 0
+        self.lines = []
+        # Allocate disassembly records for the listing
+        self.disassembly = (DisasmLine * self.log_size)()
 
         # CPU Disassembly as List
         self.z80_debug_disassembly = qtw.QListWidget()
@@ -452,10 +617,12 @@ class Z80Debug(qtw.QWidget):
         super().update()
         # Set current registers status
         self.z80_regs_status.setText(self.registers_status())
-        # Clear debug list and add new lines of disassembly
-        self.z80_debug_disassembly.clear()
-        for line in self.z80_disassembly():
-            self.z80_debug_disassembly.addItem(qtw.QListWidgetItem(line))
+        # Rebuild the list only when the disassembly changed
+        lines = self.lines
+        if self.z80_disassembly() != lines:
+            self.z80_debug_disassembly.clear()
+            for line in self.lines:
+                self.z80_debug_disassembly.addItem(qtw.QListWidgetItem(line))
 
     def registers_status(self):
         '''
@@ -471,7 +638,7 @@ class Z80Debug(qtw.QWidget):
             if reg_i % 3 == 0:
                 status += '\n'
             # Set register value
-            value = core.z80_get_reg(reg_i)
+            value = debug_state.z80_regs[reg_i]
             # Format register name and value as status
             status += '{0}={1:08x} '.format(register, value & 0xffffffff)
             # Define current M68K PC
@@ -485,17 +652,16 @@ class Z80Debug(qtw.QWidget):
         Get Z80 Disassembly at current PC.
         '''
         # Defines lines as empty list
-        lines = []
-        # Iterate over log_size n lines
-        for i in range(self.log_size):
-            # Allocate disassembly buffer
-            disassembly = create_string_buffer(2048)
+        self.lines = []
+        # Disassemble log_size lines at once, cached in the core
+        core.disasm_z80(self.pc, self.log_size, self.disassembly)
+        for disassembly in self.disassembly:
             # Define current PC as old PC for reference
-            old_pc = self.pc
+            old_pc = disassembly.address
             # Define instruction as empty
             instruction = ''
-            # Get disassembly and save current Z80 PC
-            self.pc += core.z80_disassemble(disassembly, self.pc)
+            # Save current Z80 PC
+            self.pc = old_pc + disassembly.length
             # Check if old PC is equal setted breakpoint and pause emulation
             # in current instruction
             # if old_pc == breakpoint and breakpoint_state:
@@ -506,10 +672,10 @@ class Z80Debug(qtw.QWidget):
             #     instruction += '> '
             # Format disassembly and PC addr as string
             instruction += '[0x{:08x}]: {}'.format(
-                old_pc, disassembly.value.decode().lower())
+                old_pc, disassembly.text.decode().lower())
             # Append disassembly in list
-            lines.append(instruction)
-        return lines
+            self.lines.append(instruction)
+        return self.lines
 
     def get_pc(self):
         '''
@@ -528,7 +694,7 @@ class BreakpointDebug(qtw.QWidget):
         super().__init__()
         self.title = 'Breakpoint Debug'     # Set Window Title
         self.setWindowTitle(self.title)
-        self.height = 70                    # Set Window Height
+        self.height = 300                   # Set Window Height
         self.width = 240                    # Set Window Size
 
         # Create Breakpoint Button
@@ -537,11 +703,26 @@ class BreakpointDebug(qtw.QWidget):
         self.bp_input = qtw.QLineEdit()
         self.bp_button.clicked.connect(lambda: self.set_breakpoint())
 
+        # Create Watchpoint Input as [space:]start[-end][=value] and
+        # button, writes are watched
+        self.wp_input = qtw.QLineEdit()
+        self.wp_input.setPlaceholderText('68k:ff0000-ff00ff=0000')
+        self.wp_button = qtw.QPushButton('WATCH')
+        self.wp_button.clicked.connect(lambda: self.set_watchpoint())
+        # Create list of the latest watchpoint hits
+        self.wp_hits = qtw.QListWidget()
+        self.wp_hits.font = qtg.QFont("Noto Sans Mono", 8)
+        self.wp_hits.font.setStyleHint(qtg.QFont.TypeWriter)
+        self.wp_hits.setFont(self.wp_hits.font)
+
         # Create Vertical Layout
         self.box = qtw.QVBoxLayout()
         # Add button and input to Vertical Layout
         self.box.addWidget(self.bp_input)
         self.box.addWidget(self.bp_button)
+        self.box.addWidget(self.wp_input)
+        self.box.addWidget(self.wp_button)
+        self.box.addWidget(self.wp_hits)
         # Set Window Layout as Vertical Layout
         self.setLayout(self.box)
         # Define window position and size
@@ -558,12 +739,56 @@ class BreakpointDebug(qtw.QWidget):
         global breakpoint_state
         # If breakpoint address value is not empty and setted
         if self.bp_input.text() != '':
-            # Set breakpoint value and enable breakpoint
+            # Set breakpoint value and enable breakpoint, the core checks
+            # it before every instruction
             breakpoint = int(self.bp_input.text(), 16)
             breakpoint_state = True
+            core.breakpoint_set(0, breakpoint)
         else:
             # If empty set disable breakpoint
             breakpoint_state = False
+            core.breakpoint_clear(0)
+
+    def set_watchpoint(self):
+        '''
+        Set write watchpoint, an empty input clears it
+        '''
+        text = self.wp_input.text().strip().lower()
+        if text == '':
+            core.watchpoint_clear(0)
+            return
+        space = 0
+        if ':' in text:
+            name, text = text.split(':', 1)
+            space = watch_spaces.index(name) if name in watch_spaces else 0
+        access, match, mask = watch_write, 0, 0
+        if '=' in text:
+            text, value = text.split('=', 1)
+            access |= 4
+            match, mask = int(value, 16), (1 << (4 * len(value))) - 1
+        start, _, end = text.partition('-')
+        start = int(start, 16)
+        end = int(end, 16) if end else start
+        if not core.watchpoint_set(0, space, start, end, access, match, mask):
+            statusbar.showMessage('Invalid watchpoint')
+
+    def update(self):
+        '''
+        Append the hits since the last update, keep the latest 256
+        '''
+        super().update()
+        count = core.watchpoint_get_hits(watch_hits, len(watch_hits))
+        for hit in watch_hits[:count]:
+            old = ('?' if hit.old_value == watch_no_value
+                   else '{:0{}x}'.format(hit.old_value, hit.size * 2))
+            self.wp_hits.addItem('{} {:06x} {}:{:06x} {} -> {:0{}x}'.format(
+                'Z80' if hit.z80 else '68K', hit.pc,
+                watch_spaces[hit.space], hit.address, old,
+                hit.new_value, hit.size * 2))
+        while self.wp_hits.count() > len(watch_hits):
+            self.wp_hits.takeItem(0)
+        if count:
+            self.wp_hits.scrollToBottom()
 
 
 class Display(qtw.QWidget):
@@ -584,32 +809,48 @@ class Display(qtw.QWidget):
         self.parent = parent
         # Define total frames executed as 0
         self.frames = 0
+        # Define last frame count seen from the emulation thread
+        self.last_frames = 0
+        self.last_stops = 0
         # Define turbo as disabled
         self.turbo = False
         # Set screen buffers in VDP
         self.set_vdp_buffers()
-        self.set_audio_buffer()
         # Define frame elapsed times (fps) as deque
         self.frame_times = deque([20], 1000)
+        self.timing = False
+        self.fm_mute = 0
 
-        # Start a timer for run frames every 16ms
+        # Start a timer polling the emulation thread for new frames every 4ms
         timer = qt.QTimer(self)
         timer.timeout.connect(self.frame)
-        timer.setInterval(16)
+        timer.setInterval(4)
         timer.start()
         self.timer = timer
 
+        # Use the device rate, fall back to audio_rate if the core refuses it
+        rate = qtm.QAudioDeviceInfo.defaultOutputDevice().preferredFormat().sampleRate()
+        if rate <= 0 or not core.mixer_set_output(audio_format_s16, rate):
+            rate = audio_rate
+            core.mixer_set_output(audio_format_s16, rate)
         audio_format = qtm.QAudioFormat();
-        audio_format.setSampleRate(44100)
+        audio_format.setSampleRate(rate)
         audio_format.setChannelCount(2)
-        audio_format.setSampleSize(32)
+        audio_format.setSampleSize(16)
         audio_format.setCodec("audio/pcm")
         audio_format.setByteOrder(qtm.QAudioFormat.LittleEndian)
         audio_format.setSampleType(qtm.QAudioFormat.SignedInt)
+        core.audio_set_latency(audio_latency_frames)
         self.audio_output = qtm.QAudioOutput(audio_format, self)
         self.audio_output.setVolume(1)
-        self.audio_output.setBufferSize(audio_buffer_size)
-        self.sample = qt.QBuffer()
+        self.audio_output.setBufferSize(audio_latency_frames * 4)
+        self.audio_stream = AudioStream(self)
+        self.audio_output.start(self.audio_stream)
+        # Without an audio device nothing drains the ring, pace on the clock
+        if self.audio_output.error() != qtm.QAudio.NoError:
+            core.emulation_set_pacing(emulation_pace_clock)
+        # Keep rewind snapshots while frames run
+        core.rewind_init(rewind_budget, rewind_interval)
         # Define last_fps_time as current time in timer
         self.last_fps_time = qt.QTime.currentTime()
 
@@ -676,6 +917,22 @@ class Display(qtw.QWidget):
         menu_file_turbo.setShortcut(qtg.QKeySequence(qt.Qt.Key_Space))
         menu_file.addAction(menu_file_turbo)
         menu_file.addSeparator()
+        menu_file_save_state = qtw.QAction('Save state', self)
+        menu_file_save_state.triggered.connect(self.save_state)
+        menu_file_save_state.setShortcut(qtg.QKeySequence(qt.Qt.Key_F5))
+        menu_file.addAction(menu_file_save_state)
+        menu_file_load_state = qtw.QAction('Load state', self)
+        menu_file_load_state.triggered.connect(self.load_state)
+        menu_file_load_state.setShortcut(qtg.QKeySequence(qt.Qt.Key_F8))
+        menu_file.addAction(menu_file_load_state)
+        self.menu_file_record_movie = qtw.QAction('Record movie', self)
+        self.menu_file_record_movie.setCheckable(True)
+        self.menu_file_record_movie.toggled.connect(self.record_movie)
+        menu_file.addAction(self.menu_file_record_movie)
+        menu_file_play_movie = qtw.QAction('Play movie', self)
+        menu_file_play_movie.triggered.connect(self.play_movie)
+        menu_file.addAction(menu_file_play_movie)
+        menu_file.addSeparator()
         menu_file_quit = qtw.QAction('Quit', self)
         menu_file_quit.triggered.connect(self.quit)
         menu_file_quit.setShortcut(qtg.QKeySequence.Quit)
@@ -685,6 +942,17 @@ class Display(qtw.QWidget):
         menu_options_screenshot.triggered.connect(self.take_screenshot)
         menu_options_screenshot.setShortcut(qtg.QKeySequence(qt.Qt.Key_Tab))
         menu_options.addAction(menu_options_screenshot)
+        menu_options_fast_fm = qtw.QAction('Fast FM core', self)
+        menu_options_fast_fm.setCheckable(True)
+        menu_options_fast_fm.toggled.connect(self.fast_fm)
+        menu_options.addAction(menu_options_fast_fm)
+        menu_options_mute = menu_options.addMenu('Mute FM')
+        for i, name in enumerate(['Channel {}'.format(n) for n in range(1, 7)] + ['DAC']):
+            menu_options_mute_channel = qtw.QAction(name, self)
+            menu_options_mute_channel.setCheckable(True)
+            menu_options_mute_channel.toggled.connect(
+                lambda checked, bit=1 << i: self.mute_fm(bit, checked))
+            menu_options_mute.addAction(menu_options_mute_channel)
         # Add child menus for Dumps
         menu_dump_vram = qtw.QAction('Dump VRAM', self)
         menu_dump_vram.triggered.connect(lambda: self.vram_debug.dump())
@@ -692,6 +960,22 @@ class Display(qtw.QWidget):
         menu_dump_cram = qtw.QAction('Dump CRAM', self)
         menu_dump_cram.triggered.connect(lambda: self.cram_debug.dump())
         menu_dump.addAction(menu_dump_cram)
+        menu_dump_ym2612 = qtw.QAction('Record YM2612 log', self)
+        menu_dump_ym2612.setCheckable(True)
+        menu_dump_ym2612.toggled.connect(self.record_ym2612_log)
+        menu_dump.addAction(menu_dump_ym2612)
+        menu_dump_vdp = qtw.QAction('Record VDP trace', self)
+        menu_dump_vdp.setCheckable(True)
+        menu_dump_vdp.toggled.connect(self.record_vdp_trace)
+        menu_dump.addAction(menu_dump_vdp)
+        menu_dump_profile = qtw.QAction('Record profile', self)
+        menu_dump_profile.setCheckable(True)
+        menu_dump_profile.toggled.connect(self.record_profile)
+        menu_dump.addAction(menu_dump_profile)
+        menu_dump_timing = qtw.QAction('Time subsystems', self)
+        menu_dump_timing.setCheckable(True)
+        menu_dump_timing.toggled.connect(self.time_subsystems)
+        menu_dump.addAction(menu_dump_timing)
         # Add child menus for M68k Debug
         menu_m68k_step = qtw.QAction('Step Frame', self)
         menu_m68k_step.triggered.connect(lambda: self.step_frame())
@@ -703,6 +987,8 @@ class Display(qtw.QWidget):
         '''
         Quit Function
         '''
+        core.emulation_stop()
+        core.rewind_shutdown()
         app.quit()
 
     @qt.pyqtSlot()
@@ -717,15 +1003,7 @@ class Display(qtw.QWidget):
         global scaled_buffer
         scaled_buffer = create_string_buffer(
             320*240*4)
-        core.sega3155313_set_buffers(screen_buffer, scaled_buffer)
-
-    def set_audio_buffer(self):
-        '''
-        Allocate buffer for audio Stream.
-        '''
-        global audio_buffer
-        audio_buffer = create_string_buffer(1080 * 2)
-        core.ym2612_set_buffer(audio_buffer)
+        core.sega3155313_set_scaled_buffer(scaled_buffer)
 
     @qt.pyqtSlot()
     def load_cartridge(self):
@@ -738,6 +1016,12 @@ class Display(qtw.QWidget):
             self, "Load Cartridge", os.getcwd(), "Sega Genesis Cartridge dump (*.bin *.gen *.zip *.md)")
         if not selected_file:
             return
+        # A recording in progress is offered for saving first
+        self.menu_file_record_movie.setChecked(False)
+        # The emulation thread must not run while the cartridge is swapped
+        core.emulation_stop()
+        core.rewind_reset()
+        core.movie_stop()
         self.cartridge = Cartridge(selected_file)
         self.cartridge.load()
         self.parent.setWindowTitle('Kaiser - {}'.format(self.cartridge.get_title()))
@@ -746,6 +1030,9 @@ class Display(qtw.QWidget):
         core.power_on()
         # Reset M68K CPU
         core.reset_emulation()
+        # Run frames on the emulation thread
+        core.emulation_pause(int(pause_emulation))
+        core.emulation_start()
         # Activate Screen Display
         self.activateWindow()
 
@@ -754,7 +1041,95 @@ class Display(qtw.QWidget):
         '''
         Perform emulation reset
         '''
-        self.reset_emulation = True
+        core.emulation_reset()
+
+    @qt.pyqtSlot()
+    def save_state(self):
+        '''
+        Save the machine to the quick save state file
+        '''
+        if not hasattr(self, 'cartridge'):
+            return
+        try:
+            os.mkdir(states_dir)
+        except OSError:
+            pass
+        # States are taken between frames, hold the emulation thread
+        core.emulation_stop()
+        state = create_string_buffer(core.state_size())
+        size = core.state_save(state)
+        core.emulation_start()
+        with open(os.path.join(states_dir, 'quick.state'), 'wb') as f:
+            f.write(state.raw[:size])
+        statusbar.showMessage('State saved')
+
+    @qt.pyqtSlot()
+    def load_state(self):
+        '''
+        Load the machine from the quick save state file
+        '''
+        if not hasattr(self, 'cartridge'):
+            return
+        try:
+            with open(os.path.join(states_dir, 'quick.state'), 'rb') as f:
+                data = f.read()
+        except OSError:
+            statusbar.showMessage('No saved state')
+            return
+        core.emulation_stop()
+        loaded = core.state_load(data, len(data))
+        core.emulation_start()
+        statusbar.showMessage('State loaded' if loaded else
+                              'State is from another cartridge or version')
+
+    def record_movie(self, checked):
+        '''
+        Start recording input from the current machine, on stop save
+        the movie
+        '''
+        if not hasattr(self, 'cartridge'):
+            return
+        # Movies start and end between frames, hold the emulation thread
+        core.emulation_stop()
+        if checked:
+            core.movie_record(0)
+            core.emulation_start()
+            statusbar.showMessage('Recording movie')
+            return
+        core.movie_stop()
+        movie = create_string_buffer(max(core.movie_size(), 1))
+        size = core.movie_save(movie)
+        core.emulation_start()
+        try:
+            os.mkdir(movies_dir)
+        except OSError:
+            pass
+        selected_file, _ = qtw.QFileDialog.getSaveFileName(
+            self, "Save Movie", os.path.join(movies_dir, 'movie.kmv'), "Kaiser movie (*.kmv)")
+        if selected_file and size:
+            with open(selected_file, 'wb') as f:
+                f.write(movie.raw[:size])
+            statusbar.showMessage('Movie saved')
+
+    @qt.pyqtSlot()
+    def play_movie(self):
+        '''
+        Play a movie recorded for the loaded cartridge
+        '''
+        if not hasattr(self, 'cartridge'):
+            return
+        selected_file, _ = qtw.QFileDialog.getOpenFileName(
+            self, "Play Movie", movies_dir, "Kaiser movie (*.kmv)")
+        if not selected_file:
+            return
+        with open(selected_file, 'rb') as f:
+            data = f.read()
+        self.menu_file_record_movie.setChecked(False)
+        core.emulation_stop()
+        played = core.movie_play(data, len(data))
+        core.emulation_start()
+        statusbar.showMessage('Playing movie' if played else
+                              'Movie is from another cartridge or version')
 
     @qt.pyqtSlot()
     def pause_emulation(self):
@@ -764,18 +1139,117 @@ class Display(qtw.QWidget):
         global pause_emulation
         global breakpoint_state
         pause_emulation = not pause_emulation
-    
+        core.emulation_pause(int(pause_emulation))
+
     def turbo_emulation(self):
         '''
-        Increase Emulation speed
-        decrementing display iteration timer value
+        Increase Emulation speed, frames run without pacing.
+        While paused step a single frame instead
         '''
         if pause_emulation:
-            core.m68k_execute(7)
+            core.emulation_step()
         else:
             self.turbo = not self.turbo
-            self.timer.setInterval(
-                4 if self.turbo else 16)
+            core.emulation_fast_forward(int(self.turbo))
+
+    def record_ym2612_log(self, checked):
+        '''
+        Start or stop recording YM2612 register writes
+        '''
+        # The log is opened and closed between frames
+        running = core.emulation_running()
+        core.emulation_stop()
+        if checked:
+            core.ym2612_log_open(b'ym2612.log')
+        else:
+            core.ym2612_log_close()
+        if running:
+            core.emulation_start()
+
+    def record_vdp_trace(self, checked):
+        '''
+        Start or stop recording VDP traffic for tools/vdpreplay
+        '''
+        # The trace is opened and closed between frames
+        running = core.emulation_running()
+        core.emulation_stop()
+        if checked:
+            core.sega3155313_trace_open(b'vdp.trace')
+        else:
+            core.sega3155313_trace_close()
+        if running:
+            core.emulation_start()
+
+    def time_subsystems(self, checked):
+        '''
+        Start or stop timing every subsystem per frame, the status bar
+        shows their p95 in milliseconds while on
+        '''
+        # Scopes are reset between frames
+        running = core.emulation_running()
+        core.emulation_stop()
+        if checked:
+            core.timing_start()
+        else:
+            core.timing_stop()
+        self.timing = checked
+        if running:
+            core.emulation_start()
+
+    def record_profile(self, checked):
+        '''
+        Start profiling the 68K and Z80, on stop write the profile to
+        dumps/profile.txt and collapsed stacks to dumps/profile.folded
+        '''
+        # The profile is read and reset between frames
+        running = core.emulation_running()
+        core.emulation_stop()
+        if checked:
+            started = core.profiler_start(0)
+            if running:
+                core.emulation_start()
+            statusbar.showMessage('Profiling' if started else
+                                  'Profiler not built in, see BREAKPOINTS')
+            return
+        core.profiler_stop()
+        try:
+            os.mkdir(dumps_dir)
+        except OSError:
+            pass
+        written = (core.profiler_export_flat(
+                       os.path.join(dumps_dir, 'profile.txt').encode())
+                   and core.profiler_export_collapsed(
+                       os.path.join(dumps_dir, 'profile.folded').encode()))
+        if running:
+            core.emulation_start()
+        statusbar.showMessage('Profile saved' if written else
+                              'Profile could not be written')
+
+    def mute_fm(self, bit, checked):
+        '''
+        Mute or unmute a YM2612 channel, bit 6 is the DAC
+        '''
+        if checked:
+            self.fm_mute |= bit
+        else:
+            self.fm_mute &= ~bit
+        # The mute mask is read by the emulation thread during a frame
+        running = core.emulation_running()
+        core.emulation_stop()
+        core.ym2612_set_mute(self.fm_mute)
+        if running:
+            core.emulation_start()
+
+    def fast_fm(self, checked):
+        '''
+        Switch between Nuked OPN2 and the fast FM core
+        '''
+        # The core is reset and its registers replayed between frames
+        running = core.emulation_running()
+        core.emulation_stop()
+        core.ym2612_set_core(1 if checked else 0)
+        if running:
+            core.emulation_start()
 
     @qt.pyqtSlot()
     def take_screenshot(self):
@@ -800,10 +1274,8 @@ class Display(qtw.QWidget):
         # Set screenshot filename with index
         filename = os.path.join(
             screenshot_dir, 'screenshot{:04d}.png'.format(max_index+1))
-        # Copy raw screen buffer to QImage
-        tempbuffer = scaled_buffer.raw
-        image = qtg.QImage(tempbuffer, 320,
-                           240, qtg.QImage.Format_RGB32).copy()
+        # Copy the frame on screen to QImage
+        image = frame_image().copy()
         # Save QImage as file
         image.save(filename)
         return filename
@@ -823,92 +1295,73 @@ class Display(qtw.QWidget):
             values.append('{:.1f}'.format(1000.0/sum(q)*l))
         return ' '.join(values)
 
+    def get_timing(self):
+        '''
+        Get p95 milliseconds per frame of every timed subsystem
+        '''
+        values = []
+        for i, name in enumerate(timing_names):
+            if core.timing_get_stats(i, byref(timing_stats)):
+                values.append('{} {:.2f}'.format(name, timing_stats.p95))
+        return ' '.join(values)
+
     def step_frame(self):
         '''
         Do a step frame.
 
-        Perform a Megadrive frame, upscale the screen if necessary.
-        Update debug information if debug is on.
+        Pause the emulation thread and let it run a single Megadrive
+        frame, the display picks it up on its next poll.
 
         Only executes if a cartridge is loaded
         '''
         if hasattr(self, 'cartridge'):
-            global cycle_counter
-            self.pause_emulation = True
-            core.frame()
-            self.frames+=1
-            # Update Debug Windows
-            self.cram_debug.update()
-            self.vram_debug.update()
-            self.m68k_debug.update()
-            self.z80_debug.update()
-
-            # Set scale filter as None and Zoom Level 1
-            core.scale_filter('None', 1)
-
-            # Blit Screen
-            blit_screen(self.label, scaled_buffer, 1)
-
-            # Play audio
-            self.audio_output.start(self.sample)
-
-            # Adjust Display and MainWindow size
-            # for the new screen buffer
-            self.adjustSize()
-            self.parent.adjustSize()
-
-            # Append FPS to frame_times
-            self.frame_times.append(
-                self.last_fps_time.msecsTo(qt.QTime.currentTime()))
-            # Get current time of FPS check
-            self.last_fps_time = qt.QTime.currentTime()
-
-            cycle_counter = core.get_cycle_counter()
-            self.pause_emulation = True
+            global pause_emulation
+            pause_emulation = True
+            core.emulation_pause(1)
+            core.emulation_step()
 
     def frame(self):
         '''
-        Do a single frame.
+        Poll the emulation thread.
 
-        Perform a Megadrive frame, upscale the screen if necessary.
-        Update debug information if debug is on.
+        Frames run on the emulation thread paced by the audio clock, when
+        it has finished a new one blit the screen and update debug
+        information if debug is on.
 
         Only executes if a cartridge is loaded
         '''
         if hasattr(self, 'cartridge'):
-            global cycle_counter
+            global cycle_counter, pause_emulation
+
+            # A breakpoint pauses the emulation thread inside a frame
+            stops = core.emulation_get_stops()
+            if stops != self.last_stops:
+                self.last_stops = stops
+                pause_emulation = True
+                core.debug_snapshot(byref(debug_state))
+                self.m68k_debug.update()
+                statusbar.showMessage('Breakpoint at 0x{:06x}'.format(
+                    debug_state.m68k_regs[registers.index('pc')]))
 
-            # If reset state is set perform reset CPU
-            if self.reset_emulation:
-                core.m68k_pulse_halt()
-                core.reset_emulation()
-                self.reset_emulation = False
+            # Nothing to do until the emulation thread finished a frame
+            frames = core.emulation_get_frames()
+            if frames == self.last_frames:
+                return
+            self.frames += (frames - self.last_frames) & 0xFFFFFFFF
+            self.last_frames = frames
 
-            # If pause state is set perform pause CPU
-            # And execute 1 frame
-            if not pause_emulation:
-                core.frame()
-                self.frames += 1
+            # Take one snapshot of the core for all debugger windows
+            core.debug_snapshot(byref(debug_state))
 
             # Update Debug Windows
             self.cram_debug.update()
             self.vram_debug.update()
             self.m68k_debug.update()
             self.z80_debug.update()
-
-            # Set scale filter as None and Zoom Level 1
-            core.scale_filter('None', 1)
+            self.bp_debug.update()
 
             # Blit Screen
-            blit_screen(self.label, scaled_buffer, 1)
-
-            # Play audio
-            # self.sample.close()
-            # self.sample.setData(audio_buffer)
-            # self.sample.open(qt.QIODevice.ReadOnly)
-            # self.sample.seek(0)
-            # self.audio_output.start(self.sample)
-            #print(audio_buffer[0:10])
+            blit_screen(self.label)
 
             # Adjust Display and MainWindow size
             # for the new screen buffer
@@ -921,12 +1374,16 @@ class Display(qtw.QWidget):
             # Get current time of FPS check
             self.last_fps_time = qt.QTime.currentTime()
 
-            cycle_counter = core.get_cycle_counter()
+            cycle_counter = debug_state.m68k_cycles
 
             # If cartridge is loaded display Status
             # with current FPS and Cycles runned
             if statusbar and hasattr(self, 'cartridge'):
-                if self.frames % 2:
+                if self.frames % 2 and self.timing:
+                    statusbar.showMessage('Frame: {} (fps: {}) (p95 ms: {})'.format(
+                        self.frames, self.get_fps(), self.get_timing()
+                    ))
+                elif self.frames % 2:
                     statusbar.showMessage('Frame: {} (fps: {}) (cycles: {})'.format(
                         self.frames, self.get_fps(), cycle_counter
                     ))
@@ -954,6 +1411,10 @@ class MainWindow(qtw.QMainWindow):
         On key press on Main Window interpret as
         Joysticks and if not a joypad key map as Shortcut
         '''
+        if event.key() == rewind_key:
+            if not event.isAutoRepeat():
+                core.emulation_rewind(1)
+            return
         try:
             key, pad = keymap_r[event.key()]
             core.sega3155345_pad_press_button(pad, buttons.index(key))
@@ -965,6 +1426,10 @@ class MainWindow(qtw.QMainWindow):
         On key release on Main Window interpret as
         Joysticks and if not a joypad key map as Shortcut
         '''
+        if event.key() == rewind_key:
+            if not event.isAutoRepeat():
+                core.emulation_rewind(0)
+            return
         try:
             key, pad = keymap_r[event.key()]
             core.sega3155345_pad_release_button(pad, buttons.index(key))
@@ -976,16 +1441,29 @@ class MainWindow(qtw.QMainWindow):
         app.quit()
 
 
-def blit_screen(label, scaled_buffer, zoom_level):
+def frame_image(take=False):
+    '''
+    Wraps a frame of the core in a QImage, the latest complete one
+    with "take" or the one already taken.
+
+    The core owns the memory and keeps it untouched until the next
+    frame is taken, the active area sits at the top left of a
+    320 pixels wide RGB32 buffer. Only blit_screen takes frames.
+    '''
+    frame = sip.voidptr(core.sega3155313_take_frame() if take
+                        else core.sega3155313_peek_frame())
+    return qtg.QImage(frame, core.sega3155313_get_frame_width(),
+                      core.sega3155313_get_frame_height(), 320*4,
+                      qtg.QImage.Format_RGB32)
+
+
+def blit_screen(label):
     '''
     Blits the screen to a QLabel.
 
-    Creates a QImage from a RGB32 formatted buffer, creates a QPixmap from the QImage
-    and loads the pixmap into a QLabel.
+    Creates a QPixmap from the latest frame and loads it into a QLabel.
     '''
-    image = qtg.QImage(scaled_buffer, 320*zoom_level, 240 *
-                       zoom_level, qtg.QImage.Format_RGB32)
-    pixmap = qtg.QPixmap.fromImage(image)
+    pixmap = qtg.QPixmap.fromImage(frame_image(take=True))
 
     label.setPixmap(pixmap)
 
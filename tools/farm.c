@@ -0,0 +1,554 @@
+#define _POSIX_C_SOURCE 200112L
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "hardware/bus/sega3155308.h"
+#include "hardware/vdp/sega3155313.h"
+#include "hardware/apu/audio.h"
+#include "hardware/system/movie.h"
+#include "runner.h"
+
+/******************************************************************************
+ *
+ *   kaiser-farm
+ *   Regression runs over a ROM library. Every manifest entry runs in a
+ *   fresh process, up to "workers" at a time, and the framebuffer and
+ *   audio of each frame are hashed. The hashes are compared with a
+ *   golden file, or written to one. Reports the first divergent frame
+ *   of every entry and the throughput of the whole run.
+ *
+ *   usage: kaiser-farm manifest.txt [-j workers] [-g golden.txt]
+ *                                   [-w golden.txt]
+ *
+ *   Manifests hold one "name rom.bin frames [input.txt]" line per
+ *   entry, the input a movie or a kaiser-headless script. Golden files
+ *   hold one "name frame video audio" line per frame, hashes in hex,
+ *   frames missing from them are not compared.
+ *   Exits with 2 when an entry diverges, has no golden hashes or fails.
+ *
+ ******************************************************************************/
+
+#define FARM_MCLOCK 53693175        // NTSC master clock
+#define FARM_LINE_CYCLES 3420       // Master clocks per line
+#define FARM_NAME_SIZE 64
+#define FARM_PATH_SIZE 1024
+#define FARM_POLL_MS 100            // Wait on results before looking for exited workers
+
+enum
+{
+    FARM_QUEUED = 0,
+    FARM_RUNNING,
+    FARM_DONE,
+    FARM_FAILED,                    // ROM or input could not be read, or the movie is of another ROM
+    FARM_CRASHED                    // Worker exited without a result
+};
+
+enum
+{
+    FARM_RECORD_FRAME = 0,          // Hashes of one frame, only while writing a golden file
+    FARM_RECORD_DONE,
+    FARM_RECORD_FAILED
+};
+
+enum
+{
+    FARM_DIFF_VIDEO = 1,
+    FARM_DIFF_AUDIO = 2
+};
+
+typedef struct _farm_hashes
+{
+    unsigned long long video;
+    unsigned long long audio;
+} farm_hashes;
+
+// Define a frame of a golden file, frames it skips are not compared
+typedef struct _farm_golden_frame
+{
+    farm_hashes hashes;
+    int present;
+} farm_golden_frame;
+
+typedef struct _farm_job
+{
+    char name[FARM_NAME_SIZE];
+    char rom[FARM_PATH_SIZE];
+    char input[FARM_PATH_SIZE];     // Empty without input
+    long frames;
+    farm_golden_frame *golden;      // Frames of the golden file, NULL without
+    long golden_frames;             // Frames up to the last one in the golden file
+    long golden_count;              // Frames in the golden file
+    farm_hashes *hashes;            // Frames to write, only with -w
+    pid_t pid;
+    int state;
+    long diverged;                  // First divergent frame, -1 if none
+    int diff;                       // FARM_DIFF_* of that frame
+    double seconds;                 // Run time in the worker
+} farm_job;
+
+// Define what workers send back through the result pipe, one write each
+typedef struct _farm_record
+{
+    int type;
+    int job;
+    long frame;                     // FRAME: the frame, DONE: the first divergent one or -1
+    int diff;
+    double seconds;
+    farm_hashes hashes;
+} farm_record;
+
+extern int lines_per_frame;
+
+static farm_job *jobs;
+static int job_count = 0;
+static int writing = 0;
+
+static unsigned char audio_buffer[AUDIO_RING_FRAMES * 4];
+
+static double farm_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/******************************************************************************
+ *
+ *   Hash
+ *   XXH64 of "size" bytes: four multiply and rotate lanes over 32 byte
+ *   stripes, merged and mixed down at the end
+ *
+ ******************************************************************************/
+#define FARM_PRIME1 0x9E3779B185EBCA87ULL
+#define FARM_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define FARM_PRIME3 0x165667B19E3779F9ULL
+#define FARM_PRIME4 0x85EBCA77C2B2AE63ULL
+#define FARM_PRIME5 0x27D4EB2F165667C5ULL
+#define FARM_ROTATE(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static unsigned long long farm_read64(const unsigned char *p)
+{
+    unsigned long long value;
+    memcpy(&value, p, 8);
+    return value;
+}
+
+static unsigned long long farm_round(unsigned long long lane, unsigned long long input)
+{
+    lane += input * FARM_PRIME2;
+    lane = FARM_ROTATE(lane, 31);
+    return lane * FARM_PRIME1;
+}
+
+static unsigned long long farm_merge(unsigned long long hash, unsigned long long lane)
+{
+    hash ^= farm_round(0, lane);
+    return hash * FARM_PRIME1 + FARM_PRIME4;
+}
+
+static unsigned long long farm_hash(const unsigned char *data, size_t size)
+{
+    const unsigned char *end = data + size;
+    unsigned long long hash, v1, v2, v3, v4;
+    unsigned int word;
+
+    if (size >= 32)
+    {
+        v1 = FARM_PRIME1 + FARM_PRIME2;
+        v2 = FARM_PRIME2;
+        v3 = 0;
+        v4 = 0 - FARM_PRIME1;
+        for (; data + 32 <= end; data += 32)
+        {
+            v1 = farm_round(v1, farm_read64(data));
+            v2 = farm_round(v2, farm_read64(data + 8));
+            v3 = farm_round(v3, farm_read64(data + 16));
+            v4 = farm_round(v4, farm_read64(data + 24));
+        }
+        hash = FARM_ROTATE(v1, 1) + FARM_ROTATE(v2, 7) + FARM_ROTATE(v3, 12) + FARM_ROTATE(v4, 18);
+        hash = farm_merge(hash, v1);
+        hash = farm_merge(hash, v2);
+        hash = farm_merge(hash, v3);
+        hash = farm_merge(hash, v4);
+    }
+    else
+        hash = FARM_PRIME5;
+    hash += size;
+
+    for (; data + 8 <= end; data += 8)
+    {
+        hash ^= farm_round(0, farm_read64(data));
+        hash = FARM_ROTATE(hash, 27) * FARM_PRIME1 + FARM_PRIME4;
+    }
+    if (data + 4 <= end)
+    {
+        memcpy(&word, data, 4);
+        hash ^= (unsigned long long)word * FARM_PRIME1;
+        hash = FARM_ROTATE(hash, 23) * FARM_PRIME2 + FARM_PRIME3;
+        data += 4;
+    }
+    for (; data < end; data++)
+    {
+        hash ^= *data * FARM_PRIME5;
+        hash = FARM_ROTATE(hash, 11) * FARM_PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= FARM_PRIME2;
+    hash ^= hash >> 29;
+    hash *= FARM_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/******************************************************************************
+ *
+ *   Files
+ *   Manifests and golden files, ROMs and inputs are read by runner.c
+ *
+ ******************************************************************************/
+static int farm_manifest(const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    char line[2 * FARM_PATH_SIZE + 128];
+    farm_job *job;
+    int size = 0, fields;
+
+    if (!file)
+        return 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '#')
+            continue;
+        if (job_count == size)
+        {
+            size = size ? size * 2 : 64;
+            jobs = realloc(jobs, size * sizeof(farm_job));
+        }
+        job = &jobs[job_count];
+        memset(job, 0, sizeof(farm_job));
+        fields = sscanf(line, "%63s %1023s %ld %1023s", job->name, job->rom, &job->frames, job->input);
+        if (fields < 3 || job->frames <= 0)
+            continue;
+        job->diverged = -1;
+        job_count++;
+    }
+    fclose(file);
+    return 1;
+}
+
+static farm_job *farm_find(const char *name)
+{
+    int i;
+    for (i = 0; i < job_count; i++)
+        if (!strcmp(jobs[i].name, name))
+            return &jobs[i];
+    return NULL;
+}
+
+// Frames past the end of the run are ignored
+static int farm_golden(const char *filename)
+{
+    FILE *file = fopen(filename, "r");
+    char line[256], name[FARM_NAME_SIZE];
+    farm_hashes hashes;
+    farm_job *job;
+    long frame;
+
+    if (!file)
+        return 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '#' || sscanf(line, "%63s %ld %llx %llx", name, &frame, &hashes.video, &hashes.audio) != 4)
+            continue;
+        job = farm_find(name);
+        if (!job || frame < 0 || frame >= job->frames)
+            continue;
+        if (!job->golden)
+            job->golden = calloc(job->frames, sizeof(farm_golden_frame));
+        if (!job->golden)
+            continue;
+        job->golden_count += !job->golden[frame].present;
+        job->golden[frame].hashes = hashes;
+        job->golden[frame].present = 1;
+        if (frame >= job->golden_frames)
+            job->golden_frames = frame + 1;
+    }
+    fclose(file);
+    return 1;
+}
+
+static int farm_write_golden(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    long frame;
+    int i;
+
+    if (!file)
+        return 0;
+    fprintf(file, "# kaiser-farm golden hashes: name frame video audio\n");
+    for (i = 0; i < job_count; i++)
+    {
+        if (jobs[i].state != FARM_DONE)
+            continue;
+        for (frame = 0; frame < jobs[i].frames; frame++)
+            fprintf(file, "%s %ld %016llx %016llx\n", jobs[i].name, frame, jobs[i].hashes[frame].video,
+                    jobs[i].hashes[frame].audio);
+    }
+    fclose(file);
+    return 1;
+}
+
+/******************************************************************************
+ *
+ *   Worker
+ *   Run one entry in a process of its own, so every entry starts from
+ *   the same power on state. Records are smaller than PIPE_BUF, the
+ *   writes of several workers never interleave.
+ *
+ ******************************************************************************/
+static void farm_send(int output, const farm_record *record)
+{
+    while (write(output, record, sizeof(farm_record)) < 0 && errno == EINTR)
+        ;
+}
+
+static void farm_worker(int index, int output)
+{
+    farm_job *job = &jobs[index];
+    run_input *script = NULL;
+    farm_record record;
+    unsigned char *rom, *movie = NULL;
+    unsigned int script_count = 0, next_input = 0, fill;
+    int diff;
+    long rom_size, movie_length, n, diverged = -1;
+    double start;
+
+    memset(&record, 0, sizeof(record));
+    record.job = index;
+    record.type = FARM_RECORD_FAILED;
+    rom = runner_load(job->rom, &rom_size);
+    if (job->input[0])
+    {
+        movie = runner_load(job->input, &movie_length);
+        if (movie && (movie_length < 4 || memcmp(movie, MOVIE_MAGIC, 4)))
+        {
+            free(movie);
+            movie = NULL;
+            script = runner_script(job->input, &script_count);
+        }
+    }
+    if (!rom || (job->input[0] && !movie && !script) || !runner_start(rom, rom_size) ||
+        (movie && !movie_play(movie, movie_length)))
+    {
+        farm_send(output, &record);
+        return;
+    }
+
+    start = farm_now();
+    for (n = 0; n < job->frames; n++)
+    {
+        fill = runner_frame(n, script, script_count, &next_input, audio_buffer);
+        record.hashes.video = farm_hash(sega3155313_take_frame(), VDP_FRAME_BYTES);
+        record.hashes.audio = farm_hash(audio_buffer, fill * audio_get_frame_bytes());
+
+        if (writing)
+        {
+            record.type = FARM_RECORD_FRAME;
+            record.frame = n;
+            farm_send(output, &record);
+        }
+        else if (diverged < 0 && n < job->golden_frames && job->golden[n].present)
+        {
+            diff = (record.hashes.video != job->golden[n].hashes.video ? FARM_DIFF_VIDEO : 0) |
+                   (record.hashes.audio != job->golden[n].hashes.audio ? FARM_DIFF_AUDIO : 0);
+            if (diff)
+            {
+                diverged = n;
+                record.diff = diff;
+            }
+        }
+    }
+
+    record.type = FARM_RECORD_DONE;
+    record.frame = diverged;
+    record.seconds = farm_now() - start;
+    farm_send(output, &record);
+    free(script);
+    free(movie);
+    free(rom);
+}
+
+/******************************************************************************
+ *
+ *   Results
+ *   Take every record waiting in the pipe
+ *
+ ******************************************************************************/
+static void farm_collect(int input)
+{
+    farm_record record;
+    farm_job *job;
+
+    while (read(input, &record, sizeof(record)) == sizeof(record))
+    {
+        if (record.job < 0 || record.job >= job_count)
+            continue;
+        job = &jobs[record.job];
+        switch (record.type)
+        {
+        case FARM_RECORD_FRAME:
+            if (record.frame >= 0 && record.frame < job->frames)
+                job->hashes[record.frame] = record.hashes;
+            break;
+        case FARM_RECORD_DONE:
+            job->state = FARM_DONE;
+            job->diverged = record.frame;
+            job->diff = record.diff;
+            job->seconds = record.seconds;
+            break;
+        case FARM_RECORD_FAILED:
+            job->state = FARM_FAILED;
+            break;
+        }
+    }
+}
+
+static void farm_report(const farm_job *job)
+{
+    printf("%-24s %7ld frames %8.1f fps  ", job->name, job->frames, job->seconds ? job->frames / job->seconds : 0.0);
+    if (job->state == FARM_FAILED)
+        printf("can't load %s\n", job->input[0] ? "ROM or input" : "ROM");
+    else if (job->state == FARM_CRASHED)
+        printf("worker crashed\n");
+    else if (writing)
+        printf("written\n");
+    else if (!job->golden_frames)
+        printf("no golden hashes\n");
+    else if (job->diverged >= 0)
+        printf("%s%s%s differ%s at frame %ld\n", job->diff & FARM_DIFF_VIDEO ? "video" : "",
+               job->diff == (FARM_DIFF_VIDEO | FARM_DIFF_AUDIO) ? " and " : "", job->diff & FARM_DIFF_AUDIO ? "audio" : "",
+               job->diff == (FARM_DIFF_VIDEO | FARM_DIFF_AUDIO) ? "" : "s", job->diverged);
+    else if (job->golden_count < job->frames)
+        printf("ok for the %ld golden frames\n", job->golden_count);
+    else
+        printf("ok\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *manifest_name = NULL, *golden_name = NULL, *write_name = NULL;
+    long workers = sysconf(_SC_NPROCESSORS_ONLN), frames = 0;
+    int results[2], running = 0, next = 0, finished = 0, failed = 0, i, status;
+    double begin, wall, busy = 0, emulated;
+    struct pollfd wait_results;
+    pid_t pid;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc)
+            workers = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-g") && i + 1 < argc)
+            golden_name = argv[++i];
+        else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+            write_name = argv[++i];
+        else
+            manifest_name = argv[i];
+    }
+    if (!manifest_name || workers <= 0 || (golden_name && write_name))
+    {
+        printf("usage: %s manifest.txt [-j workers] [-g golden.txt] [-w golden.txt]\n", argv[0]);
+        return 1;
+    }
+    if (!farm_manifest(manifest_name) || !job_count)
+    {
+        printf("Can't read entries from %s\n", manifest_name);
+        return 1;
+    }
+    if (golden_name && !farm_golden(golden_name))
+    {
+        printf("Can't read %s\n", golden_name);
+        return 1;
+    }
+    writing = write_name != NULL;
+    for (i = 0; writing && i < job_count; i++)
+        jobs[i].hashes = calloc(jobs[i].frames, sizeof(farm_hashes));
+
+    if (pipe(results))
+    {
+        printf("Can't create the result pipe\n");
+        return 1;
+    }
+    fcntl(results[0], F_SETFL, O_NONBLOCK);
+    wait_results.fd = results[0];
+    wait_results.events = POLLIN;
+    fflush(stdout);
+
+    begin = farm_now();
+    while (finished < job_count)
+    {
+        for (; running < workers && next < job_count; next++)
+        {
+            pid = fork();
+            if (pid == 0)
+            {
+                close(results[0]);
+                farm_worker(next, results[1]);
+                _exit(0);
+            }
+            jobs[next].pid = pid;
+            jobs[next].state = pid < 0 ? FARM_CRASHED : FARM_RUNNING;
+            finished += pid < 0;
+            running += pid > 0;
+        }
+
+        poll(&wait_results, 1, FARM_POLL_MS);
+        farm_collect(results[0]);
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            // Its last records are in the pipe before it is reaped
+            farm_collect(results[0]);
+            for (i = 0; i < job_count && jobs[i].pid != pid; i++)
+                ;
+            if (i == job_count)
+                continue;
+            if (jobs[i].state == FARM_RUNNING)
+                jobs[i].state = FARM_CRASHED;
+            jobs[i].pid = 0;
+            running--;
+            finished++;
+            farm_report(&jobs[i]);
+        }
+    }
+    wall = farm_now() - begin;
+
+    for (i = 0; i < job_count; i++)
+    {
+        if (jobs[i].state == FARM_DONE)
+        {
+            frames += jobs[i].frames;
+            busy += jobs[i].seconds;
+        }
+        failed += jobs[i].state != FARM_DONE ||
+                  (!writing && (!jobs[i].golden_frames || jobs[i].diverged >= 0));
+    }
+    emulated = (double)frames * FARM_LINE_CYCLES * lines_per_frame / FARM_MCLOCK;
+    printf("entries: %d, %d failed or divergent\n", job_count, failed);
+    printf("frames: %ld in %.3f s on %ld workers\n", frames, wall, workers);
+    printf("fps: %.1f, %.1f per worker busy second\n", frames / wall, busy ? frames / busy : 0.0);
+    printf("speed: %.2fx realtime\n", emulated / wall);
+
+    if (write_name && !farm_write_golden(write_name))
+    {
+        printf("Can't write %s\n", write_name);
+        return 1;
+    }
+    return failed ? 2 : 0;
+}
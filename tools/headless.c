@@ -0,0 +1,245 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hardware/bus/sega3155308.h"
+#include "hardware/vdp/sega3155313.h"
+#include "hardware/apu/audio.h"
+#include "hardware/system/movie.h"
+#include "hardware/debug/profiler.h"
+#include "hardware/debug/timing.h"
+#include "runner.h"
+
+/******************************************************************************
+ *
+ *   kaiser-headless
+ *   Run the core without a frontend: load a ROM, run a number of frames
+ *   as fast as possible and report throughput. Input can be scripted
+ *   or played from a movie, the run recorded as a movie, the final
+ *   framebuffer and the audio dumped raw, the VDP traffic recorded
+ *   as a trace for tools/vdpreplay, the run profiled and timed per
+ *   subsystem.
+ *
+ *   usage: kaiser-headless rom.bin [-n frames] [-i input.txt]
+ *                          [-m play.kmv] [-r record.kmv]
+ *                          [-v screen.raw] [-a audio.raw] [-t trace.bin]
+ *                          [-p profile] [-s]
+ *
+ *   Input scripts hold one "frame pad buttons" line per change, the
+ *   buttons from that frame on as letters of UDLRBCAS or "-" for none.
+ *   screen.raw is 320x240 pixels of 4 bytes with the active area at the
+ *   top left, audio.raw 16 bit stereo at 44100 Hz. A recorded movie
+ *   starts from power on, a played movie runs for its own length unless
+ *   -n is given. A profile is written as profile.txt, routines and
+ *   addresses by cycles, and profile.folded, collapsed stacks for
+ *   flamegraphs, -p is refused on a BREAKPOINTS=0 build. -s reports
+ *   milliseconds per frame of every subsystem over the last frames run.
+ *
+ ******************************************************************************/
+
+#define HEADLESS_MCLOCK 53693175    // NTSC master clock
+#define HEADLESS_LINE_CYCLES 3420   // Master clocks per line
+
+extern int lines_per_frame;
+
+static short audio_buffer[AUDIO_RING_FRAMES * 2];
+static const char *timing_names[TIMING_SUBSYSTEMS] = {"68k", "z80", "vdp", "dma", "ym2612", "scale", "frame"};
+
+static double headless_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int headless_compare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    const char *rom_name = NULL, *input_name = NULL, *screen_name = NULL, *audio_name = NULL, *trace_name = NULL;
+    const char *play_name = NULL, *record_name = NULL, *profile_name = NULL;
+    char profile_file[1024];
+    long frames = 600, rom_size, movie_length, n;
+    unsigned char *rom, *movie;
+    int frames_given = 0, timed = 0;
+    run_input *script = NULL;
+    unsigned int script_count = 0, next_input = 0, fill;
+    int i;
+    double *times, start, begin, wall, emulated;
+    FILE *audio_file = NULL, *screen_file, *movie_file;
+    timing_stats stats;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            frames = atol(argv[++i]);
+            frames_given = 1;
+        }
+        else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+            input_name = argv[++i];
+        else if (!strcmp(argv[i], "-m") && i + 1 < argc)
+            play_name = argv[++i];
+        else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+            record_name = argv[++i];
+        else if (!strcmp(argv[i], "-v") && i + 1 < argc)
+            screen_name = argv[++i];
+        else if (!strcmp(argv[i], "-a") && i + 1 < argc)
+            audio_name = argv[++i];
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            trace_name = argv[++i];
+        else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+            profile_name = argv[++i];
+        else if (!strcmp(argv[i], "-s"))
+            timed = 1;
+        else
+            rom_name = argv[i];
+    }
+    if (!rom_name || frames <= 0 || (play_name && record_name))
+    {
+        printf("usage: %s rom.bin [-n frames] [-i input.txt] [-m play.kmv] [-r record.kmv] [-v screen.raw] "
+               "[-a audio.raw] [-t trace.bin] [-p profile] [-s]\n", argv[0]);
+        return 1;
+    }
+
+    rom = runner_load(rom_name, &rom_size);
+    if (!rom)
+    {
+        printf("Can't read %s\n", rom_name);
+        return 1;
+    }
+    if (input_name && !(script = runner_script(input_name, &script_count)))
+    {
+        printf("Can't read %s\n", input_name);
+        return 1;
+    }
+    if (audio_name && !(audio_file = fopen(audio_name, "wb")))
+    {
+        printf("Can't open %s\n", audio_name);
+        return 1;
+    }
+
+    if (!runner_start(rom, rom_size))
+    {
+        printf("Can't start %s\n", rom_name);
+        return 1;
+    }
+    if (play_name)
+    {
+        movie = runner_load(play_name, &movie_length);
+        if (!movie || !movie_play(movie, movie_length))
+        {
+            printf("Can't play %s\n", play_name);
+            return 1;
+        }
+        free(movie);
+        if (!frames_given)
+            frames = movie_get_frames();
+    }
+    if (record_name && !movie_record(1))
+    {
+        printf("Can't record %s\n", record_name);
+        return 1;
+    }
+    if (frames <= 0)
+    {
+        printf("Nothing to run\n");
+        return 1;
+    }
+    times = malloc(frames * sizeof(double));
+    if (trace_name && !sega3155313_trace_open(trace_name))
+    {
+        printf("Can't open %s\n", trace_name);
+        return 1;
+    }
+    if (profile_name && !profiler_start(0))
+    {
+        printf("Can't profile, the 68K was built without its instruction hook\n");
+        return 1;
+    }
+    if (timed)
+        timing_start();
+
+    begin = headless_now();
+    for (n = 0; n < frames; n++)
+    {
+        // Draining the audio ring every frame keeps it from overrunning
+        start = headless_now();
+        fill = runner_frame(n, script, script_count, &next_input, audio_buffer);
+        times[n] = headless_now() - start;
+        if (audio_file)
+            fwrite(audio_buffer, 2 * sizeof(short), fill, audio_file);
+    }
+    wall = headless_now() - begin;
+    sega3155313_trace_close();
+    profiler_stop();
+    timing_stop();
+    emulated = (double)frames * HEADLESS_LINE_CYCLES * lines_per_frame / HEADLESS_MCLOCK;
+
+    qsort(times, frames, sizeof(double), headless_compare);
+    printf("frames: %ld\n", frames);
+    printf("wall: %.3f s, emulated: %.3f s\n", wall, emulated);
+    printf("fps: %.1f\n", frames / wall);
+    printf("speed: %.2fx realtime\n", emulated / wall);
+    printf("frame ms: p50 %.3f p90 %.3f p99 %.3f max %.3f\n", times[frames / 2] * 1000,
+           times[frames * 9 / 10] * 1000, times[frames * 99 / 100] * 1000, times[frames - 1] * 1000);
+    for (i = 0; timed && i < TIMING_SUBSYSTEMS; i++)
+        if (timing_get_stats(i, &stats))
+            printf("%-6s ms: mean %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f\n", timing_names[i], stats.mean,
+                   stats.p50, stats.p95, stats.p99, stats.max);
+
+    if (audio_file)
+        fclose(audio_file);
+    if (record_name)
+    {
+        movie_stop();
+        movie = malloc(movie_size());
+        movie_length = movie ? movie_save(movie) : 0;
+        movie_file = fopen(record_name, "wb");
+        if (!movie || !movie_file)
+        {
+            printf("Can't write %s\n", record_name);
+            return 1;
+        }
+        fwrite(movie, 1, movie_length, movie_file);
+        fclose(movie_file);
+        free(movie);
+    }
+    if (profile_name)
+    {
+        snprintf(profile_file, sizeof(profile_file), "%s.txt", profile_name);
+        if (!profiler_export_flat(profile_file))
+        {
+            printf("Can't write %s\n", profile_file);
+            return 1;
+        }
+        snprintf(profile_file, sizeof(profile_file), "%s.folded", profile_name);
+        if (!profiler_export_collapsed(profile_file))
+        {
+            printf("Can't write %s\n", profile_file);
+            return 1;
+        }
+        printf("profile: %llu 68k cycles sampled\n", profiler_get_cycles());
+    }
+    if (screen_name)
+    {
+        screen_file = fopen(screen_name, "wb");
+        if (!screen_file)
+        {
+            printf("Can't open %s\n", screen_name);
+            return 1;
+        }
+        fwrite(sega3155313_take_frame(), 1, VDP_FRAME_BYTES, screen_file);
+        fclose(screen_file);
+    }
+
+    free(times);
+    free(script);
+    free(rom);
+    return 0;
+}
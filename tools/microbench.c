@@ -0,0 +1,368 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hardware/bus/sega3155308.h"
+#include "hardware/vdp/sega3155313.h"
+#include "hardware/apu/ym2612.h"
+#include "hardware/apu/resampler.h"
+
+/******************************************************************************
+ *
+ *   microbench
+ *   Time the core hot paths one at a time: bus reads per memory region,
+ *   line rendering on the dumps/vram.bin fixture, the three DMA modes,
+ *   both FM cores, the resampler and the scale filters. No ROM needed,
+ *   the cartridge is a generated pattern. Results go to stdout as JSON,
+ *   ns per operation and operations per second, to compare builds.
+ *
+ *   usage: microbench [-t seconds] [vram.bin]
+ *
+ ******************************************************************************/
+
+#define BENCH_MIN_TIME 0.25         // Default seconds per benchmark
+#define BENCH_ROM_SIZE 0x80000      // Generated cartridge size
+#define BENCH_BUS_READS 4096        // Reads per bus benchmark pass
+#define BENCH_DMA_LENGTH 0x800      // Words (bytes for fill and copy) per DMA
+#define BENCH_DMA_TARGET 0x8000     // VRAM address DMA benchmarks write to
+#define BENCH_FM_SAMPLES 1024       // FM samples per pass
+#define BENCH_FM_RATE (53693175.0 / YM2612_SAMPLE_CYCLES)
+#define BENCH_AUDIO_RATE 44100
+
+typedef struct _bench_t
+{
+    const char *name;
+    const char *unit;       // What one operation is
+    long (*run)();          // One pass, returns the operations done
+} bench_t;
+
+extern unsigned char VRAM[], RAM[];
+extern unsigned short CRAM[], VSRAM[];
+extern int screen_width, screen_height;
+extern unsigned char *screen;
+
+void scale_nearest(unsigned int *dest, unsigned int *src, int scale);
+void scale_epx(unsigned int *dest, unsigned int *src, int scale);
+
+// Define VDP register fixture, H40 with the tables where dumps/vram.bin has them:
+// plane A 0xC000, plane B 0xE000, sprites 0xF400, hscroll 0xFC00, 64x32 planes
+static const unsigned char bench_regs[REG_SIZE] = {
+    0x04, 0x74, 0x30, 0x3C, 0x07, 0x7A, 0x00, 0x00,
+    0x00, 0x00, 0xFF, 0x00, 0x81, 0x3F, 0x00, 0x02,
+    0x01, 0x00, 0x00};
+
+static unsigned char vram_fixture[VRAM_MAX_SIZE];
+static unsigned char scaled_buffer[320 * 240 * 4];
+static unsigned int scale_buffer[320 * 240 * 4 * 4];
+static short fm_buffer[BENCH_FM_SAMPLES * 2];
+static short out_buffer[BENCH_FM_SAMPLES * 2];
+static resampler_t resampler;
+static volatile unsigned int bench_sink;
+
+static double bench_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/******************************************************************************
+ *
+ *   Fixtures
+ *   Registers first so the SAT cache follows REG5, then VRAM through
+ *   the write path, then a generated CRAM
+ *
+ ******************************************************************************/
+static void bench_load_vdp()
+{
+    unsigned int i;
+
+    sega3155313_set_reg(1, bench_regs[1]);
+    for (i = 0; i < REG_SIZE; i++)
+        sega3155313_set_reg(i, bench_regs[i]);
+    for (i = 0; i < VRAM_MAX_SIZE; i++)
+        sega3155313_vram_write(i, vram_fixture[i]);
+    for (i = 0; i < CRAM_MAX_SIZE; i++)
+        CRAM[i] = ((i * 3) & 7) << 1 | ((i * 5) & 7) << 5 | ((i * 7) & 7) << 9;
+    memset(VSRAM, 0, VSRAM_MAX_SIZE * sizeof(unsigned short));
+    screen_width = (bench_regs[12] & 0x01) ? 320 : 256;
+    screen_height = (bench_regs[1] & 0x08) ? 240 : 224;
+}
+
+/******************************************************************************
+ *
+ *   Bus reads
+ *   sega3155308_read_memory_16 over one region, stepping a word at a time
+ *
+ ******************************************************************************/
+static long bench_bus(unsigned int base, unsigned int span)
+{
+    unsigned int i, sum = 0;
+    for (i = 0; i < BENCH_BUS_READS; i++)
+        sum += sega3155308_read_memory_16(base + ((i * 2) & (span - 1)));
+    bench_sink = sum;
+    return BENCH_BUS_READS;
+}
+
+static long bench_bus_rom() { return bench_bus(0x000000, BENCH_ROM_SIZE); }
+static long bench_bus_rom_mirror() { return bench_bus(0x400000, BENCH_ROM_SIZE); }
+static long bench_bus_ram() { return bench_bus(0xFF0000, MAX_RAM_SIZE); }
+static long bench_bus_z80_ram() { return bench_bus(0xA00000, 0x2000); }
+static long bench_bus_io() { return bench_bus(0xA10000, 0x20); }
+static long bench_bus_vdp_status() { return bench_bus(0xC00004, 2); }
+static long bench_bus_vdp_hvcounter() { return bench_bus(0xC00008, 2); }
+
+/******************************************************************************
+ *
+ *   Render
+ *   Every visible line of the fixture
+ *
+ ******************************************************************************/
+static long bench_render_line()
+{
+    int line;
+    for (line = 0; line < screen_height; line++)
+        sega3155313_render_line(line);
+    return screen_height;
+}
+
+/******************************************************************************
+ *
+ *   DMA
+ *   Program the transfer through the control port like a game would,
+ *   each pass is one complete DMA into BENCH_DMA_TARGET
+ *
+ ******************************************************************************/
+static void bench_dma_setup(unsigned int type, unsigned int source, unsigned int code)
+{
+    sega3155313_set_reg(19, BENCH_DMA_LENGTH & 0xFF);
+    sega3155313_set_reg(20, BENCH_DMA_LENGTH >> 8);
+    sega3155313_set_reg(21, source & 0xFF);
+    sega3155313_set_reg(22, (source >> 8) & 0xFF);
+    sega3155313_set_reg(23, type | ((source >> 16) & 0x7F));
+    sega3155313_control_port_write(((code & 3) << 14) | (BENCH_DMA_TARGET & 0x3FFF));
+    sega3155313_control_port_write(((code & 0x3C) << 2) | (BENCH_DMA_TARGET >> 14));
+}
+
+static long bench_dma_fill()
+{
+    bench_dma_setup(0x80, 0, 0x21);
+    sega3155313_write_data_port_16(0x5A5A);
+    return BENCH_DMA_LENGTH;
+}
+
+static long bench_dma_m68k()
+{
+    bench_dma_setup(0x00, 0xFF0000 >> 1, 0x21);
+    return BENCH_DMA_LENGTH;
+}
+
+static long bench_dma_copy()
+{
+    bench_dma_setup(0xC0, 0x0000, 0x31);
+    return BENCH_DMA_LENGTH;
+}
+
+/******************************************************************************
+ *
+ *   FM
+ *   Six channels keyed on with every operator audible, generated by the
+ *   selected core, then the same samples through the resampler
+ *
+ ******************************************************************************/
+static void bench_fm_patch()
+{
+    unsigned int port, ch, op, reg;
+    static const unsigned char patch[][2] = {
+        {0x30, 0x71}, {0x40, 0x10}, {0x50, 0x1F}, {0x60, 0x05},
+        {0x70, 0x02}, {0x80, 0x1F}, {0x90, 0x00}};
+
+    ym2612_init();
+    for (port = 0; port < 2; port++)
+        for (ch = 0; ch < 3; ch++)
+        {
+            for (reg = 0; reg < sizeof(patch) / sizeof(patch[0]); reg++)
+                for (op = 0; op < 4; op++)
+                {
+                    ym2612_write_memory_8(port * 2, patch[reg][0] + op * 4 + ch);
+                    ym2612_write_memory_8(port * 2 + 1, patch[reg][1]);
+                }
+            ym2612_write_memory_8(port * 2, 0xA4 + ch);
+            ym2612_write_memory_8(port * 2 + 1, 0x22 + ch);
+            ym2612_write_memory_8(port * 2, 0xA0 + ch);
+            ym2612_write_memory_8(port * 2 + 1, 0x69 + ch * 16);
+            ym2612_write_memory_8(port * 2, 0xB0 + ch);
+            ym2612_write_memory_8(port * 2 + 1, 0x07 + ch * 8);
+            ym2612_write_memory_8(port * 2, 0xB4 + ch);
+            ym2612_write_memory_8(port * 2 + 1, 0xC0);
+        }
+    for (ch = 0; ch < 7; ch++)
+    {
+        if (ch == 3)
+            continue;
+        ym2612_write_memory_8(0, 0x28);
+        ym2612_write_memory_8(1, 0xF0 | ch);
+    }
+}
+
+static long bench_fm()
+{
+    Bit32s sample[4];
+    int i, value;
+
+    for (i = 0; i < BENCH_FM_SAMPLES; i++)
+    {
+        ym2612_generate(sample);
+        value = (sample[0] + sample[2]) * 8;
+        fm_buffer[i * 2] = value > 32767 ? 32767 : (value < -32768 ? -32768 : value);
+        value = (sample[1] + sample[3]) * 8;
+        fm_buffer[i * 2 + 1] = value > 32767 ? 32767 : (value < -32768 ? -32768 : value);
+    }
+    return BENCH_FM_SAMPLES;
+}
+
+// Switching core resets it without key ons, the patch is keyed on again
+static long bench_fm_core(int core)
+{
+    if (ym2612_get_core() != core)
+    {
+        ym2612_set_core(core);
+        bench_fm_patch();
+    }
+    return bench_fm();
+}
+
+static long bench_fm_nuked()
+{
+    return bench_fm_core(YM2612_CORE_NUKED);
+}
+
+static long bench_fm_fast()
+{
+    return bench_fm_core(YM2612_CORE_FAST);
+}
+
+static long bench_fm_batch()
+{
+    return bench_fm_core(YM2612_CORE_BATCH);
+}
+
+static long bench_resampler()
+{
+    bench_sink = resampler_process(&resampler, fm_buffer, BENCH_FM_SAMPLES, out_buffer);
+    return BENCH_FM_SAMPLES;
+}
+
+/******************************************************************************
+ *
+ *   Scale
+ *   One 2x frame of the rendered fixture per filter
+ *
+ ******************************************************************************/
+static long bench_scale_nearest()
+{
+    scale_nearest(scale_buffer, (unsigned int *)screen, 2);
+    return 1;
+}
+
+static long bench_scale_epx()
+{
+    scale_epx(scale_buffer, (unsigned int *)screen, 2);
+    return 1;
+}
+
+static const bench_t benches[] = {
+    {"bus_read_16_rom", "reads", bench_bus_rom},
+    {"bus_read_16_rom_mirror", "reads", bench_bus_rom_mirror},
+    {"bus_read_16_ram", "reads", bench_bus_ram},
+    {"bus_read_16_z80_ram", "reads", bench_bus_z80_ram},
+    {"bus_read_16_io", "reads", bench_bus_io},
+    {"bus_read_16_vdp_status", "reads", bench_bus_vdp_status},
+    {"bus_read_16_vdp_hvcounter", "reads", bench_bus_vdp_hvcounter},
+    {"vdp_render_line", "lines", bench_render_line},
+    {"vdp_dma_fill", "bytes", bench_dma_fill},
+    {"vdp_dma_m68k", "words", bench_dma_m68k},
+    {"vdp_dma_copy", "bytes", bench_dma_copy},
+    {"ym2612_generate_nuked", "samples", bench_fm_nuked},
+    {"ym2612_generate_fast", "samples", bench_fm_fast},
+    {"ym2612_generate_batch", "samples", bench_fm_batch},
+    {"resampler_process", "samples", bench_resampler},
+    {"scale_nearest_2x", "frames", bench_scale_nearest},
+    {"scale_epx_2x", "frames", bench_scale_epx}};
+
+int main(int argc, char **argv)
+{
+    const char *vram_name = "dumps/vram.bin";
+    unsigned char *rom;
+    double min_time = BENCH_MIN_TIME, start, elapsed;
+    long ops, passes, i;
+    unsigned int b;
+    FILE *file;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            min_time = atof(argv[++i]);
+        else if (argv[i][0] == '-')
+        {
+            printf("usage: %s [-t seconds] [vram.bin]\n", argv[0]);
+            return 1;
+        }
+        else
+            vram_name = argv[i];
+    }
+
+    file = fopen(vram_name, "rb");
+    if (!file || fread(vram_fixture, 1, VRAM_MAX_SIZE, file) != VRAM_MAX_SIZE)
+    {
+        printf("Can't read %s\n", vram_name);
+        return 1;
+    }
+    fclose(file);
+
+    // Generated cartridge: reset vectors, then a word pattern
+    rom = malloc(BENCH_ROM_SIZE);
+    for (i = 0; i < BENCH_ROM_SIZE; i++)
+        rom[i] = (unsigned char)(i * 7 + (i >> 8));
+    memset(rom, 0, 8);
+    rom[1] = 0xFF;
+    rom[6] = 0x02;
+    sega3155313_set_scaled_buffer(scaled_buffer);
+    load_cartridge(rom, BENCH_ROM_SIZE);
+    power_on();
+    reset_emulation();
+    for (i = 0; i < MAX_RAM_SIZE; i++)
+        RAM[i] = (unsigned char)(i ^ (i >> 8));
+
+    // Keyed on FM, its first samples also feed the resampler benchmark
+    ym2612_set_core(YM2612_CORE_FAST);
+    bench_fm_patch();
+    bench_fm();
+    resampler_init(&resampler, BENCH_FM_RATE, BENCH_AUDIO_RATE, 0, 1);
+
+    printf("{\n  \"min_time\": %.3f,\n  \"benchmarks\": [\n", min_time);
+    for (b = 0; b < sizeof(benches) / sizeof(bench_t); b++)
+    {
+        // Every benchmark starts from the fixture, DMA writes over part of it
+        bench_load_vdp();
+        benches[b].run();
+        ops = passes = 0;
+        start = bench_now();
+        do
+        {
+            ops += benches[b].run();
+            passes++;
+            elapsed = bench_now() - start;
+        } while (elapsed < min_time);
+
+        printf("    {\"name\": \"%s\", \"unit\": \"%s\", \"passes\": %ld, \"ops\": %ld, "
+               "\"ns_per_op\": %.3f, \"ops_per_s\": %.1f}%s\n",
+               benches[b].name, benches[b].unit, passes, ops, elapsed * 1e9 / ops, ops / elapsed,
+               b + 1 < sizeof(benches) / sizeof(bench_t) ? "," : "");
+    }
+    printf("  ]\n}\n");
+
+    free(rom);
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hardware/bus/sega3155308.h"
+#include "hardware/vdp/sega3155313.h"
+#include "hardware/apu/mixer.h"
+#include "hardware/apu/audio.h"
+#include "runner.h"
+
+/******************************************************************************
+ *
+ *   Runner
+ *   What kaiser-headless and kaiser-farm share: reading ROMs, movies and
+ *   input scripts, bringing the core up and running scripted frames
+ *   through run_frames.
+ *
+ ******************************************************************************/
+
+static unsigned char scaled_buffer[320 * 240 * 4];
+
+// Read a whole file, at most MAX_ROM_SIZE bytes
+unsigned char *runner_load(const char *filename, long *size)
+{
+    FILE *file = fopen(filename, "rb");
+    unsigned char *data;
+
+    if (!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (*size > MAX_ROM_SIZE)
+        *size = MAX_ROM_SIZE;
+    data = malloc(*size + 1);
+    if (!data || fread(data, 1, *size, file) != (size_t)*size)
+    {
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+/******************************************************************************
+ *
+ *   Runner script
+ *   Read an input script, one "frame pad buttons" line per change, the
+ *   buttons from that frame on as letters of RUNNER_BUTTONS or "-" for
+ *   none. Lines starting with '#' are comments. Returns NULL when the
+ *   file can't be read, an empty script is not NULL.
+ *
+ ******************************************************************************/
+run_input *runner_script(const char *filename, unsigned int *count)
+{
+    FILE *file = fopen(filename, "r");
+    run_input *script = NULL;
+    char line[256], buttons[64];
+    const char *button;
+    unsigned int size = 0, i;
+
+    *count = 0;
+    if (!file)
+        return NULL;
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '#')
+            continue;
+        if (*count == size)
+        {
+            size = size ? size * 2 : 64;
+            script = realloc(script, size * sizeof(run_input));
+        }
+        if (sscanf(line, "%u %u %63s", &script[*count].frame, &script[*count].pad, buttons) != 3)
+            continue;
+        script[*count].buttons = 0;
+        for (i = 0; buttons[i]; i++)
+            if ((button = strchr(RUNNER_BUTTONS, buttons[i])) != NULL)
+                script[*count].buttons |= 1 << (button - RUNNER_BUTTONS);
+        (*count)++;
+    }
+    fclose(file);
+    return script ? script : malloc(sizeof(run_input));
+}
+
+/******************************************************************************
+ *
+ *   Runner start
+ *   Power on with "rom" the way kaiser.py does. The audio ring is drained
+ *   every frame, so rate control is off and the output rate stays at
+ *   RUNNER_AUDIO_RATE. Returns 0 if the mixer refuses the rate.
+ *
+ ******************************************************************************/
+int runner_start(unsigned char *rom, long rom_size)
+{
+    sega3155313_set_scaled_buffer(scaled_buffer);
+    load_cartridge(rom, rom_size);
+    power_on();
+    reset_emulation();
+    if (!mixer_set_output(MIXER_FORMAT_S16, RUNNER_AUDIO_RATE))
+        return 0;
+    audio_set_latency(0);
+    return 1;
+}
+
+/******************************************************************************
+ *
+ *   Runner frame
+ *   Run frame "n" of a scripted run as a one frame batch of run_frames.
+ *   Script entries from "next" on that are due by "n" are applied from
+ *   frame 0 of the batch, "next" moves past them and their frame is
+ *   overwritten, scripts are in frame order. The audio ring is
+ *   drained into "audio", room for AUDIO_RING_FRAMES frames. Returns the
+ *   audio frames drained.
+ *
+ ******************************************************************************/
+unsigned int runner_frame(unsigned int n, run_input *script, unsigned int count, unsigned int *next, void *audio)
+{
+    run_status status;
+    unsigned int due;
+
+    // Entries are used once, rebase them onto the batch in place
+    for (due = *next; due < count && script[due].frame <= n; due++)
+        script[due].frame = 0;
+    run_frames(1, due > *next ? script + *next : NULL, due - *next, NULL, 0, audio, AUDIO_RING_FRAMES, &status);
+    *next = due;
+    return status.audio_frames;
+}
@@ -0,0 +1,7 @@
+#define RUNNER_AUDIO_RATE 44100
+#define RUNNER_BUTTONS "UDLRBCAS"   // sega3155308_pad_button order
+
+unsigned char *runner_load(const char *filename, long *size);
+run_input *runner_script(const char *filename, unsigned int *count);
+int runner_start(unsigned char *rom, long rom_size);
+unsigned int runner_frame(unsigned int n, run_input *script, unsigned int count, unsigned int *next, void *audio);
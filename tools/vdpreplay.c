@@ -0,0 +1,325 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hardware/vdp/sega3155313.h"
+#include "hardware/debug/watchpoint.h"
+#include "hardware/debug/timing.h"
+
+/******************************************************************************
+ *
+ *   vdpreplay
+ *   Render the frames of a VDP trace (Dump > Record VDP trace, or
+ *   kaiser-headless -t) again with nothing but the sega3155313_* code:
+ *   port traffic is replayed at its place between the recorded lines.
+ *   Reports the render time, and writes every frame as 320x240 pixels
+ *   of 4 bytes or compares them with such a file pixel for pixel.
+ *
+ *   usage: vdpreplay trace.bin [-n passes] [-o frames.raw] [-c frames.raw]
+ *
+ ******************************************************************************/
+
+#define REPLAY_FRAME_BYTES (320 * 240 * 4)
+
+// Define trace held in memory and the replay position
+static unsigned char *trace_data;
+static long trace_size, trace_offset;
+// Define words left in the 68K DMA event at trace_offset
+static unsigned long dma_words = 0;
+
+static unsigned char frame_buffer[REPLAY_FRAME_BYTES];
+static unsigned char scaled_buffer[REPLAY_FRAME_BYTES];
+static unsigned char reference_buffer[REPLAY_FRAME_BYTES];
+
+// Define what the VDP expects from the rest of the core
+int lines_per_frame = 262;
+int cycle_counter = 0;
+extern int screen_width, screen_height;
+
+unsigned long long get_master_clock()
+{
+    return 0;
+}
+
+int m68k_cycles_run()
+{
+    return 0;
+}
+
+void sn76489_write(unsigned int value)
+{
+}
+
+unsigned char watchpoint_pages[WATCHPOINT_PAGES / 8];
+
+void watchpoint_read(unsigned int space, unsigned int address, unsigned int size, unsigned int value)
+{
+}
+
+void watchpoint_write(unsigned int space, unsigned int address, unsigned int size, unsigned int value)
+{
+}
+
+int timing_enabled = 0;
+
+void timing_begin(unsigned int subsystem)
+{
+}
+
+void timing_end(unsigned int subsystem)
+{
+}
+
+static double replay_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static unsigned int replay_byte()
+{
+    return trace_offset < trace_size ? trace_data[trace_offset++] : 0;
+}
+
+static unsigned int replay_word()
+{
+    unsigned int value = replay_byte();
+    return value | replay_byte() << 8;
+}
+
+static unsigned long long replay_varint()
+{
+    unsigned long long value = 0;
+    unsigned int shift = 0, byte;
+    do
+    {
+        byte = replay_byte();
+        value |= (unsigned long long)(byte & 0x7F) << shift;
+        shift += 7;
+    } while ((byte & 0x80) && shift < 64);
+    return value;
+}
+
+/******************************************************************************
+ *
+ *   68K read
+ *   The DMA event follows the port write that starts the transfer, the
+ *   VDP pulls its recorded words from the trace while that write runs
+ *
+ ******************************************************************************/
+unsigned int m68k_read_memory_16(unsigned int address)
+{
+    if (!dma_words)
+    {
+        if (trace_offset >= trace_size || trace_data[trace_offset] != TRACE_DMA)
+            return 0;
+        trace_offset++;
+        replay_varint();
+        dma_words = replay_varint();
+        if (!dma_words)
+            return 0;
+    }
+    dma_words--;
+    return replay_word();
+}
+
+/******************************************************************************
+ *
+ *   Frame done
+ *   Publish the frame like VBLANK does and copy its active area into
+ *   frame_buffer, the rest of frame_buffer stays black
+ *
+ ******************************************************************************/
+static void replay_frame_done(void (*frame_done)(long frame), long frame)
+{
+    const unsigned char *source;
+    int y, width, height;
+
+    sega3155313_set_vblank();
+    source = sega3155313_take_frame();
+    if (!frame_done)
+        return;
+    width = sega3155313_get_frame_width();
+    height = sega3155313_get_frame_height();
+    memset(frame_buffer, 0, REPLAY_FRAME_BYTES);
+    for (y = 0; y < height; y++)
+        memcpy(frame_buffer + y * 320 * 4, source + y * 320 * 4, width * 4);
+    frame_done(frame);
+}
+
+/******************************************************************************
+ *
+ *   Replay
+ *   One pass over the trace, "frame_done" is called with each complete
+ *   frame. Returns the lines rendered.
+ *
+ ******************************************************************************/
+static long replay_pass(void (*frame_done)(long frame))
+{
+    long lines = 0, frame = 0;
+    int started = 0;
+    unsigned int type, port, line, flags;
+
+    trace_offset = sega3155313_trace_restore(trace_data, trace_size);
+    dma_words = 0;
+    while (trace_offset < trace_size)
+    {
+        type = replay_byte();
+        replay_varint();
+        switch (type)
+        {
+        case TRACE_WRITE:
+            port = replay_byte();
+            sega3155313_write_memory_16(port, replay_word());
+            break;
+        case TRACE_READ:
+            sega3155313_read_memory_16(replay_byte());
+            break;
+        case TRACE_DMA:
+            // Words no write consumed, skip them
+            trace_offset += replay_varint() * 2;
+            break;
+        case TRACE_LINE:
+            line = replay_word();
+            flags = replay_byte();
+            screen_width = flags & 1 ? 320 : 256;
+            screen_height = flags & 2 ? 240 : 224;
+            sega3155313_render_line(line);
+            lines++;
+            break;
+        case TRACE_FRAME:
+            // Only frames recorded from their start are complete
+            if (started)
+                replay_frame_done(frame_done, frame);
+            frame += started;
+            started = 1;
+            sega3155313_clear_vblank();
+            break;
+        case TRACE_RESET:
+            sega3155313_reset();
+            break;
+        default:
+            printf("Unknown trace event %u at %ld\n", type, trace_offset - 1);
+            trace_offset = trace_size;
+        }
+    }
+    if (started)
+        replay_frame_done(frame_done, frame);
+    return lines;
+}
+
+static FILE *output_file, *compare_file;
+static long frames_written, frames_compared, frames_differ = -1;
+
+static void replay_output(long frame)
+{
+    fwrite(frame_buffer, 1, REPLAY_FRAME_BYTES, output_file);
+    frames_written++;
+}
+
+static void replay_compare(long frame)
+{
+    long i;
+
+    if (frames_differ >= 0 || fread(reference_buffer, 1, REPLAY_FRAME_BYTES, compare_file) != REPLAY_FRAME_BYTES)
+        return;
+    frames_compared++;
+    for (i = 0; i < REPLAY_FRAME_BYTES; i++)
+    {
+        if (frame_buffer[i] != reference_buffer[i])
+        {
+            frames_differ = frame;
+            printf("frame %ld differs first at x %ld y %ld\n", frame, i / 4 % 320, i / 4 / 320);
+            return;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *trace_name = NULL, *output_name = NULL, *compare_name = NULL;
+    long passes = 1, pass, lines = 0;
+    double start, wall;
+    FILE *file;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            passes = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            output_name = argv[++i];
+        else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+            compare_name = argv[++i];
+        else
+            trace_name = argv[i];
+    }
+    if (!trace_name || passes <= 0)
+    {
+        printf("usage: %s trace.bin [-n passes] [-o frames.raw] [-c frames.raw]\n", argv[0]);
+        return 1;
+    }
+
+    file = fopen(trace_name, "rb");
+    if (!file)
+    {
+        printf("Can't open %s\n", trace_name);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    trace_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    trace_data = malloc(trace_size + 1);
+    if (!trace_data || fread(trace_data, 1, trace_size, file) != (size_t)trace_size)
+    {
+        printf("Can't read %s\n", trace_name);
+        return 1;
+    }
+    fclose(file);
+    sega3155313_set_scaled_buffer(scaled_buffer);
+    if (!sega3155313_trace_restore(trace_data, trace_size))
+    {
+        printf("%s is not a VDP trace\n", trace_name);
+        return 1;
+    }
+
+    // Timed passes render only, files are handled in a separate pass
+    start = replay_now();
+    for (pass = 0; pass < passes; pass++)
+        lines += replay_pass(NULL);
+    wall = replay_now() - start;
+    printf("%ld bytes, %ld lines per pass, %ld passes\n", trace_size, lines / passes, passes);
+    printf("render: %.3f s, %.1f ns per line, %.0f lines/s\n", wall, lines ? wall * 1e9 / lines : 0.0, lines / wall);
+
+    if (output_name)
+    {
+        output_file = fopen(output_name, "wb");
+        if (!output_file)
+        {
+            printf("Can't open %s\n", output_name);
+            return 1;
+        }
+        replay_pass(replay_output);
+        fclose(output_file);
+        printf("output: %ld frames\n", frames_written);
+    }
+    if (compare_name)
+    {
+        compare_file = fopen(compare_name, "rb");
+        if (!compare_file)
+        {
+            printf("Can't open %s\n", compare_name);
+            return 1;
+        }
+        replay_pass(replay_compare);
+        fclose(compare_file);
+        if (frames_differ >= 0)
+            return 2;
+        printf("compare: %ld frames identical\n", frames_compared);
+    }
+
+    free(trace_data);
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "hardware/apu/ym2612.h"
+#include "hardware/debug/timing.h"
+
+/******************************************************************************
+ *
+ *   ymbench
+ *   Replay a YM2612 register log (Dump > Record YM2612 log) through
+ *   Nuked OPN2, the fast FM core and the batch OPN2 clock. Reports the
+ *   time each core takes and the RMS error of the fast core against
+ *   Nuked. -v fails on the first sample where the batch clock differs
+ *   from Nuked.
+ *
+ *   usage: ymbench [-v] ym2612.log [tail seconds]
+ *
+ ******************************************************************************/
+
+#define YM2612_NATIVE_RATE (53693175 / YM2612_SAMPLE_CYCLES)
+
+static unsigned char *log_data;
+static long log_size;
+
+// Define master clock for ym2612.c, held at 0 so its deferred synthesis stays
+// idle and every sample comes from the ym2612_generate calls below
+unsigned long long get_master_clock()
+{
+    return 0;
+}
+
+// Define timing scopes of ym2612.c, off as ymbench times each run itself
+int timing_enabled = 0;
+
+void timing_begin(unsigned int subsystem)
+{
+}
+
+void timing_end(unsigned int subsystem)
+{
+}
+
+static Bit64u log_sample(long offset)
+{
+    return log_data[offset] | log_data[offset + 1] << 8 | log_data[offset + 2] << 16 | (Bit64u)log_data[offset + 3] << 24;
+}
+
+static double bench_run(int core, Bit32s *output, Bit64u samples)
+{
+    long offset = 0;
+    clock_t start;
+    Bit64u bench_sample;
+    Bit32s sample[4];
+
+    // Select first, ym2612_init then resets the core without a replay
+    ym2612_set_core(core);
+    ym2612_init();
+    start = clock();
+    for (bench_sample = 0; bench_sample < samples; bench_sample++)
+    {
+        while (offset + 6 <= log_size && log_sample(offset) <= bench_sample)
+        {
+            ym2612_write_memory_8(log_data[offset + 4], log_data[offset + 5]);
+            offset += 6;
+        }
+        ym2612_generate(sample);
+        output[bench_sample * 2] = sample[0] + sample[2];
+        output[bench_sample * 2 + 1] = sample[1] + sample[3];
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *file;
+    Bit32s *reference, *fast, *batch;
+    Bit64u samples, i;
+    double tail = 1.0, nuked_time, fast_time, batch_time, error = 0, power = 0, diff;
+    const char *name = argv[0];
+    int verify = 0;
+
+    if (argc > 1 && !strcmp(argv[1], "-v"))
+    {
+        verify = 1;
+        argv++;
+        argc--;
+    }
+    if (argc < 2)
+    {
+        printf("usage: %s [-v] ym2612.log [tail seconds]\n", name);
+        return 1;
+    }
+    if (argc > 2)
+        tail = atof(argv[2]);
+
+    file = fopen(argv[1], "rb");
+    if (!file)
+    {
+        printf("Can't open %s\n", argv[1]);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    log_size = ftell(file) / 6 * 6;
+    fseek(file, 0, SEEK_SET);
+    log_data = malloc(log_size + 1);
+    if (fread(log_data, 1, log_size, file) != (size_t)log_size)
+    {
+        printf("Can't read %s\n", argv[1]);
+        return 1;
+    }
+    fclose(file);
+
+    samples = (log_size ? log_sample(log_size - 6) : 0) + (Bit64u)(tail * YM2612_NATIVE_RATE);
+    reference = malloc(samples * 2 * sizeof(Bit32s));
+    fast = malloc(samples * 2 * sizeof(Bit32s));
+    batch = malloc(samples * 2 * sizeof(Bit32s));
+    if (!reference || !fast || !batch)
+    {
+        printf("Can't allocate %llu samples\n", (unsigned long long)samples);
+        return 1;
+    }
+
+    nuked_time = bench_run(YM2612_CORE_NUKED, reference, samples);
+    fast_time = bench_run(YM2612_CORE_FAST, fast, samples);
+    batch_time = bench_run(YM2612_CORE_BATCH, batch, samples);
+
+    for (i = 0; verify && i < samples * 2; i++)
+    {
+        if (batch[i] != reference[i])
+        {
+            printf("batch differs from nuked at sample %llu: %d, expected %d (%s)\n", (unsigned long long)(i / 2),
+                   batch[i], reference[i], i & 1 ? "right" : "left");
+            return 1;
+        }
+    }
+
+    for (i = 0; i < samples * 2; i++)
+    {
+        diff = fast[i] - reference[i];
+        error += diff * diff;
+        power += (double)reference[i] * reference[i];
+    }
+    error = sqrt(error / (samples * 2));
+    power = sqrt(power / (samples * 2));
+
+    printf("%ld writes, %llu samples (%.2f s)\n", log_size / 6, (unsigned long long)samples, (double)samples / YM2612_NATIVE_RATE);
+    printf("nuked: %8.3f s %8.1fx realtime\n", nuked_time, samples / (nuked_time * YM2612_NATIVE_RATE));
+    printf("fast:  %8.3f s %8.1fx realtime\n", fast_time, samples / (fast_time * YM2612_NATIVE_RATE));
+    printf("batch: %8.3f s %8.1fx realtime\n", batch_time, samples / (batch_time * YM2612_NATIVE_RATE));
+    printf("speedup: fast %.1fx, batch %.1fx\n", nuked_time / fast_time, nuked_time / batch_time);
+    if (verify)
+        printf("batch: bit-exact\n");
+    printf("rms: reference %.1f, error %.1f (%.1f dB)\n", power, error, power > 0 && error > 0 ? 20 * log10(error / power) : 0.0);
+
+    free(reference);
+    free(fast);
+    free(batch);
+    free(log_data);
+    return 0;
+}